@@ -0,0 +1,33 @@
+#!/bin/sh
+# Compares rows/s of the ring handoff at different batch sizes
+# Usage: bench/batch_sizes.sh [<input file>] [<vertex count>]
+# When no input file is given, a PLY file with <vertex count> vertices (default 2000000) is generated
+
+cd "$(dirname "$0")/.." || exit 1
+make -s main bench/gen_ply || exit 1
+
+INPUT=${1:-}
+VERTICES=${2:-2000000}
+if [ -z "$INPUT" ]; then
+  INPUT=$(mktemp /tmp/batch_bench.XXXXXX)
+  trap 'rm -f "$INPUT" "$INPUT.out"' EXIT
+  bench/gen_ply "$VERTICES" "$INPUT" || exit 1
+fi
+
+printf "%-32s %12s %14s\n" "mode" "MB/s" "rows/s"
+run() {
+  ./main "$@" "$INPUT" "$INPUT.out" 2>&1 >/dev/null | awk -v mode="${*:-lockstep}" '/^Read / {
+    for (i = 1; i <= NF; i++) { if ($(i + 1) == "MB/s,") mbs = $i; if ($(i + 1) == "rows/s") rows = $i }
+    printf "%-32s %12s %14s\n", mode, mbs, rows
+  }'
+}
+
+run
+run --queue-depth 4
+for ROWS in 1 16 256 4096; do
+  run --batch-rows "$ROWS"
+done
+for BYTES in 4096 65536 1048576; do
+  run --batch-bytes "$BYTES"
+  run --mmap --batch-bytes "$BYTES"
+done
@@ -0,0 +1,169 @@
+/*
+  Generates an ascii PLY file of random vertices for the benchmarks.
+
+  Compilation instructions:
+  make bench/gen_ply
+
+  Usage:
+  bench/gen_ply <vertex count> [--comments <lines>] [--properties <extra>] [--precision <digits>] [--seed <seed>] [<output file>]
+
+  --comments adds comment lines to the header, so the Reader has more to skip before end_header.
+  --properties adds float properties after x, y and z, and --precision sets the digits after the
+  decimal point of every value (6 by default), which together set the width of the rows.
+  The same arguments always generate the same file. Without an output file it is written to stdout.
+*/
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+#define MAX_PRECISION 9
+#define MAX_ROW_LENGTH 4096
+
+/* xorshift64*, which is far faster than rand() for billions of values */
+uint64_t nextRandom(uint64_t * state)
+{
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 0x2545F4914F6CDD1DULL;
+}
+
+/* Writes a random value in [-limit, limit) with precision digits after the point, and returns its length */
+size_t formatValue(char * position, uint64_t * state, uint32_t limit, int precision, uint64_t scale)
+{
+  uint64_t range = 2 * (uint64_t)limit * scale;
+  int64_t value = (int64_t)(nextRandom(state) % range) - (int64_t)(limit * scale);
+  char * start = position;
+  if (value < 0){
+    *position++ = '-';
+    value = -value;
+  }
+
+  // The digits are written backwards into a scratch buffer, with the point inserted after the fraction
+  char digits[32];
+  int count = 0;
+  for (int i = 0; i < precision; i++){
+    digits[count++] = '0' + value % 10;
+    value /= 10;
+  }
+  if (precision > 0){
+    digits[count++] = '.';
+  }
+  do {
+    digits[count++] = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
+
+  while (count > 0){
+    *position++ = digits[--count];
+  }
+  return position - start;
+}
+
+unsigned long long parseCount(const char * argument, const char * name, unsigned long long maximum)
+{
+  char * end;
+  errno = 0;
+  unsigned long long value = strtoull(argument, &end, 10);
+  if (errno != 0 || *end != '\0' || argument[0] == '-' || value > maximum){
+    fprintf(stderr, "Invalid %s %s, expected a whole number up to %llu\n", name, argument, maximum);
+    exit(EXIT_FAILURE);
+  }
+  return value;
+}
+
+int main(int argc, char * argv[])
+{
+  unsigned long long vertices = 0, comments = 0, properties = 0, seed = 1;
+  int precision = 6;
+  const char * outputFileName = NULL;
+  bool haveVertices = false;
+
+  for (int i = 1; i < argc; i++){
+    if (strcmp(argv[i], "--comments") == 0 && i + 1 < argc){
+      comments = parseCount(argv[++i], "comment count", 100000000ULL);
+    } else if (strcmp(argv[i], "--properties") == 0 && i + 1 < argc){
+      properties = parseCount(argv[++i], "property count", 256);
+    } else if (strcmp(argv[i], "--precision") == 0 && i + 1 < argc){
+      precision = parseCount(argv[++i], "precision", MAX_PRECISION);
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc){
+      seed = parseCount(argv[++i], "seed", UINT64_MAX);
+    } else if (!haveVertices){
+      vertices = parseCount(argv[i], "vertex count", 100000000000ULL);
+      haveVertices = true;
+    } else if (outputFileName == NULL){
+      outputFileName = argv[i];
+    } else {
+      fprintf(stderr, "Unexpected argument %s\n", argv[i]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  if (!haveVertices){
+    fprintf(stderr, "Usage: %s <vertex count> [--comments <lines>] [--properties <extra>] [--precision <digits>] [--seed <seed>] [<output file>]\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  FILE * output = stdout;
+  if (outputFileName != NULL && (output = fopen(outputFileName, "w")) == NULL){
+    fprintf(stderr, "Error opening %s: %s\n", outputFileName, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  fprintf(output, "ply\nformat ascii 1.0\ncomment generated by gen_ply with seed %llu\n", seed);
+  for (unsigned long long i = 0; i < comments; i++){
+    fprintf(output, "comment padding line %llu of the benchmark header\n", i);
+  }
+  fprintf(output, "element vertex %llu\nproperty float x\nproperty float y\nproperty float z\n", vertices);
+  for (unsigned long long i = 0; i < properties; i++){
+    fprintf(output, "property float p%llu\n", i);
+  }
+  fprintf(output, "end_header\n");
+
+  uint64_t scale = 1;
+  for (int i = 0; i < precision; i++){
+    scale *= 10;
+  }
+  // A zero state would stay zero forever
+  uint64_t state = seed * 0x9E3779B97F4A7C15ULL + 1;
+  if (state == 0){
+    state = 1;
+  }
+
+  // Rows are formatted straight into a large buffer, which is written whenever another row might not fit
+  char * buffer = malloc(OUTPUT_BUFFER_SIZE + MAX_ROW_LENGTH * (properties / 64 + 1));
+  if (buffer == NULL){
+    perror("Error allocating output buffer");
+    exit(EXIT_FAILURE);
+  }
+  size_t used = 0;
+  for (unsigned long long i = 0; i < vertices; i++){
+    used += formatValue(buffer + used, &state, 1, precision, scale);
+    buffer[used++] = ' ';
+    used += formatValue(buffer + used, &state, 1, precision, scale);
+    buffer[used++] = ' ';
+    used += formatValue(buffer + used, &state, 32, precision, scale);
+    for (unsigned long long j = 0; j < properties; j++){
+      buffer[used++] = ' ';
+      used += formatValue(buffer + used, &state, 1000, precision, scale);
+    }
+    buffer[used++] = '\n';
+    if (used >= OUTPUT_BUFFER_SIZE){
+      if (fwrite(buffer, 1, used, output) != used){
+        perror("Error writing output");
+        exit(EXIT_FAILURE);
+      }
+      used = 0;
+    }
+  }
+  if (fwrite(buffer, 1, used, output) != used || fclose(output) == EOF){
+    perror("Error writing output");
+    exit(EXIT_FAILURE);
+  }
+  free(buffer);
+  return EXIT_SUCCESS;
+}
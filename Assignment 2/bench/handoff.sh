@@ -0,0 +1,57 @@
+#!/bin/sh
+# Compares the semaphore and spin handoffs in each handoff mode of the threads, and prints a tab separated table
+# Usage: bench/handoff.sh [<input file>] [<vertex count>]
+# When no input file is given, a PLY file with <vertex count> vertices (default 1000000) is generated
+#
+# Settings, through environment variables:
+#   MODES       main options of each run, separated by commas (default below, "-" is the lockstep handoff)
+#   OPTIONS     main options added to every run, e.g. "--cpus 2,3,4" to keep the threads on their own cores
+#   REPEAT      runs of every mode and handoff, each one a row of the table (default 3)
+#
+# Every row holds the handoff, the mode, the run, the wall and CPU time in seconds, the tokens handed over,
+# the percentage of them found while spinning and after sleeping, the average sleep and the average time
+# from the post to the woken thread running, both in microseconds. Spinning needs more than one CPU
+
+cd "$(dirname "$0")/.." || exit 1
+make -s main bench/gen_ply || exit 1
+
+INPUT=${1:-}
+VERTICES=${2:-1000000}
+MODES=${MODES:-"-,--queue-depth 8,--batch-rows 256,--stages read,strip,filter*2,write --batch-rows 64"}
+OPTIONS=${OPTIONS:-}
+REPEAT=${REPEAT:-3}
+if [ -z "$INPUT" ]; then
+  INPUT=$(mktemp /tmp/handoff_bench.XXXXXX)
+  trap 'rm -f "$INPUT" "$INPUT.out"' EXIT
+  bench/gen_ply "$VERTICES" "$INPUT" || exit 1
+else
+  trap 'rm -f "$INPUT.out"' EXIT
+fi
+
+printf "handoff\tmode\trun\twall_s\tcpu_s\ttokens\tspun_pct\tslept_pct\tsleep_us\twake_us\n"
+# The modes are split on commas, except within a stage plan, whose commas are followed by a stage name
+echo "$MODES" | sed 's/,\(-\)/\n\1/g' | while read -r MODE; do
+  [ "$MODE" = "-" ] && MODE=""
+  for HANDOFF in semaphore spin; do
+    RUN=1
+    while [ "$RUN" -le "$REPEAT" ]; do
+      # shellcheck disable=SC2086
+      ./main $OPTIONS $MODE --handoff "$HANDOFF" "$INPUT" "$INPUT.out" 2>&1 >/dev/null | awk -v OFS='\t' \
+        -v handoff="$HANDOFF" -v mode="${MODE:--}" -v run="$RUN" '
+        /^Read [0-9]+ rows/ { for (i = 1; i <= NF; i++) if ($(i + 1) == "s") { wall = $i; break } }
+        /^Used .* s of CPU time/ { cpu = $2 }
+        /^Handed over/ {
+          tokens = $3; spun = "0"; slept = "0"; sleep = "-"; wake = "-"
+          for (i = 1; i <= NF; i++) {
+            if ($(i + 1) == "came") spun = $i
+            if ($(i + 1) == "had") slept = $i
+            if ($i == "for" && $(i + 2) == "us") sleep = $(i + 1)
+            if ($i == "woken") wake = $(i + 1)
+          }
+          sub(/%/, "", spun); sub(/%/, "", slept)
+        }
+        END { print handoff, mode, run, wall, cpu, tokens, spun, slept, sleep, wake }'
+      RUN=$((RUN + 1))
+    done
+  done
+done
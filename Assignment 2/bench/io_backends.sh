@@ -0,0 +1,34 @@
+#!/bin/sh
+# Compares rows/s of the stdio and io_uring file backends of the Reader and Writer
+# Usage: bench/io_backends.sh [<input file>] [<vertex count>]
+# When no input file is given, a PLY file with <vertex count> vertices (default 2000000) is generated
+# Set DROP_CACHES=1 when running as root to read the input from the disk instead of the page cache
+
+cd "$(dirname "$0")/.." || exit 1
+make -s main bench/gen_ply || exit 1
+
+INPUT=${1:-}
+VERTICES=${2:-2000000}
+if [ -z "$INPUT" ]; then
+  INPUT=$(mktemp /tmp/io_bench.XXXXXX)
+  trap 'rm -f "$INPUT" "$INPUT.out"' EXIT
+  bench/gen_ply "$VERTICES" "$INPUT" || exit 1
+fi
+
+printf "%-52s %12s %14s\n" "mode" "MB/s" "rows/s"
+run() {
+  if [ "${DROP_CACHES:-0}" = 1 ]; then
+    sync && echo 3 > /proc/sys/vm/drop_caches
+  fi
+  ./main "$@" "$INPUT" "$INPUT.out" 2>&1 >/dev/null | awk -v mode="$*" '/^Read / {
+    for (i = 1; i <= NF; i++) { if ($(i + 1) == "MB/s,") mbs = $i; if ($(i + 1) == "rows/s") rows = $i }
+    printf "%-52s %12s %14s\n", mode, mbs, rows
+  }'
+}
+
+for MODE in "--batch-rows 256" "--batch-bytes 65536" "--batch-bytes 1048576" "--output-format binary --batch-bytes 65536"; do
+  run $MODE
+  run --io-uring $MODE
+done
+run --mmap --batch-bytes 65536
+run --mmap --io-uring --batch-bytes 65536
@@ -0,0 +1,60 @@
+#!/bin/sh
+# Compares the per-row latency percentiles of every stage with and without CPU pinning, real-time scheduling
+# and locked memory, and prints a tab separated table
+# Usage: bench/jitter.sh [<input file>] [<vertex count>]
+# When no input file is given, a PLY file with <vertex count> vertices (default 2000000) is generated
+#
+# Settings, through environment variables:
+#   OPTIONS     main options of every run (default "--batch-rows 256")
+#   CPUS        CPUs the threads are pinned to (default the CPUs this shell may run on)
+#   PRIORITIES  real-time priorities of the threads (default 50)
+#   REPEAT      runs of every setting, each one a row of the table per stage (default 3)
+#
+# The realtime setting needs CAP_SYS_NICE or a real-time ulimit -r, its rows say whether the kernel refused it.
+# The percentiles are the upper bounds of the power of two histogram buckets of the stage metrics
+
+cd "$(dirname "$0")/.." || exit 1
+make -s main bench/gen_ply || exit 1
+
+INPUT=${1:-}
+VERTICES=${2:-2000000}
+OPTIONS=${OPTIONS:-"--batch-rows 256"}
+CPUS=${CPUS:-$(awk '/^Cpus_allowed_list/ { print $2 }' /proc/self/status)}
+PRIORITIES=${PRIORITIES:-50}
+REPEAT=${REPEAT:-3}
+if [ -z "$INPUT" ]; then
+  INPUT=$(mktemp /tmp/jitter_bench.XXXXXX)
+  trap 'rm -f "$INPUT" "$INPUT.out"' EXIT
+  bench/gen_ply "$VERTICES" "$INPUT" || exit 1
+else
+  trap 'rm -f "$INPUT.out"' EXIT
+fi
+
+printf "setting\trun\tstage\trows\tp50\tp99\tp99.9\tmax\trefused\n"
+run() {
+  SETTING=$1
+  shift
+  RUN=1
+  while [ "$RUN" -le "$REPEAT" ]; do
+    # shellcheck disable=SC2086
+    ./main $OPTIONS "$@" "$INPUT" "$INPUT.out" 2>&1 >/dev/null | awk -v OFS='\t' -v setting="$SETTING" -v run="$RUN" '
+      /kernel refused/ { refused = "yes" }
+      /^  [^ ].* rows, .* per row$/ {
+        for (i = 2; i <= NF; i++) {
+          if ($(i + 1) == "rows,") rows = $i
+          if ($i == "p50") p50 = $(i + 2)
+          if ($i == "p99") p99 = $(i + 2)
+          if ($i == "p99.9") p999 = $(i + 2)
+          if ($i == "max") max = $(i + 2)
+        }
+        sub(/,$/, "", p50); sub(/,$/, "", p99); sub(/,$/, "", p999)
+        line[++stages] = $1 OFS rows OFS p50 OFS p99 OFS p999 OFS max
+      }
+      END { for (s = 1; s <= stages; s++) print setting, run, line[s], refused == "" ? "no" : refused }'
+    RUN=$((RUN + 1))
+  done
+}
+
+run default
+run pinned --cpus "$CPUS"
+run realtime --cpus "$CPUS" --sched fifo --priorities "$PRIORITIES" --mlock
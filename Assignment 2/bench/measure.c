@@ -0,0 +1,67 @@
+/*
+  Runs a command and reports the resources it used, for the benchmark suite.
+
+  Compilation instructions:
+  make bench/measure
+
+  Usage:
+  bench/measure <command> [<arguments>...]
+
+  The output of the command is discarded, including the status messages main prints to stderr.
+  One tab separated line is printed: wall time in seconds, peak resident set size in KB, voluntary
+  and involuntary context switches, and the exit status (128 plus the signal number when the
+  command was killed, 127 when it could not be run).
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+double currentTime()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main(int argc, char * argv[])
+{
+  if (argc < 2){
+    fprintf(stderr, "Usage: %s <command> [<arguments>...]\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  double startTime = currentTime();
+  pid_t child = fork();
+  if (child < 0){
+    perror("Error creating benchmark process");
+    exit(EXIT_FAILURE);
+  }
+  if (child == 0){
+    int devNull = open("/dev/null", O_WRONLY);
+    if (devNull >= 0){
+      dup2(devNull, STDOUT_FILENO);
+      dup2(devNull, STDERR_FILENO);
+      close(devNull);
+    }
+    execvp(argv[1], argv + 1);
+    _exit(127);
+  }
+
+  // wait4 gives the usage of this child alone, unlike getrusage(RUSAGE_CHILDREN)
+  int status;
+  struct rusage usage;
+  if (wait4(child, &status, 0, &usage) < 0){
+    perror("Error waiting for benchmark command");
+    exit(EXIT_FAILURE);
+  }
+  double elapsedTime = currentTime() - startTime;
+
+  int exitStatus = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+  printf("%.6f\t%ld\t%ld\t%ld\t%d\n", elapsedTime, usage.ru_maxrss, usage.ru_nvcsw, usage.ru_nivcsw, exitStatus);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,113 @@
+/*
+  Microbenchmark of the substring search used by the Processor against strstr and memmem.
+
+  Compilation instructions:
+  make bench/search_bench
+
+  Usage:
+  bench/search_bench
+  bench/search_bench <haystack size in MB>
+
+  Each pattern is only present at the very end of a haystack of PLY vertex rows, so every
+  implementation scans the whole haystack. Patterns are cut from the same rows, so the
+  first and last bytes of the pattern are common in the haystack.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../search.h"
+
+#define REPETITIONS 5
+
+typedef const char * (*SearchFunction)(const char *, size_t, const char *, size_t);
+
+const char * searchWithStrstr(const char * haystack, size_t haystackLength, const char * needle, size_t needleLength)
+{
+  return strstr(haystack, needle);
+}
+
+double currentTime()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/* Returns the best throughput in MB/s of a search implementation over REPETITIONS runs */
+double measure(SearchFunction search, const char * haystack, size_t haystackLength, const char * needle, size_t needleLength)
+{
+  double best = 0;
+  for (int i = 0; i < REPETITIONS; i++){
+    double startTime = currentTime();
+    const char * match = search(haystack, haystackLength, needle, needleLength);
+    double elapsedTime = currentTime() - startTime;
+
+    if (match != haystack + haystackLength - needleLength){
+      fprintf(stderr, "Search returned the wrong match for a pattern of length %zu\n", needleLength);
+      exit(EXIT_FAILURE);
+    }
+    if (haystackLength / 1e6 / elapsedTime > best){
+      best = haystackLength / 1e6 / elapsedTime;
+    }
+  }
+  return best;
+}
+
+int main(int argc, char const *argv[])
+{
+  size_t haystackLength = (argc > 1 ? strtoul(argv[1], NULL, 10) : 64) << 20;
+  size_t patternLengths[] = {2, 3, 4, 8, 10, 16, 32, 64, 99};
+  char * haystack = malloc(haystackLength + 1);
+  char needle[128];
+
+  // Fill the haystack with rows of vertex coordinates
+  srand(1);
+  for (size_t i = 0; i < haystackLength;){
+    char row[64];
+    int rowLength = snprintf(row, sizeof(row), "%f %f %f \n", rand() / (double) RAND_MAX - 1, rand() / (double) RAND_MAX, 16.0 * rand() / RAND_MAX);
+    for (int j = 0; j < rowLength && i < haystackLength; j++){
+      haystack[i++] = row[j];
+    }
+  }
+  haystack[haystackLength] = '\0';
+
+  printf("Haystack of %zu MB, best of %d runs, chosen implementation: %s\n", haystackLength >> 20, REPETITIONS, substringSearchName());
+  printf("%8s %12s %12s %12s %12s\n", "pattern", "strstr", "memmem", "sse2", "avx2");
+
+  for (size_t p = 0; p < sizeof(patternLengths) / sizeof(patternLengths[0]); p++){
+    size_t needleLength = patternLengths[p];
+
+    // A pattern made of digits that ends in a byte never found in the rows, placed at the end of the haystack
+    for (size_t i = 0; i < needleLength; i++){
+      needle[i] = "0123456789"[i % 10];
+    }
+    needle[needleLength - 1] = '#';
+    needle[needleLength] = '\0';
+    char saved[128];
+    memcpy(saved, haystack + haystackLength - needleLength, needleLength);
+    memcpy(haystack + haystackLength - needleLength, needle, needleLength);
+
+    printf("%8zu %12.0f %12.0f", needleLength,
+      measure(searchWithStrstr, haystack, haystackLength, needle, needleLength),
+      measure(findSubstringScalar, haystack, haystackLength, needle, needleLength));
+    if (cpuSupportsSse2()){
+      printf(" %12.0f", measure(findSubstringSse2, haystack, haystackLength, needle, needleLength));
+    } else {
+      printf(" %12s", "-");
+    }
+    if (cpuSupportsAvx2()){
+      printf(" %12.0f", measure(findSubstringAvx2, haystack, haystackLength, needle, needleLength));
+    } else {
+      printf(" %12s", "-");
+    }
+    printf("   MB/s\n");
+
+    memcpy(haystack + haystackLength - needleLength, saved, needleLength);
+  }
+
+  free(haystack);
+  return 0;
+}
@@ -0,0 +1,71 @@
+#!/bin/sh
+# Runs main in each of its I/O and handoff modes over generated PLY files and prints a tab separated table
+# Usage: bench/suite.sh [<output table>]
+#
+# Settings, through environment variables:
+#   SIZES       vertex counts of the generated files (default "1000 100000 1000000", up to 1000000000)
+#   SHAPES      header comment lines:extra properties:precision of each file (default "0:0:6 20000:0:6 0:9:3")
+#   MODES       main options of each run, separated by commas (default below, "-" is the lockstep handoff)
+#   LOCKSTEP_MAX  largest file run in lockstep mode, which is slow on large files (default 1000000)
+#   REPEAT      runs of every mode, each one a row of the table (default 3)
+#   MAIN        the main binary to measure (default ./main), so an older build can be compared
+#   BUILD       label of the build in the table (default the git commit, with -dirty for local changes)
+#   BENCH_DIR   where the generated files are kept between runs (default /tmp/ply_bench)
+#
+# Every row holds the build, the file, the mode, the run, the wall time in seconds, the input MB,
+# MB/s, rows/s, the peak RSS in KB, the voluntary and involuntary context switches and the exit status
+
+cd "$(dirname "$0")/.." || exit 1
+make -s main bench/gen_ply bench/measure || exit 1
+
+SIZES=${SIZES:-"1000 100000 1000000"}
+SHAPES=${SHAPES:-"0:0:6 20000:0:6 0:9:3"}
+MODES=${MODES:-"-,--mmap,--queue-depth 4,--batch-rows 256,--batch-bytes 65536,--mmap --batch-bytes 65536,--processes --batch-bytes 65536,--processors $(nproc) --batch-bytes 65536,--mmap --where z>0,--io-uring --batch-bytes 65536,--batch-bytes 65536 --flush-latency 1,--batch-bytes 65536 --output-format binary,--parallel $(nproc),--bulk-copy"}
+LOCKSTEP_MAX=${LOCKSTEP_MAX:-1000000}
+REPEAT=${REPEAT:-3}
+MAIN=${MAIN:-./main}
+BUILD=${BUILD:-$(git describe --always --dirty 2>/dev/null || echo unknown)}
+BENCH_DIR=${BENCH_DIR:-/tmp/ply_bench}
+TABLE=${1:-/dev/stdout}
+
+mkdir -p "$BENCH_DIR" || exit 1
+OUTPUT="$BENCH_DIR/output.$$"
+trap 'rm -f "$OUTPUT"' EXIT
+
+printf "build\tvertices\tcomments\tproperties\tprecision\tmode\trun\twall_s\tinput_mb\tmb_s\trows_s\tmax_rss_kb\tvoluntary_cs\tinvoluntary_cs\tstatus\n" > "$TABLE"
+for VERTICES in $SIZES; do
+  for SHAPE in $SHAPES; do
+    COMMENTS=${SHAPE%%:*}
+    PRECISION=${SHAPE##*:}
+    PROPERTIES=${SHAPE#*:}
+    PROPERTIES=${PROPERTIES%:*}
+    INPUT="$BENCH_DIR/vertices_${VERTICES}_c${COMMENTS}_p${PROPERTIES}_d${PRECISION}.ply"
+    if [ ! -s "$INPUT" ]; then
+      echo "Generating $INPUT" >&2
+      bench/gen_ply "$VERTICES" --comments "$COMMENTS" --properties "$PROPERTIES" --precision "$PRECISION" "$INPUT.tmp" && mv "$INPUT.tmp" "$INPUT" || exit 1
+    fi
+    BYTES=$(wc -c < "$INPUT")
+
+    # The modes are split on commas, so their options can still be split on spaces
+    echo "$MODES" | tr ',' '\n' | while read -r MODE; do
+      if [ "$MODE" = "-" ] && [ "$VERTICES" -gt "$LOCKSTEP_MAX" ]; then
+        continue
+      fi
+      OPTIONS=$MODE
+      [ "$OPTIONS" = "-" ] && OPTIONS=
+      RUN=1
+      while [ "$RUN" -le "$REPEAT" ]; do
+        # shellcheck disable=SC2086
+        bench/measure "$MAIN" $OPTIONS "$INPUT" "$OUTPUT" | awk -F '\t' -v OFS='\t' \
+          -v build="$BUILD" -v vertices="$VERTICES" -v comments="$COMMENTS" -v properties="$PROPERTIES" \
+          -v precision="$PRECISION" -v mode="$MODE" -v run="$RUN" -v bytes="$BYTES" '{
+            wall = $1 > 0 ? $1 : 1e-9
+            printf "%s\t%s\t%s\t%s\t%s\t%s\t%s\t%.4f\t%.2f\t%.2f\t%.0f\t%s\t%s\t%s\t%s\n", build, vertices, comments, properties,
+              precision, mode, run, $1, bytes / 1048576, bytes / 1048576 / wall, vertices / wall, $2, $3, $4, $5
+          }' >> "$TABLE"
+        rm -f "$OUTPUT"
+        RUN=$((RUN + 1))
+      done
+    done
+  done
+done
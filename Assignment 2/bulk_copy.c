@@ -0,0 +1,114 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+#include "bulk_copy.h"
+#include "search.h"
+
+#define COPY_CHUNK_SIZE (1 << 30)
+#define FALLBACK_BUFFER_SIZE (1 << 20)
+
+//Errors which mean the kernel cannot copy between these two files, rather than that the copy failed
+static bool isUnsupported(int error){
+	return error == ENOSYS || error == EXDEV || error == EINVAL || error == EOPNOTSUPP || error == EBADF;
+}
+
+//Copies from offset to the end of the input file, returning the number of bytes copied
+//Tries copy_file_range first, then sendfile, then a plain read and write loop
+static size_t copyFrom(int inputFile, int outputFile, off_t offset, const char ** method){
+	size_t copied = 0;
+	ssize_t result;
+
+	*method = "copy_file_range";
+	while ((result = copy_file_range(inputFile, &offset, outputFile, NULL, COPY_CHUNK_SIZE, 0)) > 0){
+		copied += result;
+	}
+	if (result == 0){ return copied; }
+	if (!isUnsupported(errno) || copied > 0){
+		perror("Error copying content region");
+		exit(EXIT_FAILURE);
+	}
+
+	*method = "sendfile";
+	while ((result = sendfile(outputFile, inputFile, &offset, COPY_CHUNK_SIZE)) > 0){
+		copied += result;
+	}
+	if (result == 0){ return copied; }
+	if (!isUnsupported(errno) || copied > 0){
+		perror("Error copying content region");
+		exit(EXIT_FAILURE);
+	}
+
+	*method = "read/write";
+	char * buffer = malloc(FALLBACK_BUFFER_SIZE);
+	if (buffer == NULL || lseek(inputFile, offset, SEEK_SET) < 0){
+		perror("Error copying content region");
+		exit(EXIT_FAILURE);
+	}
+	while ((result = read(inputFile, buffer, FALLBACK_BUFFER_SIZE)) > 0){
+		for (ssize_t written = 0, count; written < result; written += count){
+			if ((count = write(outputFile, buffer + written, result - written)) < 0){
+				perror("Error writing to output file");
+				exit(EXIT_FAILURE);
+			}
+		}
+		copied += result;
+	}
+	if (result < 0){
+		perror("Error reading from input file");
+		exit(EXIT_FAILURE);
+	}
+	free(buffer);
+	return copied;
+}
+
+BulkCopyResult bulkCopyContent(const char * inputFileName, const char * outputFileName, const char * substring){
+	BulkCopyResult result = {false, false, 0, 0, 0, "none"};
+	size_t substringLength = strlen(substring);
+	char * row = NULL;
+	size_t rowCapacity = 0;
+	ssize_t rowLength;
+	FILE * readFile;
+	int outputFile;
+
+	if ((readFile = fopen(inputFileName, "r")) == NULL){
+		fprintf(stderr,
+			"Error: Could not find or open %s. Ensure that a file named %s exists within the same directory.\n",
+			inputFileName, inputFileName
+		);
+		fprintf(stderr, "Exiting program...\n");
+		exit(ENOENT); /* No such file or directory */
+	}
+	if ((outputFile = open(outputFileName, O_WRONLY | O_CREAT | O_TRUNC, 0666)) < 0){
+		fprintf(stderr, "Error! opening creating or opening existing output file\n");
+		exit(EXIT_FAILURE);
+	}
+
+	fprintf(stderr, "Reading the header of %s\n", inputFileName);
+
+	// Only the header is read row by row, the scan stops at the row holding the substring
+	while (!result.substringFound && (rowLength = getline(&row, &rowCapacity, readFile)) > 0){
+		result.dataInFile = true;
+		result.headerRows++;
+		result.headerBytes += rowLength;
+		result.substringFound = findSubstring(row, rowLength, substring, substringLength) != NULL;
+	}
+	free(row);
+
+	// The content region starts right after the row holding the substring, whatever stdio has buffered past it
+	if (result.substringFound){
+		result.contentBytes = copyFrom(fileno(readFile), outputFile, result.headerBytes, &result.method);
+	}
+
+	if (close(outputFile) != 0){
+		fprintf(stderr, "Error closing output file: %s\n", strerror(errno));
+	}
+	if (fclose(readFile) == EOF){
+		fprintf(stderr, "Error closing input file: %s\n", strerror(errno));
+	}
+	return result;
+}
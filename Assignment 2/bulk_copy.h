@@ -0,0 +1,22 @@
+#ifndef BULK_COPY_H
+#define BULK_COPY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* The outcome of stripping the header of a file with a bulk copy of its content region */
+typedef struct BulkCopyResult {
+	bool dataInFile;
+	bool substringFound;
+	size_t headerRows;
+	size_t headerBytes;
+	size_t contentBytes;
+
+	//The kernel interface that copied the content region
+	const char * method;
+} BulkCopyResult;
+
+/* Scans the header of the input file row by row and copies everything after the row holding the substring to the output file */
+BulkCopyResult bulkCopyContent(const char * inputFileName, const char * outputFileName, const char * substring);
+
+#endif
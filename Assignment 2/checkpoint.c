@@ -0,0 +1,122 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "checkpoint.h"
+
+//A checkpoint is a few "key value" lines, so it can be read and edited by hand
+#define CHECKPOINT_VERSION "ply-strip-checkpoint 1"
+
+char * checkpointFileName(const char * outputFileName){
+	char * fileName;
+	if (asprintf(&fileName, "%s.checkpoint", outputFileName) < 0){
+		perror("Error allocating checkpoint file name");
+		exit(EXIT_FAILURE);
+	}
+	return fileName;
+}
+
+bool identifyCheckpointInput(Checkpoint * checkpoint, const char * inputFileName){
+	struct stat inputStatus;
+	if (stat(inputFileName, &inputStatus) != 0){
+		return false;
+	}
+	checkpoint->inputSize = inputStatus.st_size;
+	checkpoint->inputModified = inputStatus.st_mtime;
+	return true;
+}
+
+bool saveCheckpoint(const char * fileName, const Checkpoint * checkpoint){
+	char * temporaryName;
+	if (asprintf(&temporaryName, "%s.tmp", fileName) < 0){
+		return false;
+	}
+
+	FILE * file = fopen(temporaryName, "w");
+	bool saved = file != NULL;
+	if (saved){
+		fprintf(file, CHECKPOINT_VERSION "\n");
+		fprintf(file, "input %s\n", checkpoint->inputFileName);
+		fprintf(file, "input_size %zu\n", checkpoint->inputSize);
+		fprintf(file, "input_modified %lld\n", (long long) checkpoint->inputModified);
+		fprintf(file, "input_offset %zu\n", checkpoint->inputOffset);
+		fprintf(file, "region %s\n", checkpoint->contentRegion ? "content" : "header");
+		fprintf(file, "output_length %zu\n", checkpoint->outputLength);
+		saved = fflush(file) == 0 && fsync(fileno(file)) == 0;
+		saved = fclose(file) == 0 && saved;
+	}
+	saved = saved && rename(temporaryName, fileName) == 0;
+	if (!saved){
+		unlink(temporaryName);
+	}
+	free(temporaryName);
+	return saved;
+}
+
+bool loadCheckpoint(const char * fileName, Checkpoint * checkpoint){
+	FILE * file = fopen(fileName, "r");
+	if (file == NULL){
+		return false;
+	}
+	memset(checkpoint, 0, sizeof(Checkpoint));
+
+	char * line = NULL;
+	size_t capacity = 0;
+	ssize_t length;
+	unsigned fieldsFound = 0;
+	bool versionFound = false;
+	while ((length = getline(&line, &capacity, file)) > 0){
+		if (line[length - 1] == '\n'){
+			line[--length] = '\0';
+		}
+		char * value = strchr(line, ' ');
+		if (strcmp(line, CHECKPOINT_VERSION) == 0){
+			versionFound = true;
+			continue;
+		}
+		if (value == NULL){
+			continue;
+		}
+		*value++ = '\0';
+
+		long long number = strtoll(value, NULL, 10);
+		if (strcmp(line, "input") == 0 && checkpoint->inputFileName == NULL){
+			checkpoint->inputFileName = strdup(value);
+			fieldsFound |= 1;
+		} else if (strcmp(line, "input_size") == 0){
+			checkpoint->inputSize = number;
+			fieldsFound |= 2;
+		} else if (strcmp(line, "input_modified") == 0){
+			checkpoint->inputModified = number;
+			fieldsFound |= 4;
+		} else if (strcmp(line, "input_offset") == 0){
+			checkpoint->inputOffset = number;
+			fieldsFound |= 8;
+		} else if (strcmp(line, "region") == 0){
+			checkpoint->contentRegion = strcmp(value, "content") == 0;
+			fieldsFound |= 16;
+		} else if (strcmp(line, "output_length") == 0){
+			checkpoint->outputLength = number;
+			fieldsFound |= 32;
+		}
+	}
+	free(line);
+	fclose(file);
+
+	if (!versionFound || fieldsFound != 63){
+		fprintf(stderr, "%s is not a complete checkpoint\n", fileName);
+		freeCheckpoint(checkpoint);
+		errno = EINVAL;
+		return false;
+	}
+	return true;
+}
+
+void freeCheckpoint(Checkpoint * checkpoint){
+	free(checkpoint->inputFileName);
+	checkpoint->inputFileName = NULL;
+}
@@ -0,0 +1,36 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+/* How far an interrupted run got, so that a later run can continue from there instead of from the start */
+typedef struct Checkpoint {
+	//The input file the run read, which must be unchanged to resume
+	char * inputFileName;
+	size_t inputSize;
+	time_t inputModified;
+
+	size_t inputOffset;  //Input bytes of every row the Writer had handled, so the next row starts here
+	bool contentRegion;  //Whether the substring had been found, so the rows after inputOffset are content
+	size_t outputLength; //Length of the output file up to and including the last row written
+} Checkpoint;
+
+/* Returns the name of the checkpoint file kept next to an output file, to be freed by the caller */
+char * checkpointFileName(const char * outputFileName);
+
+/* Records the size and modification time of the input file in the checkpoint, returning false if it cannot be read */
+bool identifyCheckpointInput(Checkpoint * checkpoint, const char * inputFileName);
+
+/* Writes the checkpoint to a temporary file, syncs it, then renames it over fileName, so it is never seen half written */
+bool saveCheckpoint(const char * fileName, const Checkpoint * checkpoint);
+
+/* Reads a checkpoint saved by saveCheckpoint. Returns false with errno set to ENOENT when there is none,
+   or to EINVAL after printing the problem when it cannot be used */
+bool loadCheckpoint(const char * fileName, Checkpoint * checkpoint);
+
+/* Frees the strings held by a loaded checkpoint */
+void freeCheckpoint(Checkpoint * checkpoint);
+
+#endif
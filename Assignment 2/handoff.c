@@ -0,0 +1,246 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "handoff.h"
+
+#define INITIAL_SPIN_LIMIT 256
+#define MIN_SPIN_LIMIT 16
+#define MAX_SPIN_LIMIT 8192
+#define PARK_CANCEL_INTERVAL 10000000 //Nanoseconds a parked thread sleeps before it looks for a cancellation again
+
+static uint64_t handoffNow(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+//Tells the core this is a spin loop, so it saves power and leaves the pipeline to its other hyperthread
+static inline void cpuRelax(){
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield");
+#endif
+}
+
+//The thread handing over the token cannot run while the only CPU spins, so spinning is only worth it with more than one
+static bool spinningHelps(){
+	cpu_set_t cpus;
+	return sched_getaffinity(0, sizeof(cpus), &cpus) == 0 && CPU_COUNT(&cpus) > 1;
+}
+
+static unsigned clampSpinLimit(long limit){
+	return limit < MIN_SPIN_LIMIT ? MIN_SPIN_LIMIT : limit > MAX_SPIN_LIMIT ? MAX_SPIN_LIMIT : limit;
+}
+
+bool parseHandoffMode(const char * name, HandoffMode * mode){
+	if (strcmp(name, "semaphore") == 0){
+		*mode = HandoffSemaphore;
+	} else if (strcmp(name, "spin") == 0){
+		*mode = HandoffSpin;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+const char * handoffModeName(HandoffMode mode){
+	return mode == HandoffSpin ? "spin" : "semaphore";
+}
+
+int initHandoff(Handoff * handoff, HandoffMode mode, unsigned tokens, bool processShared){
+	memset(&handoff->stats, 0, sizeof(HandoffStats));
+	handoff->mode = mode;
+	handoff->processShared = processShared;
+	atomic_init(&handoff->tokens, tokens);
+	atomic_init(&handoff->sleepers, 0);
+	atomic_init(&handoff->postNanos, 0);
+	handoff->spinLimit = spinningHelps() ? INITIAL_SPIN_LIMIT : 0;
+	if (mode == HandoffSemaphore){
+		return sem_init(&handoff->semaphore, processShared, tokens);
+	}
+	return 0;
+}
+
+void destroyHandoff(Handoff * handoff){
+	if (handoff->mode == HandoffSemaphore){
+		sem_destroy(&handoff->semaphore);
+	}
+}
+
+//Takes a token from the counter of spin mode if there is one
+static bool takeToken(Handoff * handoff){
+	int available = atomic_load(&handoff->tokens);
+	while (available > 0){
+		if (atomic_compare_exchange_weak(&handoff->tokens, &available, available - 1)){
+			return true;
+		}
+	}
+	return false;
+}
+
+//Takes a token without waiting in either mode
+static bool takeAvailable(Handoff * handoff){
+	if (handoff->mode == HandoffSemaphore){
+		return sem_trywait(&handoff->semaphore) == 0;
+	}
+	return takeToken(handoff);
+}
+
+bool handoffTryWait(Handoff * handoff){
+	if (!takeAvailable(handoff)){
+		return false;
+	}
+	handoff->stats.waits++;
+	return true;
+}
+
+//Counts a wait that slept, and how long the post that ended it took to get the waiter running again
+static void recordPark(Handoff * handoff, uint64_t parkStart, uint64_t woken){
+	HandoffStats * stats = &handoff->stats;
+	stats->parkedWaits++;
+	stats->parkedNanos += woken - parkStart;
+	uint64_t posted = atomic_load_explicit(&handoff->postNanos, memory_order_relaxed);
+	if (posted >= parkStart && posted <= woken){
+		stats->wakeups++;
+		stats->wakeNanos += woken - posted;
+	}
+}
+
+//A waiter cancelled in its sleep is no longer one, so posts stop waking it
+static void leavePark(void * params){
+	Handoff * handoff = params;
+	atomic_fetch_sub(&handoff->sleepers, 1);
+}
+
+//Sleeps on the futex word until the counter changes, or for PARK_CANCEL_INTERVAL at most. The futex call is no cancellation point,
+//so a parked thread acts on a cancellation between its sleeps instead, and like sem_wait it can still be cancelled while it waits
+static long sleepOnTokens(Handoff * handoff){
+	struct timespec timeout = {0, PARK_CANCEL_INTERVAL};
+	pthread_testcancel();
+	return syscall(SYS_futex, &handoff->tokens, handoff->processShared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE, 0, &timeout, NULL, 0);
+}
+
+//Sleeps until a token is posted, in the semaphore or on the futex word of the counter
+static int park(Handoff * handoff){
+	uint64_t parkStart = handoffNow();
+	volatile int result = 0; //Set between the setjmp of the cleanup handler and the return
+
+	// The sleeper is announced before the last look at the counter, and a post adds its token before it looks for sleepers,
+	// so either the waiter sees the token or the post sees the sleeper and wakes it
+	atomic_fetch_add(&handoff->sleepers, 1);
+	pthread_cleanup_push(leavePark, handoff);
+	if (handoff->mode == HandoffSemaphore){
+		result = sem_wait(&handoff->semaphore);
+	} else {
+		while (!takeToken(handoff)){
+			// The kernel only puts the thread to sleep while the counter still holds no token
+			if (sleepOnTokens(handoff) != 0 && errno == EINTR){
+				result = -1;
+				break;
+			}
+		}
+	}
+	pthread_cleanup_pop(1);
+
+	int error = errno;
+	recordPark(handoff, parkStart, handoffNow());
+	errno = error;
+	return result;
+}
+
+int handoffWait(Handoff * handoff){
+	handoff->stats.waits++;
+	if (takeAvailable(handoff)){
+		return 0;
+	}
+	if (handoff->mode == HandoffSemaphore || handoff->spinLimit == 0){
+		return park(handoff);
+	}
+
+	uint64_t spinStart = handoffNow();
+	unsigned limit = handoff->spinLimit;
+	for (unsigned spin = 1; spin <= limit; spin++){
+		cpuRelax();
+		if (atomic_load_explicit(&handoff->tokens, memory_order_relaxed) > 0 && takeToken(handoff)){
+			// Aim the budget at twice the spins this token took, so a wait a little longer than usual is still caught
+			handoff->stats.spunWaits++;
+			handoff->spinLimit = clampSpinLimit((long) limit + ((long) spin * 2 - (long) limit) / 8);
+			return 0;
+		}
+	}
+	uint64_t parkStart = handoffNow();
+	uint64_t parkedBefore = handoff->stats.parkedNanos;
+	int result = park(handoff);
+
+	// A token that came within another budget's worth of spinning would have been caught by a budget twice as long,
+	// one that took longer means the spinning was wasted, so the budget shrinks for the next wait
+	if (result == 0){
+		uint64_t parked = handoff->stats.parkedNanos - parkedBefore;
+		handoff->spinLimit = clampSpinLimit(parked <= parkStart - spinStart ? (long) limit * 2 : (long) limit / 2);
+	}
+	return result;
+}
+
+void handoffPost(Handoff * handoff){
+	if (handoff->mode == HandoffSemaphore){
+		if (atomic_load(&handoff->sleepers) > 0){
+			atomic_store_explicit(&handoff->postNanos, handoffNow(), memory_order_relaxed);
+		}
+		sem_post(&handoff->semaphore);
+		return;
+	}
+
+	atomic_fetch_add(&handoff->tokens, 1);
+	if (atomic_load(&handoff->sleepers) > 0){
+		atomic_store_explicit(&handoff->postNanos, handoffNow(), memory_order_relaxed);
+		syscall(SYS_futex, &handoff->tokens, handoff->processShared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+	}
+}
+
+void addHandoffStats(HandoffStats * total, const Handoff * handoff){
+	const HandoffStats * stats = &handoff->stats;
+	total->waits += stats->waits;
+	total->spunWaits += stats->spunWaits;
+	total->parkedWaits += stats->parkedWaits;
+	total->parkedNanos += stats->parkedNanos;
+	total->wakeups += stats->wakeups;
+	total->wakeNanos += stats->wakeNanos;
+	if (handoff->spinLimit > total->spinLimit){
+		total->spinLimit = handoff->spinLimit;
+	}
+}
+
+void printHandoffStats(FILE * file, HandoffMode mode, const HandoffStats * stats){
+	if (stats->waits == 0){
+		return;
+	}
+	size_t straightAway = stats->waits - stats->spunWaits - stats->parkedWaits;
+	fprintf(file, "Handed over %zu tokens through %s handoffs: %.1f%% were waiting, ", stats->waits, handoffModeName(mode),
+		100.0 * straightAway / stats->waits);
+	if (mode == HandoffSpin && stats->spinLimit > 0){
+		fprintf(file, "%.1f%% came while spinning, ", 100.0 * stats->spunWaits / stats->waits);
+	}
+	fprintf(file, "%.1f%% had to sleep", 100.0 * stats->parkedWaits / stats->waits);
+	if (stats->parkedWaits > 0){
+		fprintf(file, " for %.1f us on average", stats->parkedNanos / 1e3 / stats->parkedWaits);
+	}
+	if (stats->wakeups > 0){
+		fprintf(file, ", woken %.1f us after the post", stats->wakeNanos / 1e3 / stats->wakeups);
+	}
+	if (mode == HandoffSpin){
+		if (stats->spinLimit > 0){
+			fprintf(file, ", spinning up to %u pauses", stats->spinLimit);
+		} else {
+			fprintf(file, ", without spinning on a single CPU");
+		}
+	}
+	fprintf(file, "\n");
+}
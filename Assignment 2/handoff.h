@@ -0,0 +1,70 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* How a thread waits for the next token another thread hands it */
+typedef enum HandoffMode {
+	HandoffSemaphore, //Sleeps in sem_wait as soon as no token is waiting
+	HandoffSpin       //Spins for a while first, then parks on a futex
+} HandoffMode;
+
+/* What the waits for tokens cost, over one handoff or added up over many */
+typedef struct HandoffStats {
+	size_t waits;         //Tokens taken, whether one was waiting or had to be waited for
+	size_t spunWaits;     //Waits that found their token while spinning
+	size_t parkedWaits;   //Waits that went to sleep
+	uint64_t parkedNanos; //Time spent asleep
+	size_t wakeups;       //Sleepers woken by a post, and the time from the post until they ran
+	uint64_t wakeNanos;
+	unsigned spinLimit;   //The largest spin budget when the stats were taken
+} HandoffStats;
+
+/* A counting semaphore passing tokens from one thread to another, such as the free and filled slots of a ring.
+   Only one thread waits on a handoff at a time, which keeps its statistics and tunes its spin budget */
+typedef struct Handoff {
+	HandoffMode mode;
+	bool processShared;    //Waited on and posted from several processes, so the semaphore and futex are not private
+	sem_t semaphore;       //The tokens in semaphore mode
+	atomic_int tokens;     //The tokens in spin mode, and the futex word parked waiters sleep on
+	atomic_int sleepers;   //Waiters asleep or about to be, a post only makes a system call when one needs waking
+	atomic_uint_fast64_t postNanos; //When a post last woke a sleeper
+	unsigned spinLimit;    //Pauses spent looking for a token before parking, zero on a single CPU
+	HandoffStats stats;
+} Handoff;
+
+/* Parses semaphore or spin into a mode, returning false for anything else */
+bool parseHandoffMode(const char * name, HandoffMode * mode);
+
+/* Returns the name of a mode as the option takes it */
+const char * handoffModeName(HandoffMode mode);
+
+/* Sets up a handoff holding the given number of tokens, returning the result of sem_init in semaphore mode and 0 otherwise.
+   A process shared handoff must be in memory shared by the processes, like mapSharedMemory returns */
+int initHandoff(Handoff * handoff, HandoffMode mode, unsigned tokens, bool processShared);
+
+/* Releases a handoff nobody waits on any more */
+void destroyHandoff(Handoff * handoff);
+
+/* Takes a token if one is waiting, without sleeping or spinning */
+bool handoffTryWait(Handoff * handoff);
+
+/* Takes a token, waiting for one when there is none. Like sem_wait it returns -1 with errno set to EINTR
+   when a signal interrupted the wait, and 0 once it has the token */
+int handoffWait(Handoff * handoff);
+
+/* Hands a token over, waking the waiter when it is asleep */
+void handoffPost(Handoff * handoff);
+
+/* Adds the statistics of a handoff whose waiter has finished onto total */
+void addHandoffStats(HandoffStats * total, const Handoff * handoff);
+
+/* Prints how the waits of a run were spent, or nothing when there were none */
+void printHandoffStats(FILE * file, HandoffMode mode, const HandoffStats * stats);
+
+#endif
@@ -11,8 +11,119 @@
   ./main <input file name> <output file name>
   ./main <input file name> <output file name> <substring>
   note: arguments are restricted to a maximum of 100 characters each
+
+  A file name of - reads the input from stdin or writes the output to stdout, which also works when
+  they are pipes. Status messages and statistics are always printed to stderr, so that the program
+  can sit in the middle of a shell pipeline:
+  zcat scan.ply.gz | ./main - - | next_tool
+  Binary output to a pipe is held in an unlinked temporary file until the element counts of its
+  header are known. --mmap needs stdin to be a regular file, --bulk-copy and --parallel need names
+
+  Options may be given before or between the file names:
+  --mmap              map the input file into memory and pass (offset, length) views of each row
+                      between the threads instead of copying the row through the pipe
+  --queue-depth <N>   connect the threads with rings of N slots so that each thread can run ahead
+                      of the next one, instead of handing over a single shared row in lockstep
+  --batch-rows <N>    hand over a batch of up to N rows per ring slot instead of a single row
+  --batch-bytes <N>   hand over a batch of up to N bytes of rows per ring slot, e.g. 65536
+                      Batching enables the rings with a depth of 4 when no queue depth is given
+  --stages <plan>     run these stages over the rings, read,strip+filter+parse,write by default. A comma
+                      puts the next stage on threads of its own behind a ring, + runs it on the threads
+                      of the stage before it without a handoff, and *N runs a group on N workers, e.g.
+                      read,strip,filter*4,write. The stages are read, scan (guesses where the header
+                      ends in each batch on its own), strip (finds the end of the header), filter
+                      (--drop and --select), parse (binary output and --stats) and write. Only scan and
+                      filter can run on several workers, the rows are still written in order. %N runs a
+                      group on N workers that each take the next batch as soon as they are free, and the
+                      group after it puts the batches back in order, e.g. read,scan+filter%4,strip,write.
+                      A plan enables the rings like batching does
+  --processors <N>    run the work of the Processor on N workers, which take the batches in any order.
+                      The read stage numbers each batch, and the Writer puts them back in that order
+                      from the rings of the workers, so the output is the same as with one Processor.
+                      Each worker searches its batches for the end of the header as if the header went
+                      on into them, until the Writer has seen it end, and the Writer settles which rows
+                      were header in order. Short for --stages read,scan+filter%N,strip+parse+write
+  --processes         run each group of the stage plan in a process of its own, so by default the Reader,
+                      Processor and Writer are separate processes. They hand the rows over through rings
+                      in POSIX shared memory, waiting on each other through process shared semaphores,
+                      or futexes with --handoff spin. The input is mapped into memory like --mmap before
+                      the processes are started, so only the views of the rows go through the rings.
+                      A stage process that fails stops the others. Ascii output of a single file only
+  --cpus <list>       pin the threads of the pipeline to these CPUs in turn, e.g. 2,4-6. The threads
+                      are numbered Reader, Processor, Writer in lockstep mode, and by the groups of
+                      the stage plan and their workers over the rings
+  --sched <fifo|rr>   run the threads of the pipeline under a real-time scheduling policy, which needs
+                      CAP_SYS_NICE or a real-time ulimit -r. Without it they keep the default scheduler
+  --priorities <list> real-time priority of each thread in the same order, the last one is used for the
+                      threads after it. The lowest real-time priority when none is given
+  --mlock             lock every page of the process into memory with mlockall, so no row waits on
+                      a page fault. The p99.9 and max of the stage metrics show the effect of these,
+                      bench/jitter.sh compares runs with and without them
+  --handoff <semaphore|spin>
+                      how a thread waits for the row or slot the thread before it hands over. semaphore
+                      sleeps in sem_wait, spin spins with pause instructions for a budget tuned from the
+                      waits it has seen, then parks on a futex, trading CPU time for a faster wake-up.
+                      Only with more than one CPU to run on, otherwise it parks straight away. The final
+                      statistics show how each wait ended and the CPU time, bench/handoff.sh compares them
+  --io-uring          read the input in large blocks kept in flight ahead of the Reader, and write
+                      the output in large blocks, through io_uring. Falls back to stdio when the
+                      kernel does not allow io_uring. With --mmap only the output uses io_uring
+  --flush-bytes <N>   gather ascii output rows until N bytes are waiting, then write them all with a
+                      single writev call, 1048576 by default
+  --flush-latency <ms>
+                      also write the waiting rows once the oldest has waited this long, and before
+                      the Writer sleeps waiting for rows, trading throughput for latency
+  --metrics-file <path>
+                      append the stage metrics reports requested with SIGUSR1 to path instead of
+                      printing them to stderr. Each report shows the rows and bytes every thread
+                      has handled, its time blocked against its time working, and a histogram
+                      of the time it spent on each row. A final report is printed at exit
+  --bulk-copy         only scan the header, then copy the rest of the file with copy_file_range,
+                      falling back to sendfile or a read/write loop, without starting the threads
+  --parallel <N>      only scan the header, then split the rest of the file into N chunks that end
+                      on a newline and process each chunk on its own thread, writing the results
+                      in their original order. The input is always mapped into memory
+  --resume            continue an interrupted run from the checkpoint it saved next to its output file.
+                      When Ctrl+C stops a run once the rows in flight were written, the input offset
+                      of the next row, the region and the length of the output are saved to
+                      <output file>.checkpoint. --resume truncates the output to that length and reads
+                      on from that offset. A checkpoint is only used for the same unchanged input file,
+                      and a run that completes removes it. Not for -, binary output or --stats
+  --stats             parse the x, y and z coordinates of every vertex in the content region and
+                      print the vertex count, bounding box and centroid with the final summary
+  --substring <text>  search for text, the same as giving it as the third file name argument
+  --terminator <text> also end the header at a row containing text, may be given many times
+  --drop <text>       leave out content rows containing text, e.g. --drop comment
+  --select <text>     only keep content rows containing text, or any other --select text
+  --patterns <file>   read more of these patterns from a file, one per line as "terminator <text>",
+                      "drop <text>" or "select <text>". Blank lines and lines starting with # are skipped
+                      All the patterns are found together by an Aho-Corasick automaton built once,
+                      in a single pass over each row however many patterns there are
+  --where <expr>      only keep content rows whose coordinates match expr, e.g. "z > 16.0 && x < -0.9".
+                      Compares x, y or z with a number by <, <=, >, >=, == or !=, joined by && and ||,
+                      negated by ! and grouped by parentheses. The expression is compiled once, then the
+                      where stage parses the coordinates of each batch into columns and compares whole
+                      vectors of them at once with SSE2 or AVX2, whichever the CPU has. The coordinates
+                      are the x, y and z properties of the vertex element of a PLY header, or the first
+                      three numbers of each row when the header declares no vertex element or cannot be
+                      parsed. Rows without them never match, like the faces of a PLY file. Runs over
+                      the rings in batches of 65536 bytes unless a batch size is given, with the plan
+                      read,strip+filter+where+parse,write unless a plan is given. Not with --resume
+  --output-format <ascii|binary>
+                      binary saves the Content region as a binary little endian PLY file. An ascii
+                      PLY header is parsed into elements and typed properties, and every content
+                      row is parsed into preallocated columns sized from the declared counts.
+                      Without a PLY header, each row is converted to x, y, z float vertices
+
+  To strip the header of many files, give an output directory followed by any number of input
+  files or directories. Every file directly within a directory is an input. Each output is saved
+  to the output directory under the name of its input:
+  ./main [options] --output-dir <directory> [--jobs <N>] <input file or directory>...
+  --jobs <N>          number of files processed at the same time, by default one per CPU core
 */
 
+#define _GNU_SOURCE
+
 #include <pthread.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -25,43 +136,222 @@
 #include <errno.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <dirent.h>
+#include <stdatomic.h>
+#include <sys/resource.h>
+#include "bulk_copy.h"
+#include "checkpoint.h"
+#include "handoff.h"
+#include "parallel.h"
+#include "patterns.h"
+#include "output_buffer.h"
+#include "ply.h"
+#include "row_pool.h"
+#include "search.h"
+#include "shared_memory.h"
+#include "stage_metrics.h"
+#include "stage_pipeline.h"
+#include "thread_placement.h"
+#include "uring_io.h"
+#include "vertex_stats.h"
+#include "where.h"
 
 #define BUFFER_SIZE 1024
 #define MAX_ARGUMENT_LENGTH 100
 #define DEFAULT_INPUT_FILENAME "data.txt"
 #define DEFAULT_OUTPUT_FILENAME "output.txt"
 #define DEFAULT_SUBSTRING "end_header"
+#define DEFAULT_BATCH_QUEUE_DEPTH 4
+#define MIN_BATCH_ROW_LENGTH 8
+#define DEFAULT_FLUSH_BYTES (1 << 20)
+#define DEFAULT_STAGE_PLAN "read,strip+filter+parse,write" //The threads of the rings, the same as in lockstep mode
+#define PROCESSORS_STAGE_PLAN "read,scan+filter%%%u,strip+%sparse+write" //The plan of --processors, with its number of workers and the where stage of --where
+#define WHERE_STAGE_PLAN "read,strip+filter+where+parse,write" //The default plan with --where
+#define DEFAULT_WHERE_BATCH_BYTES 65536 //Batches of --where without a batch size, so each compare covers many rows
+#define RESUME_LIMITS "--resume only continues ascii output of a single file through the threads, without --io-uring, --stats or --where"
+#define SHUTDOWN_TIMEOUT 2.0         //Seconds the threads get to drain the rows in flight after an interrupt before they are cancelled
+#define SHUTDOWN_WAKE_INTERVAL 0.01  //Seconds between the signals that wake a Reader blocked on its input after an interrupt
 
 /* --- Structs --- */
 typedef enum fileRegion
 {
   Header,
-  Content
+  Content,
+  Dropped //A content row left out by the --drop and --select patterns
 } fileRegion;
 
+//How the Writer saves the Content region
+typedef enum outputFormat
+{
+  AsciiOutput,  //The rows exactly as they were read
+  BinaryOutput  //A binary little endian PLY file, with the elements of the input header or x, y, z float vertices
+} outputFormat;
+
 //Each structure defines a row of a file
 typedef struct DataRow
 {
   //An enum is used to determine whether the row is from the header or the content region
   enum fileRegion region;
 
-  //The char array is used to store the content of the row read from the file
-  char content[BUFFER_SIZE];
+  //The row read from the file, owned by the thread holding this DataRow until the Writer gives it back to the pool
+  PooledRow * pooled;
+
+  //In mmap mode the row is not copied at all, it is a view into the mapped input file instead
+  size_t offset;
+  size_t length;
+
+  //Set instead of a row once the Reader has closed the pipe, so that the Writer finishes the output
+  bool endOfStream;
 } DataRow;
 
+//A view of one row within the mapped input file, sent through the pipe in mmap mode
+typedef struct RowView
+{
+  size_t offset;
+  size_t length;
+} RowView;
+
+//A row within a batch, its offset is into the batch data, or into the mapped input file in mmap mode
+typedef struct RowSpan
+{
+  enum fileRegion region;
+  size_t offset;
+  size_t length;
+  PooledRow * pooled; //Only set for a row longer than the free space of the slot, which is held in a pooled row instead
+} RowSpan;
+
+//A block of rows handed between threads in a single ring slot
+//The slot holds this header, followed by maxRows RowSpans and then the text of the rows
+typedef struct RowBatch
+{
+  size_t rowCount;
+  size_t dataLength; //Total length of the rows in the batch
+  size_t sequence;   //The position of the batch in the stream, numbered by the read stage
+  bool scanned;      //The scan stage left every row in the Content region, and found the rows that are header if the header goes on into the batch
+  size_t headerRows;
+  bool headerEnds;   //Whether the header ends within those rows
+} RowBatch;
+
+//A batch is handed over once it holds maxRows rows or maxBytes bytes, whichever comes first
+typedef struct
+{
+  size_t maxRows;
+  size_t maxBytes;
+  size_t slotSize;
+} BatchLimits;
+
+//The input file mapped into memory, shared read-only by every thread in mmap mode
+typedef struct
+{
+  const char * data;
+  size_t size;
+} MappedInput;
+
+//Options selected on the command line
+typedef struct
+{
+  bool useMmap;
+  unsigned queueDepth; //Zero keeps the single slot lockstep handoff
+  size_t batchRows;    //Zero when no row count was given
+  size_t batchBytes;   //Zero when no byte budget was given
+  bool bulkCopy;       //Copy the content region with the kernel instead of the threads
+  char * outputDirectory; //Set in multi-file mode, where every positional argument is an input
+  unsigned jobs;       //Number of files processed at the same time in multi-file mode
+  enum outputFormat outputFormat;
+  unsigned parallelThreads; //Zero keeps the three thread pipeline, otherwise chunks are processed on this many threads
+  bool vertexStats;    //Gather the bounding box and centroid of the vertices while the content is processed
+  bool useUring;       //Read and write the files through io_uring, only set once it is known to be available
+  size_t flushBytes;   //Ascii output is written once this many bytes are waiting
+  double flushLatency; //Or once the oldest waiting row is this many seconds old, zero for no limit
+  PatternSet patterns; //Terminators and row filters, empty unless one was given
+  bool resume;         //Continue from the checkpoint of an interrupted run
+  StagePlan stagePlan; //The stages run over the rings and the threads they run on, empty in lockstep mode
+  ThreadPlacement placement; //The CPUs and scheduling of the pipeline threads, left to the kernel unless given
+  bool lockMemory;     //Lock every page of the process into memory, so no row waits on a page fault
+  HandoffMode handoffMode; //How the threads wait for each other, in sem_wait or spinning before they park
+  bool useProcesses;   //Run each group of stages in a process of its own, connected by rings in shared memory
+  unsigned processors; //Workers of the Processor that take the batches in any order, zero for the plan given or the default one
+  WhereProgram where;  //The compiled --where expression, empty unless one was given
+} ProgramOptions;
+
+//The state and results of one run of the pipeline over one input file
+typedef struct PipelineRun
+{
+  char * inputFileName;
+  char * outputFileName;
+  char * substring;
+
+  bool dataInFile;     //To track whether the input file contains any data
+  bool substringFound; //To track whether the substring was found in the input file
+  size_t rowsRead;     //Throughput counters, only updated by the Reader thread
+  size_t bytesRead;
+  double elapsedTime;
+  const char * copyMethod; //Only set in bulk copy mode
+  unsigned parallelRounds; //Rounds of chunks processed, only set in parallel mode
+  size_t convertedRows; //Rows written in binary output mode
+  size_t skippedRows;  //Content rows that binary output mode could not convert
+  atomic_size_t droppedRows; //Content rows left out by the row filters, added to by every filter worker
+  size_t whereTested, whereKept; //Content rows the where stage compared, and those that matched the --where expression
+  atomic_size_t contentBatch; //The first batch the strip stage knows to start in the Content region, which the scan stage no longer searches
+  size_t pooledRows, longestRow; //Row buffers the pool allocated, and the longest row they held, only in stdio mode
+  bool uringReads, uringWrites;  //Whether the input and output files were opened through io_uring
+  size_t outputFlushes, latencyFlushes; //Writes of the gathered ascii output, and how many the latency limit caused
+  PipelineMetrics metrics; //What each thread has done, reported on SIGUSR1 and at exit
+  bool outputFinished; //Set by the Writer under shutdownLock once the output file is complete
+  bool outputFailed;   //Whether any part of the output could not be written, so the output file is incomplete
+  bool interrupted;    //Whether the run was still going when the user interrupted it
+  atomic_bool shutdownCancelled; //Whether threads had to be cancelled because they did not drain in time
+  double shutdownLatency; //Seconds from the interrupt until every thread had exited
+  bool resumed;        //Whether the run continues from a checkpoint, at these offsets of the input and output
+  size_t resumeInput, resumeOutput;
+  size_t inputWritten; //Input offset after the last row the Writer has handled, whatever its region
+  size_t outputBytes;
+  PlySchema schema;    //The parsed PLY header and typed content, only filled when the content is parsed
+  VertexStats stats;   //Only gathered when the statistics were requested
+
+  //How often the stages on either side of each ring had to wait on each other, only set when the rings are used
+  BatchLimits batchLimits;
+  size_t fullStalls[MAX_PIPELINE_STAGES], emptyStalls[MAX_PIPELINE_STAGES];
+  HandoffStats handoffs; //What the threads' waits for each other cost, in either mode
+
+  pthread_t * threadIDs; //Every thread of the pipeline, the Reader first
+  unsigned threadCount;
+  pid_t * processIDs;   //Every process of the pipeline instead in process mode, the read stage first
+  unsigned processCount;
+} PipelineRun;
+
+//The list of input files of the multi-file mode, shared by the workers of the pool
 typedef struct
 {
-  sem_t * sem_read;
-  sem_t * sem_process;
-  sem_t * sem_write;
+  ProgramOptions * options;
+  PipelineRun * runs;
+  size_t runCount;
+  atomic_size_t nextRun;
+} WorkerPoolParams;
+
+//The three counting semaphores of lockstep mode, which wait the way the handoff mode selects
+typedef struct
+{
+  Handoff * sem_read;
+  Handoff * sem_process;
+  Handoff * sem_write;
+  HandoffMode mode;
 } SemaphoreParams;
 
 typedef struct
 {
   char * inputFileName;
   int * pipePrt;
-  sem_t * read;
-  sem_t * process;
+  Handoff * read;
+  Handoff * process;
+  MappedInput * mappedInput;
+  BatchLimits * batchLimits;
+  PipelineRun * run;
+  RowPool * rowPool;   //NULL in mmap mode, where rows are never copied
+  bool useUring;
+  StageMetrics * metrics; //Only used in lockstep mode, the stages of the rings have metrics of their own
 } ReadParams;
 
 typedef struct
@@ -69,26 +359,229 @@ typedef struct
   char * substring;
   int *pipePrt;
   DataRow * sharedBuffer;
-  sem_t * process;
-  sem_t * write;
+  Handoff * process;
+  Handoff * write;
+  MappedInput * mappedInput;
+  BatchLimits * batchLimits;
+  PipelineRun * run;
+  PlySchema * schema;  //NULL unless the header is parsed, for typed columns or vertex statistics
+  bool typedColumns;   //Parse the content rows into the typed columns of the schema
+  VertexStats * stats; //NULL unless the vertex statistics were requested
+  const PatternSet * patterns; //NULL unless terminators or row filters were given, the substring alone is searched faster
+  const WhereProgram * where;  //NULL unless --where was given
+  StageMetrics * metrics;
 } ProcessorParams;
 
 typedef struct
 {
   char * outputFileName;
   DataRow * sharedBuffer;
-  sem_t * write;
-  sem_t * read;
+  Handoff * write;
+  Handoff * read;
+  MappedInput * mappedInput;
+  BatchLimits * batchLimits;
+  PipelineRun * run;
+  enum outputFormat outputFormat;
+  PlySchema * schema;
+  RowPool * rowPool;
+  bool useUring;
+  size_t flushBytes;
+  double flushLatency;
+  StageMetrics * metrics;
 } WriterParams;
 
+//The state of the Writer, kept outside the thread so that the output file can be finished even when it is cancelled
+typedef struct
+{
+  WriterParams * parameters;
+  FILE * writeFile;
+
+  //Binary output writes the header once the first content row arrives, when the PLY schema is known
+  bool headerWritten;
+  bool useSchema;
+  PlyCursor cursor;
+  long * countPositions;
+
+  //Ascii rows are gathered here and written in large blocks
+  OutputBuffer output;
+
+  //Binary output to a pipe is written to a temporary file instead, then copied here once its counts are filled in
+  FILE * streamFile;
+} WriterState;
+
+//The thread that waits for the stage processes of a run to exit in process mode
+typedef struct
+{
+  StagePipeline * stages;
+  PipelineRun * run;
+  bool succeeded;
+} ProcessWatcherParams;
+
+//The context of the stages run over the rings, which share the parameters of the three threads of lockstep mode
+typedef struct
+{
+  ReadParams * read;
+  ProcessorParams * processor;
+  WriterParams * writer;
+} StageParams;
+
+//The state of the read stage
+typedef struct
+{
+  ReadParams * parameters;
+  FILE * readFile;
+  size_t nextOffset;
+  size_t nextSequence;
+  bool endOfFile;
+} ReadStage;
+
+//The state of the strip stage, the region carries over from one batch to the next
+typedef struct
+{
+  ProcessorParams * parameters;
+  enum fileRegion region;
+  size_t headerDrops; //Header rows a filter ahead of the strip stage counted as dropped, while it took them for content
+} StripStage;
+
+//The state of each worker of the filter stage, which counts the rows it left out on its own
+typedef struct
+{
+  ProcessorParams * parameters;
+  size_t droppedRows;
+} FilterStage;
+
+//The state of the where stage, the rows of each batch the expression is evaluated over and those that matched
+typedef struct
+{
+  ProcessorParams * parameters;
+  WhereFilter filter;
+  size_t * candidates; //The index in the batch of each row added to the filter
+  size_t * selected;
+} WhereStage;
+
 /* --- Prototypes --- */
 
-/* Initializes the three semaphores that are used to control the order of execution of the threads */
+/* Prints the accepted ways of invoking the program and exits */
+void printUsage();
+
+/* Prints a final message to indicate how the program performed */
+void printSummary(PipelineRun * run);
+
+/* Prints the vertex count, bounding box and centroid of the content region, and how fast it was parsed */
+void printVertexStats(PipelineRun * run);
+
+/* Prints the throughput of a run, and how often the threads stalled on each other when the rings were used */
+void printRunStatistics(ProgramOptions * options, PipelineRun * run);
+
+/* Runs the Reader, Processor and Writer threads, or the bulk copy, over the input file of the run */
+void runPipeline(ProgramOptions * options, PipelineRun * run);
+
+/* Adds a file, or every file within a directory, to the inputs of the multi-file mode */
+void addInputFiles(const char * path, char *** inputFileNames, size_t * inputCount);
+
+/* Orders file names alphabetically for qsort */
+int compareFileNames(const void * first, const void * second);
+
+/* Runs the pipeline over many input files with a pool of workers and prints the status of each file.
+   Returns false if any output could not be written */
+bool runMultiFile(ProgramOptions * options, char ** inputFileNames, size_t inputCount, char * substring);
+
+/* A worker of the multi-file mode, which runs the pipeline over one input file after another */
+void *FileWorker(void * params);
+
+/* Maps the input file into memory for the mmap reader mode */
+void mapInputFile(char * inputFileName, MappedInput * mappedInput);
+
+/* Works out the batch limits and ring slot size from the batch options */
+void setBatchLimits(ProgramOptions * options, BatchLimits * limits);
+
+/* Returns the RowSpans stored in a batch slot */
+RowSpan * batchRows(RowBatch * batch);
+
+/* Returns the start of the row text stored in a batch slot */
+char * batchData(RowBatch * batch, BatchLimits * limits);
+
+/* Returns the text of a row in a batch, which is either stored in the batch or in the mapped input */
+char * spanText(RowBatch * batch, BatchLimits * limits, MappedInput * mappedInput, RowSpan * span);
+
+/* Returns the current time of the monotonic clock in seconds */
+double currentTime();
+
+/* Initializes the three semaphores that are used to control the order of execution of the threads, in the handoff mode of the run */
 void initialiseSempahores(void * params);
 
 /* Handles the Ctrl+C signal interrupt and safely exits the program */
 void handleInterupt();
 
+/* Raised to interrupt a blocking read or semaphore wait of the Reader after an interrupt.
+   A read stage in a process of its own has not seen the interrupt itself, so it also stops reading */
+void handleWake(int signalNumber);
+
+/* Wakes the threads waiting on the pipelines after an interrupt, which the signal handler cannot do itself */
+void *InterruptWatcher(void * params);
+
+/* Waits for the stage processes of a run to exit, then marks its output as finished */
+void *StageProcessWatcher(void * params);
+
+/* Waits until the Writer has finished the output. After an interrupt the rows in flight are drained within SHUTDOWN_TIMEOUT, or the threads are cancelled */
+void awaitPipeline(PipelineRun * run);
+
+/* Marks the output of a run as finished and wakes the thread waiting on it */
+void markOutputFinished(PipelineRun * run);
+
+/* Reads the next row into buffer, or into a pooled row when it does not fit, or finds its offset in the mapped input */
+bool readRow(ReadParams * parameters, FILE * readFile, size_t * nextOffset, char * buffer, size_t space, PooledRow ** pooled, size_t * offset, size_t * length);
+
+/* Loads the checkpoint of the output file and sets the run up to continue from it, or leaves it to start over without one */
+void resumeFromCheckpoint(PipelineRun * run, const char * checkpointName);
+
+/* Returns whether --resume can continue a run with these options */
+bool canResume(const ProgramOptions * options);
+
+/* Saves a checkpoint after an interrupted run whose output is complete up to the last row read and that --resume could continue,
+   otherwise removes any old one */
+void finishCheckpoint(ProgramOptions * options, PipelineRun * run, const char * checkpointName);
+
+/* Adds the substring to the terminators and builds the automaton, when any other pattern was given */
+void preparePatterns(ProgramOptions * options, const char * substring);
+
+/* Tags a row with the current region and switches to the Content region after the row containing the substring */
+void tagRow(ProcessorParams * parameters, enum fileRegion * region, enum fileRegion * rowRegion, const char * content, size_t length);
+
+/* Tags every row of a batch, searching the rows that are still in the Header region with a single call */
+void tagBatch(ProcessorParams * parameters, enum fileRegion * region, RowBatch * batch);
+
+/* Returns Dropped for a content row that the row filters leave out, otherwise Content */
+enum fileRegion filterRow(const PatternSet * patterns, const char * content, size_t length);
+
+/* Adds a tagged row to the PLY schema, or parses it into the typed columns once the header is complete */
+void parseTaggedRow(ProcessorParams * parameters, enum fileRegion rowRegion, const char * content, size_t length);
+
+/* Writes the header of the binary output, from the PLY schema when it could be parsed */
+void writeBinaryHeader(WriterState * state);
+
+/* Writes a row of the Content region to the output file in the selected output format, stable rows stay valid until the next flush */
+void writeContentRow(WriterState * state, const char * content, size_t length, bool stable);
+
+/* Waits for the next row in lockstep mode, writing the waiting rows first when the Writer would sleep under a latency limit.
+   Returns false if the wait failed */
+bool waitForWriterRow(WriterState * state);
+
+/* Completes and closes the output file, run when the Writer returns or is cancelled */
+void finishOutputFile(void * state);
+
+/* Copies a temporary file from its start to a file descriptor, returning false if either failed */
+bool copyStream(FILE * source, int destination);
+
+/* Opens the input file of the Reader or the read stage and seeks to the checkpoint of a resumed run, or returns NULL in mmap mode */
+FILE * openInputFile(ReadParams * parameters);
+
+/* Lets the wake signal interrupt the blocking reads and waits of the calling thread, which reads the input */
+void unblockWakeSignal();
+
+/* Opens the output file of the Writer or the write stage and sets up the state that writes to it */
+void openOutputFile(WriterParams * parameters, WriterState * state);
+
 /* A thread which reads data from input file and writes each row to a pipe */
 void *Reader(void * params);
 
@@ -98,261 +591,2155 @@ void *Processor(void * params);
 /* A thread which reads from shared message and writes non-header text to the output file */
 void *Writer(void * params);
 
-pthread_t readerThreadID, processorThreadID, writerThreadID;    //Thread ID
+/* Opens a file for the Reader or Writer, where - is stdin or stdout, through io_uring when it is asked for and available */
+FILE * openStream(const char * fileName, const char * mode, bool useUring, bool * usedUring);
+
+/* Returns whether a file name is - for stdin or stdout */
+bool isStandardStream(const char * fileName);
+
+/* Asks for a report of the stage metrics when SIGUSR1 is received, without stopping the run */
+void handleMetricsRequest(int signalNumber);
+
+/* Returns the total length of the rows of a batch, including rows held in the row pool */
+size_t batchBytes(RowBatch * batch);
+
+/* Copies the part of a batch in use into the slot of the next ring of the stages */
+void copyBatch(void * context, void * to, void * from);
+
+/* Returns the rows and bytes of a batch for the metrics of the stages */
+void measureBatch(void * context, void * slot, size_t * rows, size_t * bytes);
+
+/* Exits when the stage plan cannot do what the other options ask for */
+void checkStagePlan(ProgramOptions * options);
+
+/* The stages of the rings. Each reuses the parameters of the thread of lockstep mode that does the same work */
+void * initReadStage(void * context, unsigned worker);
+bool readBatch(void * state, void * slot);
+void finishReadStage(void * state);
+void * initScanStage(void * context, unsigned worker);
+bool scanBatch(void * state, void * slot);
+void * initStripStage(void * context, unsigned worker);
+bool stripBatch(void * state, void * slot);
+void finishStripStage(void * state);
+void * initFilterStage(void * context, unsigned worker);
+bool filterBatch(void * state, void * slot);
+void finishFilterStage(void * state);
+void * initWhereStage(void * context, unsigned worker);
+bool whereBatch(void * state, void * slot);
+void finishWhereStage(void * state);
+void * initParseStage(void * context, unsigned worker);
+bool parseBatch(void * state, void * slot);
+void * initWriteStage(void * context, unsigned worker);
+bool writeBatch(void * state, void * slot);
+void idleWriteStage(void * state);
+void finishWriteStage(void * state);
 
 /* Global flags */
-bool dataInFile; //To track whether the input file contains any data
-bool substringFound; //To track whether the substring was found in the input file
-bool safelyTerminate; //To track whether the user has interrupted the program
+atomic_bool safelyTerminate; //To track whether the user has interrupted the program
+double interruptTime;        //When the user interrupted the program, to measure how long the threads took to stop
+sem_t interruptPosted;       //Posted by the interrupt handler for the InterruptWatcher
+pthread_mutex_t shutdownLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t shutdownChanged = PTHREAD_COND_INITIALIZER; //Broadcast when an output is finished or the user interrupts
+
+/* The stages a --stages plan is made of, in the order they can run */
+const StageType pipelineStages[] = {
+  {"read", StageSource, false, initReadStage, readBatch, NULL, finishReadStage},
+  {"scan", StageTransform, true, initScanStage, scanBatch, NULL, NULL},
+  {"strip", StageTransform, false, initStripStage, stripBatch, NULL, finishStripStage},
+  {"filter", StageTransform, true, initFilterStage, filterBatch, NULL, finishFilterStage},
+  {"where", StageTransform, false, initWhereStage, whereBatch, NULL, finishWhereStage},
+  {"parse", StageTransform, false, initParseStage, parseBatch, NULL, NULL},
+  {"write", StageSink, false, initWriteStage, writeBatch, idleWriteStage, finishWriteStage}
+};
 
 int main(int argc, char const *argv[])
 {
   /* Handles the Ctrl+C signal interrupt and safely exits the program */
+  sem_init(&interruptPosted, 0, 0);
   signal(SIGINT, handleInterupt);
+  signal(SIGUSR1, handleMetricsRequest);
 
-  // Ensure that the program has been invoked correctly
-  if (argc < 1 || argc > 4) {
-		fprintf(stderr, "USAGE:\n");
-    fprintf(stderr, "./main.out\n");
-    fprintf(stderr, "./main.out <input file>\n");
-    fprintf(stderr, "./main.out <input file> <output file>\n");
-    fprintf(stderr, "./main.out <input file> <output file> <substring>\n");
-    exit(EXIT_FAILURE);
-	}
+  // Without SA_RESTART, so that the wake signal makes a blocking read of the Reader return
+  struct sigaction wake;
+  memset(&wake, 0, sizeof(wake));
+  wake.sa_handler = handleWake;
+  sigemptyset(&wake.sa_mask);
+  sigaction(SIGUSR2, &wake, NULL);
 
   // Assign default input and output file names
   char inputFileName[MAX_ARGUMENT_LENGTH] = DEFAULT_INPUT_FILENAME;
   char outputFileName[MAX_ARGUMENT_LENGTH] = DEFAULT_OUTPUT_FILENAME;
   char substring[MAX_ARGUMENT_LENGTH] = DEFAULT_SUBSTRING;
+  ProgramOptions options = {false, 0, 0, 0, false, NULL, 0, AsciiOutput, 0, false, false, DEFAULT_FLUSH_BYTES, 0};
+  char const * positionalArguments[argc];
+  int positionalCount = 0;
+  FILE * metricsFile = stderr;
 
-  // Override the default input and output file names if they have been specified by the user 
+  // Override the defaults with the options and file names specified by the user
   for(int i = 1; i < argc; i++){
-    if(strlen(argv[i]) > MAX_ARGUMENT_LENGTH){
-      fprintf(stderr, "Argument number %i exceeds %i characters.\n", i, MAX_ARGUMENT_LENGTH);
+    if(strlen(argv[i]) >= MAX_ARGUMENT_LENGTH){
+      fprintf(stderr, "Argument number %i exceeds %i characters.\n", i, MAX_ARGUMENT_LENGTH - 1);
       fprintf(stderr, "Exiting program...\n");
       exit(EXIT_FAILURE);
-    } else {
-      switch(i){
-        case 1:
-          strncpy(inputFileName, argv[1], MAX_ARGUMENT_LENGTH);
-          break;
-        case 2:
-          strncpy(outputFileName, argv[2], MAX_ARGUMENT_LENGTH);
-          break;
-        case 3:
-          strncpy(substring, argv[3], MAX_ARGUMENT_LENGTH);
-          break;
-        default:
-          break;
-      }
     }
-  }
 
-  /* Initialisaton*/
-  int pipeFileDescriptor[2];              //File descriptor for creating a pipe
-  DataRow sharedBuffer;                   //Create shared memory buffer
-  pthread_attr_t threadAttributes;        //Create pthread thread attributes object
-  sem_t sem_read, sem_process, sem_write; //Create semaphores
+    if(strncmp(argv[i], "--", 2) == 0){
+      if(strcmp(argv[i], "--mmap") == 0){
+        options.useMmap = true;
+      } else if(strcmp(argv[i], "--stats") == 0){
+        options.vertexStats = true;
+      } else if(strcmp(argv[i], "--io-uring") == 0){
+        options.useUring = true;
+      } else if(strcmp(argv[i], "--flush-bytes") == 0 && i + 1 < argc){
+        char * end;
+        long size = strtol(argv[++i], &end, 10);
+        if(*end != '\0' || size < 1 || size > 1 << 30){
+          fprintf(stderr, "The flush size must be between 1 and %i bytes\n", 1 << 30);
+          exit(EXIT_FAILURE);
+        }
+        options.flushBytes = size;
+      } else if(strcmp(argv[i], "--flush-latency") == 0 && i + 1 < argc){
+        char * end;
+        double latency = strtod(argv[++i], &end);
+        if(*end != '\0' || !(latency > 0) || latency > 60000){
+          fprintf(stderr, "The flush latency must be more than 0 and at most 60000 ms\n");
+          exit(EXIT_FAILURE);
+        }
+        options.flushLatency = latency / 1000;
+      } else if(strcmp(argv[i], "--cpus") == 0 && i + 1 < argc){
+        free(options.placement.cpus);
+        if(!parseNumberList(argv[++i], "CPU list", true, &options.placement.cpus, &options.placement.cpuCount)){
+          exit(EXIT_FAILURE);
+        }
+      } else if(strcmp(argv[i], "--sched") == 0 && i + 1 < argc){
+        if(!parseSchedulingPolicy(argv[++i], &options.placement.policy)){
+          fprintf(stderr, "The scheduling policy must be fifo, rr or other\n");
+          exit(EXIT_FAILURE);
+        }
+      } else if(strcmp(argv[i], "--priorities") == 0 && i + 1 < argc){
+        free(options.placement.priorities);
+        if(!parseNumberList(argv[++i], "priority list", false, &options.placement.priorities, &options.placement.priorityCount)){
+          exit(EXIT_FAILURE);
+        }
+      } else if(strcmp(argv[i], "--handoff") == 0 && i + 1 < argc){
+        if(!parseHandoffMode(argv[++i], &options.handoffMode)){
+          fprintf(stderr, "The handoff mode must be semaphore or spin\n");
+          exit(EXIT_FAILURE);
+        }
+      } else if(strcmp(argv[i], "--processes") == 0){
+        options.useProcesses = true;
+      } else if(strcmp(argv[i], "--processors") == 0 && i + 1 < argc){
+        char * end;
+        long processors = strtol(argv[++i], &end, 10);
+        if(*end != '\0' || processors < 1 || processors > MAX_STAGE_WORKERS){
+          fprintf(stderr, "The number of processors must be between 1 and %d\n", MAX_STAGE_WORKERS);
+          exit(EXIT_FAILURE);
+        }
+        options.processors = processors;
+      } else if(strcmp(argv[i], "--mlock") == 0){
+        options.lockMemory = true;
+      } else if(strcmp(argv[i], "--metrics-file") == 0 && i + 1 < argc){
+        if((metricsFile = fopen(argv[++i], "a")) == NULL){
+          fprintf(stderr, "Error opening metrics file %s: %s\n", argv[i], strerror(errno));
+          exit(EXIT_FAILURE);
+        }
+      } else if((strcmp(argv[i], "--terminator") == 0 || strcmp(argv[i], "--drop") == 0 || strcmp(argv[i], "--select") == 0) && i + 1 < argc){
+        PatternKind kind = argv[i][2] == 't' ? PatternTerminator : argv[i][2] == 'd' ? PatternDrop : PatternSelect;
+        if(!addPattern(&options.patterns, argv[i + 1], strlen(argv[i + 1]), kind)){
+          fprintf(stderr, "%s needs a pattern that is not empty\n", argv[i]);
+          exit(EXIT_FAILURE);
+        }
+        i++;
+      } else if(strcmp(argv[i], "--where") == 0 && i + 1 < argc){
+        if(!compileWhere(&options.where, argv[++i])){
+          exit(EXIT_FAILURE);
+        }
+      } else if(strcmp(argv[i], "--patterns") == 0 && i + 1 < argc){
+        if(!loadPatternFile(&options.patterns, argv[++i])){
+          exit(EXIT_FAILURE);
+        }
+      } else if(strcmp(argv[i], "--resume") == 0){
+        options.resume = true;
+      } else if(strcmp(argv[i], "--bulk-copy") == 0){
+        options.bulkCopy = true;
+      } else if(strcmp(argv[i], "--output-dir") == 0 && i + 1 < argc){
+        options.outputDirectory = (char *) argv[++i];
+      } else if(strcmp(argv[i], "--output-format") == 0 && i + 1 < argc){
+        i++;
+        if(strcmp(argv[i], "ascii") == 0){
+          options.outputFormat = AsciiOutput;
+        } else if(strcmp(argv[i], "binary") == 0){
+          options.outputFormat = BinaryOutput;
+        } else {
+          fprintf(stderr, "The output format must be ascii or binary\n");
+          exit(EXIT_FAILURE);
+        }
+      } else if(strcmp(argv[i], "--substring") == 0 && i + 1 < argc){
+        strcpy(substring, argv[++i]);
+      } else if(strcmp(argv[i], "--jobs") == 0 && i + 1 < argc){
+        char * end;
+        long jobs = strtol(argv[++i], &end, 10);
+        if(*end != '\0' || jobs < 1 || jobs > 1024){
+          fprintf(stderr, "The number of jobs must be between 1 and 1024\n");
+          exit(EXIT_FAILURE);
+        }
+        options.jobs = jobs;
+      } else if(strcmp(argv[i], "--parallel") == 0 && i + 1 < argc){
+        char * end;
+        long threads = strtol(argv[++i], &end, 10);
+        if(*end != '\0' || threads < 1 || threads > 1024){
+          fprintf(stderr, "The number of parallel threads must be between 1 and 1024\n");
+          exit(EXIT_FAILURE);
+        }
+        options.parallelThreads = threads;
+      } else if(strcmp(argv[i], "--stages") == 0 && i + 1 < argc){
+        if(!parseStagePlan(&options.stagePlan, argv[++i], pipelineStages, sizeof(pipelineStages) / sizeof(pipelineStages[0]))){
+          exit(EXIT_FAILURE);
+        }
+      } else if(strcmp(argv[i], "--queue-depth") == 0 && i + 1 < argc){
+        char * end;
+        long depth = strtol(argv[++i], &end, 10);
+        if(*end != '\0' || depth < 1 || depth > 1 << 20){
+          fprintf(stderr, "The queue depth must be between 1 and %i\n", 1 << 20);
+          exit(EXIT_FAILURE);
+        }
+        options.queueDepth = depth;
+      } else if((strcmp(argv[i], "--batch-rows") == 0 || strcmp(argv[i], "--batch-bytes") == 0) && i + 1 < argc){
+        char * end;
+        bool isRows = strcmp(argv[i], "--batch-rows") == 0;
+        long size = strtol(argv[++i], &end, 10);
+        if(*end != '\0' || size < 1 || size > 1 << 26){
+          fprintf(stderr, "The batch size must be between 1 and %i\n", 1 << 26);
+          exit(EXIT_FAILURE);
+        }
+        if(isRows){
+          options.batchRows = size;
+        } else {
+          options.batchBytes = size;
+        }
+      } else {
+        fprintf(stderr, "Unknown option %s\n", argv[i]);
+        printUsage();
+      }
+      continue;
+    }
 
-  // Instantiate thread paramater structures for each thread
-  SemaphoreParams semParams = {&sem_read, &sem_process, &sem_write};
-  ReadParams readParams = {inputFileName, pipeFileDescriptor, &sem_read, &sem_process};
-  ProcessorParams processorParams = {substring, pipeFileDescriptor, &sharedBuffer, &sem_process, &sem_write};
-  WriterParams writerParams = {outputFileName, &sharedBuffer, &sem_write, &sem_read};
+    positionalArguments[positionalCount++] = argv[i];
+  }
 
-  initialiseSempahores(&semParams);
-  pthread_attr_init(&threadAttributes);
+  // The workers of --processors are a group of the stage plan, so the options of the rings apply to them too
+  if(options.processors > 0){
+    if(options.stagePlan.groupCount > 0){
+      fprintf(stderr, "--processors runs a stage plan of its own, use a group like scan+filter%%%u in the --stages plan instead\n", options.processors);
+      exit(EXIT_FAILURE);
+    }
+    char plan[64];
+    snprintf(plan, sizeof(plan), PROCESSORS_STAGE_PLAN, options.processors, options.where.stepCount > 0 ? "where+" : "");
+    if(!parseStagePlan(&options.stagePlan, plan, pipelineStages, sizeof(pipelineStages) / sizeof(pipelineStages[0]))){
+      exit(EXIT_FAILURE);
+    }
+  }
 
-  // Create pipe between Processor and Writer thread
-  if (pipe(pipeFileDescriptor) < 0){
-    perror("Pipe creation error");
+  // The bulk copy mode only reads the header, so none of the thread handoff options apply to it
+  if(options.bulkCopy && (options.useMmap || options.queueDepth > 0 || options.batchRows > 0 || options.batchBytes > 0
+      || options.stagePlan.groupCount > 0 || options.outputFormat != AsciiOutput || options.vertexStats)){
+    fprintf(stderr, "--bulk-copy cannot be combined with the thread handoff, output format or statistics options\n");
     exit(EXIT_FAILURE);
   }
 
-  // Create the Reader, Processor and Writer thread
-  if (pthread_create(&readerThreadID, &threadAttributes, Reader, &readParams) != 0){
-    perror("Error creating Reader thread");
+  // The parallel mode maps the input and splits it itself, so it replaces the thread handoff and the bulk copy
+  if(options.parallelThreads > 0 && (options.bulkCopy || options.queueDepth > 0 || options.batchRows > 0 || options.batchBytes > 0
+      || options.stagePlan.groupCount > 0)){
+    fprintf(stderr, "--parallel cannot be combined with --bulk-copy or the thread handoff options\n");
     exit(EXIT_FAILURE);
   }
-  if (pthread_create(&processorThreadID, &threadAttributes, Processor, &processorParams) != 0){
-    perror("Error creating Processor thread");
+  if(options.patterns.count > 0 && (options.bulkCopy || options.parallelThreads > 0)){
+    fprintf(stderr, "The terminator and row filter patterns are matched by the Processor thread, not by --bulk-copy or --parallel\n");
     exit(EXIT_FAILURE);
   }
-  if (pthread_create(&writerThreadID, &threadAttributes, Writer, &writerParams) != 0){
-    perror("Error creating Writer thread");
+  if(options.where.stepCount > 0 && (options.bulkCopy || options.parallelThreads > 0)){
+    fprintf(stderr, "--where is evaluated by the where stage over the rings, not by --bulk-copy or --parallel\n");
     exit(EXIT_FAILURE);
   }
-
-  // Wait on threads to finish
-  if(pthread_join(readerThreadID, NULL) != 0){
-    perror("Error joining Reader thread");
+  if(options.resume && !canResume(&options)){
+    fprintf(stderr, RESUME_LIMITS "\n");
+    exit(EXIT_FAILURE);
+  }
+  // The chunks of the parallel mode run on threads of their own, and the bulk copy runs no threads at all
+  if((options.placement.cpuCount > 0 || options.placement.policy != SCHED_OTHER) && (options.bulkCopy || options.parallelThreads > 0)){
+    fprintf(stderr, "--cpus and --sched place the threads of the pipeline, not those of --bulk-copy or --parallel\n");
+    exit(EXIT_FAILURE);
   }
-  if(pthread_join(processorThreadID, NULL) != 0){
-    perror("Error joining Processor thread");
+  // Every stage process has its own copy of the memory of the program, only the counters of the run come back from them.
+  // The columns and statistics the parse stage gathers would stay in its process
+  if(options.useProcesses && (options.bulkCopy || options.parallelThreads > 0 || options.outputDirectory != NULL
+      || options.outputFormat != AsciiOutput || options.vertexStats)){
+    fprintf(stderr, "--processes runs the stages over one file with ascii output, not with --bulk-copy, --parallel, --output-dir, binary output or --stats\n");
+    exit(EXIT_FAILURE);
+  }
+  // Only the views of the rows go through the shared rings, the stage processes all read the rows from the mapped input
+  if(options.useProcesses){
+    options.useMmap = true;
+  }
+  if(options.handoffMode != HandoffSemaphore && (options.bulkCopy || options.parallelThreads > 0)){
+    fprintf(stderr, "--handoff selects how the threads of the pipeline wait for each other, --bulk-copy and --parallel have no handoffs\n");
+    exit(EXIT_FAILURE);
   }
-  if(pthread_join(writerThreadID, NULL) != 0){
-    perror("Error joining Writer thread");
+  if(!checkThreadPlacement(&options.placement)){
+    exit(EXIT_FAILURE);
+  }
+  if(options.useUring && (options.bulkCopy || options.parallelThreads > 0)){
+    fprintf(stderr, "--io-uring only applies to the Reader and Writer threads, not to --bulk-copy or --parallel\n");
+    exit(EXIT_FAILURE);
   }
 
-  // If the program was not terminated by the user
-  // Print a final message to indicate how the program performed
-  if(!safelyTerminate){
-    if(dataInFile){
-      if(substringFound){
-        printf("The content region of %s has been saved to %s\n", inputFileName, outputFileName);
-      } else {
-        printf("The substring '%s' was not found in %s\n", substring, inputFileName);
-      }
-    } else {
-      printf("%s was empty\n", inputFileName);
-    }
+  // The where stage compares the coordinates of a whole batch at once, which a batch of one row would waste
+  if(options.where.stepCount > 0 && options.batchRows == 0 && options.batchBytes == 0){
+    options.batchBytes = DEFAULT_WHERE_BATCH_BYTES;
   }
 
-  printf("Exiting program...\n");
-  return 0;
-}
+  // Batching and the stages only apply to the rings, so they enable them when no queue depth was given
+  if(options.queueDepth == 0 && (options.batchRows > 0 || options.batchBytes > 0 || options.stagePlan.groupCount > 0 || options.useProcesses
+      || options.where.stepCount > 0)){
+    options.queueDepth = DEFAULT_BATCH_QUEUE_DEPTH;
+  }
+  if(options.queueDepth > 0 && options.stagePlan.groupCount == 0){
+    parseStagePlan(&options.stagePlan, options.where.stepCount > 0 ? WHERE_STAGE_PLAN : DEFAULT_STAGE_PLAN, pipelineStages,
+      sizeof(pipelineStages) / sizeof(pipelineStages[0]));
+  }
+  if(options.queueDepth > 0){
+    checkStagePlan(&options);
+  }
 
-void initialiseSempahores(void * params)
-{
-  SemaphoreParams * parameters = params;
-  printf("Initialising program...\n");
+  fprintf(stderr, "Initialising program...\n");
 
-  // Initialise Sempahores
-  if (sem_init(parameters->sem_read, 0, 1)){
-    perror("Error initializing read semaphore.");
-    exit(EXIT_FAILURE);
+  // Pages are locked as they are mapped from now on too, like the rings and rows of the run. Without the privilege the run goes on unlocked
+  if(options.lockMemory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0){
+    fprintf(stderr, "Could not lock the memory of the process (%s), it may be paged out\n", strerror(errno));
+    options.lockMemory = false;
   }
+  startMetricsReporter(metricsFile);
 
-  if (sem_init(parameters->sem_process, 0, 0)){
-    perror("Error initializing process semaphore.");
+  // The watcher takes no signals itself, it only waits for the interrupt handler
+  pthread_t watcherThreadID;
+  sigset_t allSignals, mainSignals;
+  sigfillset(&allSignals);
+  pthread_sigmask(SIG_BLOCK, &allSignals, &mainSignals);
+  if(pthread_create(&watcherThreadID, NULL, InterruptWatcher, NULL) != 0){
+    perror("Error creating interrupt watcher thread");
     exit(EXIT_FAILURE);
   }
+  pthread_detach(watcherThreadID);
+  pthread_sigmask(SIG_SETMASK, &mainSignals, NULL);
 
-  if (sem_init(parameters->sem_write, 0, 0)){
-    perror("Error initializing write semaphore.");
+  // Older kernels, and containers which block the system calls, do not have io_uring
+  const char * uringProblem;
+  if(options.useUring && !uringAvailable(&uringProblem)){
+    fprintf(stderr, "io_uring is not available (%s), falling back to stdio\n", uringProblem);
+    options.useUring = false;
+  }
+
+  // In multi-file mode every positional argument is an input file or a directory of input files
+  if(options.outputDirectory != NULL){
+    char ** inputFileNames = NULL;
+    size_t inputCount = 0;
+
+    if(positionalCount == 0){
+      printUsage();
+    }
+    for(int i = 0; i < positionalCount; i++){
+      addInputFiles(positionalArguments[i], &inputFileNames, &inputCount);
+    }
+    preparePatterns(&options, substring);
+    bool written = runMultiFile(&options, inputFileNames, inputCount, substring);
+
+    for(size_t i = 0; i < inputCount; i++){
+      free(inputFileNames[i]);
+    }
+    free(inputFileNames);
+    freePatternSet(&options.patterns);
+    freeThreadPlacement(&options.placement);
+    fprintf(stderr, "Exiting program...\n");
+    return written ? 0 : EXIT_FAILURE;
+  }
+
+  for(int i = 0; i < positionalCount; i++){
+    switch(i + 1){
+      case 1:
+        strcpy(inputFileName, positionalArguments[i]);
+        break;
+      case 2:
+        strcpy(outputFileName, positionalArguments[i]);
+        break;
+      case 3:
+        strcpy(substring, positionalArguments[i]);
+        break;
+      default:
+        // Ensure that the program has been invoked correctly
+        printUsage();
+    }
+  }
+
+  // Both modes need to find their input by offset, which a stream does not have
+  if((options.bulkCopy || options.parallelThreads > 0) && (isStandardStream(inputFileName) || isStandardStream(outputFileName))){
+    fprintf(stderr, "--bulk-copy and --parallel need input and output file names, - is only read and written by the threads\n");
     exit(EXIT_FAILURE);
   }
-  return;
-}
 
-void handleInterupt(int signalNumber){
-  // Termine the program the Ctrl+C interrupt is raised more than once
-  if(safelyTerminate){
+  if(options.resume && (isStandardStream(inputFileName) || isStandardStream(outputFileName))){
+    fprintf(stderr, "--resume needs to seek in the input and output files, so neither can be -\n");
     exit(EXIT_FAILURE);
-  } else {
-    printf("Interrupt detected: safely exiting program...\n");
-    safelyTerminate = true;
   }
+
+  preparePatterns(&options, substring);
+  PipelineRun run = {inputFileName, outputFileName, substring};
+  char * checkpointName = checkpointFileName(outputFileName);
+  if(options.resume){
+    resumeFromCheckpoint(&run, checkpointName);
+  }
+  runPipeline(&options, &run);
+  finishCheckpoint(&options, &run, checkpointName);
+  free(checkpointName);
+
+  printSummary(&run);
+  if(options.vertexStats){
+    printVertexStats(&run);
+  }
+  printRunStatistics(&options, &run);
+  freePlySchema(&run.schema);
+  freePatternSet(&options.patterns);
+  freeThreadPlacement(&options.placement);
+
+  fprintf(stderr, "Exiting program...\n");
+  return run.outputFailed ? EXIT_FAILURE : 0;
 }
 
-void *Reader(void * params)
+void runPipeline(ProgramOptions * options, PipelineRun * run)
 {
-  ReadParams * parameters = params;
-  char row[BUFFER_SIZE];
-  FILE *readFile;
+  if(options->bulkCopy){
+    double startTime = currentTime();
+    BulkCopyResult result = bulkCopyContent(run->inputFileName, run->outputFileName, run->substring);
+    run->elapsedTime = currentTime() - startTime;
 
-  //Open the input file for reading
-  if ((readFile = fopen(parameters->inputFileName, "r")) == NULL){
-    printf(
-      "Error: Could not find or open %s. Ensure that a file named %s exists within the same directory.\n",
-      parameters->inputFileName, parameters->inputFileName
-    );
-    printf("Exiting program...\n");
-    exit(ENOENT); /* No such file or directory */
+    run->dataInFile = result.dataInFile;
+    run->substringFound = result.substringFound;
+    run->rowsRead = result.headerRows;
+    run->bytesRead = result.headerBytes + result.contentBytes;
+    run->copyMethod = result.method;
+    return;
   }
 
-  printf("Reading from %s\n", parameters->inputFileName);
+  if(options->parallelThreads > 0){
+    double startTime = currentTime();
+    initPlySchema(&run->schema);
+    initVertexStats(&run->stats, 0);
+    ParallelResult result = runParallel(run->inputFileName, run->outputFileName, run->substring,
+      options->parallelThreads, options->outputFormat == BinaryOutput, &run->schema, options->vertexStats ? &run->stats : NULL);
+    run->elapsedTime = currentTime() - startTime;
 
-  while (!safelyTerminate && !sem_wait(parameters->read) && fgets(row, BUFFER_SIZE, readFile) != NULL){
-    dataInFile = true;
-    //Write data from file to pipe between the Reader and Processor thread
-    if ((write(parameters->pipePrt[1], row, strlen(row) + 1) < 1)){
-      perror("Error writing to pipe");
-      exit(EPIPE); /* Broken pipe */
-    }
-    sem_post(parameters->process);
+    run->dataInFile = result.dataInFile;
+    run->substringFound = result.substringFound;
+    run->rowsRead = result.headerRows + result.contentRows;
+    run->bytesRead = result.bytesRead;
+    run->convertedRows = result.convertedRows;
+    run->skippedRows = result.skippedRows;
+    run->outputBytes = result.outputBytes;
+    run->parallelRounds = result.rounds;
+    return;
   }
 
-  if(close(parameters->pipePrt[1]) != 0){
-    fprintf(stderr, "Error closing pipe: %s\n", strerror(errno));
+  // In process mode the run is kept in shared memory, where the stage processes update its counters, and copied back at the end
+  PipelineRun * callerRun = run;
+  if(options->useProcesses){
+    run = mapSharedMemory("run", sizeof(PipelineRun));
+    *run = *callerRun;
   }
-  if(fclose(readFile) == EOF){
-    fprintf(stderr, "Error closing input file: %s\n", strerror(errno));
+
+  /* Initialisaton*/
+  int pipeFileDescriptor[2];              //File descriptor for creating a pipe
+  DataRow sharedBuffer = {Header, NULL, 0, 0, false}; //Create shared memory buffer
+  Handoff sem_read, sem_process, sem_write; //Create semaphores
+  MappedInput mappedInput = {NULL, 0};    //Only used in mmap mode
+  MappedInput * mapping = options->useMmap ? &mappedInput : NULL;
+  BatchLimits * batchLimits = &run->batchLimits; //Rows handed over per ring slot
+  bool useStages = options->queueDepth > 0;      //The stages of the plan run over rings instead of the three threads in lockstep
+
+  if(useStages){
+    setBatchLimits(options, batchLimits);
   }
 
-  //Send a cancellation request to all other threads
-  //This means that the threads will perform their cleanup tasks and then return
-  if(pthread_cancel(readerThreadID) != 0){
-    perror("Error cancelling Reader thread");
+  // Instantiate thread paramater structures for each thread
+  SemaphoreParams semParams = {&sem_read, &sem_process, &sem_write, options->handoffMode};
+  RowPool * rowPool = options->useMmap ? NULL : createRowPool(); //Rows of any length, passed between the threads by pointer
+  ReadParams readParams = {run->inputFileName, pipeFileDescriptor, &sem_read, &sem_process, mapping, batchLimits, run, rowPool, options->useUring};
+  PlySchema * schema = NULL;              //Only parse the content into typed columns when a stage needs it
+  initPlySchema(&run->schema);
+  initVertexStats(&run->stats, 0);
+  if(options->outputFormat == BinaryOutput){
+    schema = &run->schema;
   }
-  if(pthread_cancel(processorThreadID) != 0){
-    perror("Error cancelling Processor thread");
+  ProcessorParams processorParams = {run->substring, pipeFileDescriptor, &sharedBuffer, &sem_process, &sem_write, mapping, batchLimits, run,
+    schema != NULL || options->vertexStats ? &run->schema : NULL, schema != NULL, options->vertexStats ? &run->stats : NULL,
+    options->patterns.count > 0 ? &options->patterns : NULL, options->where.stepCount > 0 ? &options->where : NULL};
+  WriterParams writerParams = {run->outputFileName, &sharedBuffer, &sem_write, &sem_read, mapping, batchLimits, run, options->outputFormat, schema, rowPool, options->useUring,
+    options->flushBytes, options->flushLatency};
+  StageParams stageParams = {&readParams, &processorParams, &writerParams};
+  StagePipeline stages = {&options->stagePlan, &stageParams, options->queueDepth, batchLimits->slotSize, copyBatch, measureBatch, &options->placement,
+    options->handoffMode, options->lockMemory};
+  ProcessWatcherParams watcherParams = {&stages, run, true};
+  pthread_t processWatcher;
+  pthread_t lockstepThreads[3];           //The Reader, Processor and Writer threads
+
+  initialiseSempahores(&semParams);
+  if(options->useMmap){
+    mapInputFile(run->inputFileName, &mappedInput);
   }
-  if(pthread_cancel(writerThreadID) != 0){
-    perror("Error cancelling Writer thread");
+
+  // Create pipe between Processor and Writer thread, the stages hand everything over through their rings
+  if (!useStages && pipe(pipeFileDescriptor) < 0){
+    perror("Pipe creation error");
+    exit(EXIT_FAILURE);
   }
-  pthread_exit(0);
-}
 
-void *Processor(void *params)
-{
-  ProcessorParams * parameters = params;
-  enum fileRegion region = Header;
+  double startTime = currentTime();
+  atomic_init(&run->contentBatch, run->substringFound ? 0 : SIZE_MAX);
+  initPipelineMetrics(&run->metrics, run->inputFileName);
+  if(useStages){
+    for(unsigned g = 0; g < options->stagePlan.groupCount; g++){
+      stages.metrics[g] = addStageMetrics(&run->metrics, options->stagePlan.groups[g].name);
+    }
+  } else {
+    readParams.metrics = addStageMetrics(&run->metrics, "Reader");
+    processorParams.metrics = addStageMetrics(&run->metrics, "Processor");
+    writerParams.metrics = addStageMetrics(&run->metrics, "Writer");
+  }
+  registerPipelineMetrics(&run->metrics);
 
-  while (!safelyTerminate && !sem_wait(parameters->process)){
-    char readBuffer[BUFFER_SIZE];
+  // Signals would interrupt the semaphore waits of the threads, so only the thread that created them takes them
+  // The Reader unblocks the wake signal itself, which is sent to it alone
+  sigset_t pipelineSignals, previousSignals;
+  sigemptyset(&pipelineSignals);
+  sigaddset(&pipelineSignals, SIGUSR1);
+  sigaddset(&pipelineSignals, SIGUSR2);
+  sigaddset(&pipelineSignals, SIGINT);
+  pthread_sigmask(SIG_BLOCK, &pipelineSignals, &previousSignals);
 
-    // Read pipe and copy to readBuffer
-    if ((read(parameters->pipePrt[0], &readBuffer, BUFFER_SIZE) < 1)){
-      perror("Error reading from the pipe");
-      exit(EPIPE); /* Broken pipe */
+  if(useStages && options->useProcesses){
+    // Every group of the plan runs in a process of its own, forked with the signals of the pipeline still blocked
+    startStageProcesses(&stages);
+    run->processIDs = stages.processes;
+    run->processCount = stages.processCount;
+    if(pthread_create(&processWatcher, NULL, StageProcessWatcher, &watcherParams) != 0){
+      perror("Error creating the stage process watcher thread");
+      stopStageProcesses(&stages);
+      exit(EXIT_FAILURE);
+    }
+  } else if(useStages){
+    // Every group of the plan runs on its own workers, the read stage ends the stream like the Reader
+    startStagePipeline(&stages);
+    run->threadIDs = stages.threads;
+    run->threadCount = stages.threadCount;
+  } else {
+    // Create the Writer, Processor and Reader thread, each on its CPU and with its priority when they were given
+    // The Reader is created last, it ends the stream once the input is exhausted or the user interrupts
+    if ((errno = createPlacedThread(&options->placement, 2, &lockstepThreads[2], Writer, &writerParams)) != 0){
+      perror("Error creating Writer thread");
+      exit(EXIT_FAILURE);
+    }
+    if ((errno = createPlacedThread(&options->placement, 1, &lockstepThreads[1], Processor, &processorParams)) != 0){
+      perror("Error creating Processor thread");
+      exit(EXIT_FAILURE);
+    }
+    if ((errno = createPlacedThread(&options->placement, 0, &lockstepThreads[0], Reader, &readParams)) != 0){
+      perror("Error creating Reader thread");
+      exit(EXIT_FAILURE);
     }
+    run->threadIDs = lockstepThreads;
+    run->threadCount = 3;
+  }
+  pthread_sigmask(SIG_SETMASK, &previousSignals, NULL);
 
-    // Instantiate DataRow object with the current value of region
-    struct DataRow dataRow = {region};
+  // Wait on threads to finish
+  awaitPipeline(run);
+  if(useStages && options->useProcesses){
+    if(pthread_join(processWatcher, NULL) != 0){
+      perror("Error joining the stage process watcher thread");
+    }
+    if(!watcherParams.succeeded){
+      fprintf(stderr, "The output is incomplete, a stage process failed\n");
+      exit(EXIT_FAILURE);
+    }
+  } else if(useStages){
+    joinStagePipeline(&stages);
+  } else {
+    if(pthread_join(lockstepThreads[0], NULL) != 0){
+      perror("Error joining Reader thread");
+    }
+    if(pthread_join(lockstepThreads[1], NULL) != 0){
+      perror("Error joining Processor thread");
+    }
+    if(pthread_join(lockstepThreads[2], NULL) != 0){
+      perror("Error joining Writer thread");
+    }
+  }
 
-    //Copy data from read buffer to DataRow object
-    strncpy(dataRow.content, readBuffer, sizeof(dataRow.content) - 1);
+  run->elapsedTime = currentTime() - startTime;
+  if(run->interrupted){
+    run->shutdownLatency = currentTime() - interruptTime;
+  }
+  unregisterPipelineMetrics(&run->metrics);
+  if(mappedInput.data != NULL && munmap((void *) mappedInput.data, mappedInput.size) != 0){
+    fprintf(stderr, "Error unmapping input file: %s\n", strerror(errno));
+  }
+  if(rowPool != NULL){
+    run->pooledRows = rowPool->created;
+    run->longestRow = rowPool->largestRow;
+    destroyRowPool(rowPool);
+  }
+  if(useStages){
+    for(unsigned g = 0; g + 1 < options->stagePlan.groupCount; g++){
+      stageLinkStalls(&stages, g, &run->fullStalls[g], &run->emptyStalls[g]);
+    }
+    stageHandoffStats(&stages, &run->handoffs);
+    destroyStagePipeline(&stages);
+  } else {
+    addHandoffStats(&run->handoffs, &sem_read);
+    addHandoffStats(&run->handoffs, &sem_process);
+    addHandoffStats(&run->handoffs, &sem_write);
+  }
+  destroyHandoff(&sem_read);
+  destroyHandoff(&sem_process);
+  destroyHandoff(&sem_write);
+  run->threadIDs = NULL;
+  run->threadCount = 0;
+  run->processIDs = NULL;
+  run->processCount = 0;
+  if(run != callerRun){
+    *callerRun = *run;
+    unmapSharedMemory(run, sizeof(PipelineRun));
+  }
+}
 
-    // Copy DataRow object to shared memory that exists between processor and writer threads
-    *(parameters->sharedBuffer) = dataRow;
+void addInputFiles(const char * path, char *** inputFileNames, size_t * inputCount)
+{
+  struct stat fileStatus;
+  struct dirent * entry;
+  DIR * directory;
+  size_t firstEntry = *inputCount;
 
-    /* Check contains the substring. If it does, we update the region  */
-    if (region == Header && strstr(readBuffer, parameters->substring) != NULL){
-      region = Content;
-      substringFound = true;
-    }
+  if (stat(path, &fileStatus) != 0){
+    fprintf(stderr, "Error: Could not find or open %s: %s\n", path, strerror(errno));
+    exit(ENOENT); /* No such file or directory */
+  }
 
-    sem_post(parameters->write);
+  if (!S_ISDIR(fileStatus.st_mode)){
+    *inputFileNames = realloc(*inputFileNames, (*inputCount + 1) * sizeof(char *));
+    (*inputFileNames)[(*inputCount)++] = strdup(path);
+    return;
   }
 
-  if(close(parameters->pipePrt[0]) != 0){
-    fprintf(stderr, "Error closing pipe: %s\n", strerror(errno));
+  // Only the regular files directly within the directory are inputs, hidden files are skipped
+  if ((directory = opendir(path)) == NULL){
+    fprintf(stderr, "Error: Could not open directory %s: %s\n", path, strerror(errno));
+    exit(EXIT_FAILURE);
   }
-  pthread_exit(NULL);
+  while ((entry = readdir(directory)) != NULL){
+    char * entryPath;
+    if (entry->d_name[0] == '.' || asprintf(&entryPath, "%s/%s", path, entry->d_name) < 0){
+      continue;
+    }
+    if (stat(entryPath, &fileStatus) != 0 || !S_ISREG(fileStatus.st_mode)){
+      free(entryPath);
+      continue;
+    }
+    *inputFileNames = realloc(*inputFileNames, (*inputCount + 1) * sizeof(char *));
+    (*inputFileNames)[(*inputCount)++] = entryPath;
+  }
+  closedir(directory);
+
+  // Directory order is arbitrary, sort the entries so the summary is stable between runs
+  qsort(*inputFileNames + firstEntry, *inputCount - firstEntry, sizeof(char *), compareFileNames);
 }
 
-void *Writer(void * params)
+int compareFileNames(const void * first, const void * second)
 {
-  WriterParams * parameters = params;
-  FILE *writeFile;
+  return strcmp(*(char * const *) first, *(char * const *) second);
+}
 
-  // Create or open the output file we want to output the content to
-  if ((writeFile = fopen(parameters->outputFileName, "w")) == NULL){
-    printf("Error! opening creating or opening existing output file\n");
+bool runMultiFile(ProgramOptions * options, char ** inputFileNames, size_t inputCount, char * substring)
+{
+  PipelineRun * runs = calloc(inputCount, sizeof(PipelineRun));
+  struct stat inputStatus, outputStatus;
+
+  if (mkdir(options->outputDirectory, 0777) != 0 && errno != EEXIST){
+    fprintf(stderr, "Error creating output directory %s: %s\n", options->outputDirectory, strerror(errno));
     exit(EXIT_FAILURE);
   }
 
-  while (!safelyTerminate && !sem_wait(parameters->write)){
-    /* Writes rows in the Content region to the output file */
-    if (parameters->sharedBuffer->region == Content){
-      fprintf(writeFile, "%s", parameters->sharedBuffer->content);
+  // Each output is named after its input, and must never be the input itself
+  for (size_t i = 0; i < inputCount; i++){
+    const char * baseName = strrchr(inputFileNames[i], '/') != NULL ? strrchr(inputFileNames[i], '/') + 1 : inputFileNames[i];
+    runs[i].inputFileName = inputFileNames[i];
+    runs[i].substring = substring;
+    if (asprintf(&runs[i].outputFileName, "%s/%s", options->outputDirectory, baseName) < 0){
+      perror("Error allocating output file name");
+      exit(EXIT_FAILURE);
     }
-    sem_post(parameters->read);
+    if (stat(runs[i].inputFileName, &inputStatus) == 0 && stat(runs[i].outputFileName, &outputStatus) == 0
+        && inputStatus.st_dev == outputStatus.st_dev && inputStatus.st_ino == outputStatus.st_ino){
+      fprintf(stderr, "Error: %s would overwrite its own input, choose another output directory\n", runs[i].outputFileName);
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  unsigned workerCount = options->jobs > 0 ? options->jobs : (unsigned) sysconf(_SC_NPROCESSORS_ONLN);
+  if (workerCount > inputCount){
+    workerCount = inputCount;
+  }
+  pthread_t workerThreadIDs[workerCount];
+  WorkerPoolParams poolParams = {options, runs, inputCount};
+  atomic_init(&poolParams.nextRun, 0);
+
+  double startTime = currentTime();
+  for (unsigned i = 0; i < workerCount; i++){
+    if (pthread_create(&workerThreadIDs[i], NULL, FileWorker, &poolParams) != 0){
+      perror("Error creating worker thread");
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (unsigned i = 0; i < workerCount; i++){
+    if (pthread_join(workerThreadIDs[i], NULL) != 0){
+      perror("Error joining worker thread");
+    }
+  }
+  double elapsedTime = currentTime() - startTime;
+
+  // Report the status of every file, then the throughput of the whole pool
+  size_t rowsRead = 0, bytesRead = 0, saved = 0, failed = 0;
+  for (size_t i = 0; i < inputCount; i++){
+    if (runs[i].elapsedTime == 0 && !runs[i].dataInFile){
+      fprintf(stderr, "%s: skipped\n", runs[i].inputFileName);
+    } else if (runs[i].outputFailed){
+      fprintf(stderr, "%s: %s is incomplete, it could not be written in full\n", runs[i].inputFileName, runs[i].outputFileName);
+      failed++;
+    } else if (!runs[i].dataInFile){
+      fprintf(stderr, "%s: empty\n", runs[i].inputFileName);
+    } else if (!runs[i].substringFound){
+      fprintf(stderr, "%s: substring '%s' not found\n", runs[i].inputFileName, substring);
+    } else {
+      fprintf(stderr, "%s: content saved to %s\n", runs[i].inputFileName, runs[i].outputFileName);
+      if(options->vertexStats){
+        printVertexStats(&runs[i]);
+      }
+      saved++;
+    }
+    rowsRead += runs[i].rowsRead;
+    bytesRead += runs[i].bytesRead;
+    free(runs[i].outputFileName);
+  }
+  if (elapsedTime > 0){
+    fprintf(stderr, "Saved the content region of %zu of %zu files with %u workers in %.3f s: %.2f MB/s, %.0f rows/s\n",
+      saved, inputCount, workerCount, elapsedTime, bytesRead / 1e6 / elapsedTime, rowsRead / elapsedTime);
+  }
+  free(runs);
+  return failed == 0;
+}
+
+void *FileWorker(void * params)
+{
+  WorkerPoolParams * parameters = params;
+  size_t next;
+
+  // Stop taking new files once the user has interrupted the program
+  while (!safelyTerminate && (next = atomic_fetch_add(&parameters->nextRun, 1)) < parameters->runCount){
+    runPipeline(parameters->options, &parameters->runs[next]);
+    freePlySchema(&parameters->runs[next].schema);
+  }
+  pthread_exit(NULL);
+}
+
+void printSummary(PipelineRun * run)
+{
+  // If the program was not terminated by the user
+  // Print a final message to indicate how the program performed
+  if(run->outputFailed){
+    fprintf(stderr, "The output %s is incomplete, it could not be written in full\n", run->outputFileName);
+  } else if(!safelyTerminate){
+    if(run->dataInFile){
+      if(run->substringFound){
+        fprintf(stderr, "The content region of %s has been saved to %s\n", run->inputFileName, run->outputFileName);
+      } else {
+        fprintf(stderr, "The substring '%s' was not found in %s\n", run->substring, run->inputFileName);
+      }
+    } else {
+      fprintf(stderr, "%s was empty\n", run->inputFileName);
+    }
+  }
+}
+
+void printVertexStats(PipelineRun * run)
+{
+  VertexStats * stats = &run->stats;
+
+  if(stats->count == 0){
+    fprintf(stderr, "No vertices were found in the content region of %s\n", run->inputFileName);
+  } else {
+    fprintf(stderr, "%zu vertices, min (%g, %g, %g), max (%g, %g, %g), mean (%g, %g, %g)\n", stats->count,
+      stats->min[0], stats->min[1], stats->min[2], stats->max[0], stats->max[1], stats->max[2],
+      stats->sum[0] / stats->count, stats->sum[1] / stats->count, stats->sum[2] / stats->count);
+  }
+  if(run->elapsedTime > 0){
+    fprintf(stderr, "Parsed the coordinates of %zu content rows at %.0f rows/s\n", stats->rowsParsed, stats->rowsParsed / run->elapsedTime);
+  }
+}
+
+void printRunStatistics(ProgramOptions * options, PipelineRun * run)
+{
+  if(run->elapsedTime <= 0){
+    return;
+  }
+
+  if(options->bulkCopy){
+    fprintf(stderr, "Scanned %zu header rows and copied %.2f MB of content with %s in %.3f s: %.2f MB/s\n",
+      run->rowsRead, run->bytesRead / 1e6, run->copyMethod, run->elapsedTime,
+      run->bytesRead / 1e6 / run->elapsedTime);
+    return;
+  }
+
+  // Report the throughput of the selected reader path
+  fprintf(stderr, "Read %zu rows (%.2f MB) in %.3f s using the %s reader: %.2f MB/s, %.0f rows/s\n",
+    run->rowsRead, run->bytesRead / 1e6, run->elapsedTime,
+    options->useMmap || options->parallelThreads > 0 ? "mmap" : run->uringReads ? "io_uring" : "stdio",
+    run->bytesRead / 1e6 / run->elapsedTime, run->rowsRead / run->elapsedTime);
+  if(run->uringWrites){
+    fprintf(stderr, "The output file was written through io_uring\n");
+  }
+  if(run->interrupted){
+    fprintf(stderr, "Shut down %.1f ms after the interrupt, %s\n", run->shutdownLatency * 1e3,
+      run->shutdownCancelled ? "cancelling the threads that had not drained in time" : "after the rows in flight were written");
+  }
+  if(run->outputFlushes > 0){
+    fprintf(stderr, "Wrote the output in %zu writes of %.1f KB on average, %zu of them to keep within the latency limit\n",
+      run->outputFlushes, run->outputBytes / 1024.0 / run->outputFlushes, run->latencyFlushes);
+  }
+  if(run->pooledRows > 0){
+    fprintf(stderr, "Rows were passed between the threads in %zu pooled buffers, the longest was %zu bytes\n", run->pooledRows, run->longestRow);
+  }
+
+  printThreadPlacement(stderr, &options->placement);
+  if(options->lockMemory){
+    fprintf(stderr, "The memory of the process was locked, so no page was faulted in from the disk while the rows were handled\n");
+  }
+  printPipelineMetrics(stderr, &run->metrics);
+
+  // Spinning shows up as CPU time the threads spent without handling a row. The stage processes have exited by now
+  struct rusage usage, children;
+  printHandoffStats(stderr, options->handoffMode, &run->handoffs);
+  if(getrusage(RUSAGE_SELF, &usage) == 0 && getrusage(RUSAGE_CHILDREN, &children) == 0){
+    double cpuTime = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6
+      + children.ru_utime.tv_sec + children.ru_utime.tv_usec / 1e6 + children.ru_stime.tv_sec + children.ru_stime.tv_usec / 1e6;
+    fprintf(stderr, "Used %.3f s of CPU time, %.0f%% of the elapsed time, with %ld voluntary context switches\n", cpuTime,
+      100 * cpuTime / run->elapsedTime, usage.ru_nvcsw + children.ru_nvcsw);
+  }
+
+  if(options->patterns.kindsPresent & (PatternDrop | PatternSelect)){
+    fprintf(stderr, "Left out %zu content rows with the row filters, matching %zu patterns with an automaton of %zu states\n",
+      run->droppedRows, options->patterns.count, options->patterns.nodeCount);
+  }
+
+  if(options->where.stepCount > 0){
+    fprintf(stderr, "Kept %zu of %zu content rows matching --where %s, compared with %s in batches of up to %zu rows\n",
+      run->whereKept, run->whereTested, options->where.text, whereCompareName(), run->batchLimits.maxRows);
+  }
+
+  if(options->outputFormat == BinaryOutput){
+    fprintf(stderr, "Converted %zu rows to a binary PLY file of %.2f MB (%.1f%% of the input), skipped %zu content rows that could not be converted\n",
+      run->convertedRows, run->outputBytes / 1e6, run->bytesRead > 0 ? 100.0 * run->outputBytes / run->bytesRead : 0, run->skippedRows);
+  }
+
+  if(options->parallelThreads > 0){
+    fprintf(stderr, "Processed the content region in %u rounds of up to %u newline aligned chunks, one thread per chunk\n",
+      run->parallelRounds, options->parallelThreads);
+  }
+
+  // Report the PLY schema the typed columns were parsed with, the parallel mode converts rows without keeping columns
+  if(run->schema.columnsReady || (options->parallelThreads > 0 && options->outputFormat == BinaryOutput && plySchemaIsConvertible(&run->schema))){
+    fprintf(stderr, "Parsed the PLY header into %zu elements:", run->schema.elementCount);
+    for(size_t e = 0; e < run->schema.elementCount; e++){
+      fprintf(stderr, " %s %zu of %zu rows (%zu properties)%s", run->schema.elements[e].name, run->schema.elements[e].rowCount,
+        run->schema.elements[e].declaredCount, run->schema.elements[e].propertyCount, e + 1 < run->schema.elementCount ? "," : "\n");
+    }
+    fprintf(stderr, "%zu content rows did not match their element, %zu rows came after the last declared row\n",
+      run->schema.malformedRows, run->schema.extraRows);
+  }
+
+  // Report how often the stages on either side of each ring had to wait on each other
+  if(options->queueDepth > 0){
+    const StagePlan * plan = &options->stagePlan;
+    fprintf(stderr, "Batches of up to %zu rows or %zu bytes\n", run->batchLimits.maxRows, run->batchLimits.maxBytes);
+    fprintf(stderr, "Queue depth %u:", options->queueDepth);
+    for(unsigned g = 0; g + 1 < plan->groupCount; g++){
+      fprintf(stderr, " %s stalled %zu times on a full ring and %s %zu times on an empty ring%s", plan->groups[g].name, run->fullStalls[g],
+        plan->groups[g + 1].name, run->emptyStalls[g], g + 2 < plan->groupCount ? "," : "");
+    }
+    fprintf(stderr, "%s\n", plan->groupCount == 1 ? " every stage runs on one thread, without a ring" : "");
+    if(options->useProcesses){
+      fprintf(stderr, "Each group of stages ran in a process of its own, the rings between them in shared memory\n");
+    }
+  }
+}
+
+void printUsage()
+{
+  fprintf(stderr, "USAGE:\n");
+  fprintf(stderr, "./main [options]\n");
+  fprintf(stderr, "./main [options] <input file>\n");
+  fprintf(stderr, "./main [options] <input file> <output file>\n");
+  fprintf(stderr, "./main [options] <input file> <output file> <substring>\n");
+  fprintf(stderr, "A file name of - reads stdin or writes stdout, status messages always go to stderr\n");
+  fprintf(stderr, "OPTIONS:\n");
+  fprintf(stderr, "--mmap                map the input file and pass row views between threads\n");
+  fprintf(stderr, "--queue-depth <N>     use rings of N slots between the threads instead of a single shared row\n");
+  fprintf(stderr, "--batch-rows <N>      hand over up to N rows per ring slot\n");
+  fprintf(stderr, "--batch-bytes <N>     hand over up to N bytes of rows per ring slot\n");
+  fprintf(stderr, "--stages <plan>       run the stages of plan over the rings, e.g. read,strip,filter*4,write or read,scan+filter%%4,strip,write\n");
+  fprintf(stderr, "--processes           run each group of stages in a process of its own over shared memory rings\n");
+  fprintf(stderr, "--processors <N>      run the Processor on N workers taking batches in any order, written back in order\n");
+  fprintf(stderr, "--cpus <list>         pin the pipeline threads to these CPUs in turn, e.g. 2,4-6\n");
+  fprintf(stderr, "--sched <fifo|rr>     run the pipeline threads under a real-time scheduling policy\n");
+  fprintf(stderr, "--priorities <list>   real-time priority of each pipeline thread in turn\n");
+  fprintf(stderr, "--mlock               lock the memory of the process so no row waits on a page fault\n");
+  fprintf(stderr, "--handoff <mode>      wait for the other threads in sem_wait (semaphore) or spin then park (spin)\n");
+  fprintf(stderr, "--io-uring            read and write the files through io_uring when the kernel allows it\n");
+  fprintf(stderr, "--flush-bytes <N>     write the gathered output rows once N bytes are waiting\n");
+  fprintf(stderr, "--flush-latency <ms>  write the gathered output rows once the oldest has waited this long\n");
+  fprintf(stderr, "--metrics-file <path>  append the stage metrics reports requested with SIGUSR1 to path\n");
+  fprintf(stderr, "--terminator <text>   also end the header at a row containing text\n");
+  fprintf(stderr, "--drop <text>         leave out content rows containing text\n");
+  fprintf(stderr, "--select <text>       only keep content rows containing one of the --select texts\n");
+  fprintf(stderr, "--patterns <file>     read \"terminator\", \"drop\" or \"select\" patterns from a file, one per line\n");
+  fprintf(stderr, "--where <expr>        only keep content rows whose x, y and z match expr, e.g. \"z > 16.0 && x < -0.9\"\n");
+  fprintf(stderr, "--bulk-copy           scan the header only and let the kernel copy the content region\n");
+  fprintf(stderr, "--parallel <N>        split the content region into N newline aligned chunks processed on N threads\n");
+  fprintf(stderr, "--resume              continue an interrupted run from the checkpoint saved next to its output file\n");
+  fprintf(stderr, "--stats               print the vertex count, bounding box and centroid of the content region\n");
+  fprintf(stderr, "--substring <text>    search for text instead of the third file name argument\n");
+  fprintf(stderr, "--output-format <F>   ascii (default) or binary little endian PLY vertices\n");
+  fprintf(stderr, "./main [options] --output-dir <directory> <input file or directory>...\n");
+  fprintf(stderr, "--jobs <N>            process N input files at the same time in multi-file mode\n");
+  exit(EXIT_FAILURE);
+}
+
+void mapInputFile(char * inputFileName, MappedInput * mappedInput)
+{
+  struct stat fileStatus;
+  int fileDescriptor;
+
+  if (isStandardStream(inputFileName)){
+    fileDescriptor = dup(STDIN_FILENO);
+  } else {
+    fileDescriptor = open(inputFileName, O_RDONLY);
+  }
+  if (fileDescriptor < 0){
+    fprintf(stderr,
+      "Error: Could not find or open %s. Ensure that a file named %s exists within the same directory.\n",
+      inputFileName, inputFileName
+    );
+    fprintf(stderr, "Exiting program...\n");
+    exit(ENOENT); /* No such file or directory */
+  }
+
+  if (fstat(fileDescriptor, &fileStatus) != 0){
+    perror("Error reading input file size");
+    exit(EXIT_FAILURE);
+  }
+
+  if (!S_ISREG(fileStatus.st_mode)){
+    fprintf(stderr, "--mmap and --processes need %s to be a regular file, read pipes without them\n", isStandardStream(inputFileName) ? "stdin" : inputFileName);
+    exit(EXIT_FAILURE);
+  }
+
+  // An empty file cannot be mapped, the Reader treats a NULL mapping as a file without data
+  mappedInput->size = fileStatus.st_size;
+  if (mappedInput->size > 0){
+    void * data = mmap(NULL, mappedInput->size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+    if (data == MAP_FAILED){
+      perror("Error mapping input file");
+      exit(EXIT_FAILURE);
+    }
+    madvise(data, mappedInput->size, MADV_SEQUENTIAL);
+    mappedInput->data = data;
+  }
+
+  // The mapping stays valid after the file descriptor is closed
+  if (close(fileDescriptor) != 0){
+    fprintf(stderr, "Error closing input file: %s\n", strerror(errno));
+  }
+}
+
+void setBatchLimits(ProgramOptions * options, BatchLimits * limits)
+{
+  // Without a limit of its own, each option is sized so that the other one ends the batch
+  limits->maxRows = options->batchRows;
+  limits->maxBytes = options->batchBytes;
+  if(limits->maxRows == 0 && limits->maxBytes == 0){
+    limits->maxRows = 1;
+  }
+  if(limits->maxBytes == 0){
+    limits->maxBytes = limits->maxRows * BUFFER_SIZE;
+  }
+  if(limits->maxRows == 0){
+    limits->maxRows = limits->maxBytes / MIN_BATCH_ROW_LENGTH + 1;
+  }
+
+  // Copied rows are read straight into the slot, which needs room for one more full row past the byte budget
+  size_t dataSize = options->useMmap ? 0 : limits->maxBytes + BUFFER_SIZE;
+  limits->slotSize = sizeof(RowBatch) + limits->maxRows * sizeof(RowSpan) + dataSize;
+  limits->slotSize = (limits->slotSize + sizeof(size_t) - 1) / sizeof(size_t) * sizeof(size_t);
+}
+
+RowSpan * batchRows(RowBatch * batch)
+{
+  return (RowSpan *) (batch + 1);
+}
+
+char * batchData(RowBatch * batch, BatchLimits * limits)
+{
+  return (char *) (batchRows(batch) + limits->maxRows);
+}
+
+char * spanText(RowBatch * batch, BatchLimits * limits, MappedInput * mappedInput, RowSpan * span)
+{
+  if (span->pooled != NULL){
+    return span->pooled->data;
+  }
+  if (mappedInput != NULL){
+    return (char *) mappedInput->data + span->offset;
+  }
+  return batchData(batch, limits) + span->offset;
+}
+
+bool isStandardStream(const char * fileName)
+{
+  return strcmp(fileName, "-") == 0;
+}
+
+FILE * openStream(const char * fileName, const char * mode, bool useUring, bool * usedUring)
+{
+  if (isStandardStream(fileName)){
+    return mode[0] == 'r' ? stdin : stdout;
+  }
+  if (useUring){
+    return openUringFile(fileName, mode, usedUring);
+  }
+  return fopen(fileName, mode);
+}
+
+size_t batchBytes(RowBatch * batch)
+{
+  RowSpan * rows = batchRows(batch);
+  size_t bytes = 0;
+  for (size_t i = 0; i < batch->rowCount; i++){
+    bytes += rows[i].length;
+  }
+  return bytes;
+}
+
+double currentTime()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+void initialiseSempahores(void * params)
+{
+  SemaphoreParams * parameters = params;
+
+  // Initialise Sempahores
+  if (initHandoff(parameters->sem_read, parameters->mode, 1, false)){
+    perror("Error initializing read semaphore.");
+    exit(EXIT_FAILURE);
+  }
+
+  if (initHandoff(parameters->sem_process, parameters->mode, 0, false)){
+    perror("Error initializing process semaphore.");
+    exit(EXIT_FAILURE);
+  }
+
+  if (initHandoff(parameters->sem_write, parameters->mode, 0, false)){
+    perror("Error initializing write semaphore.");
+    exit(EXIT_FAILURE);
+  }
+  return;
+}
+
+void handleInterupt(int signalNumber){
+  // Termine the program the Ctrl+C interrupt is raised more than once
+  if(safelyTerminate){
+    exit(EXIT_FAILURE);
+  } else {
+    fprintf(stderr, "Interrupt detected: safely exiting program...\n");
+    interruptTime = currentTime();
+    safelyTerminate = true;
+    sem_post(&interruptPosted);
+  }
+}
+
+void handleWake(int signalNumber){
+  safelyTerminate = true;
+}
+
+void *InterruptWatcher(void * params)
+{
+  while (true){
+    while (sem_wait(&interruptPosted) != 0 && errno == EINTR){ }
+    pthread_mutex_lock(&shutdownLock);
+    pthread_cond_broadcast(&shutdownChanged);
+    pthread_mutex_unlock(&shutdownLock);
+  }
+  return NULL;
+}
+
+void awaitPipeline(PipelineRun * run)
+{
+  pthread_mutex_lock(&shutdownLock);
+  while (!run->outputFinished && !safelyTerminate){
+    pthread_cond_wait(&shutdownChanged, &shutdownLock);
+  }
+
+  // The Reader stops at the interrupt, then the rows it already read drain through the Processor and Writer.
+  // It may be blocked reading a pipe, or about to block, so it is signalled again until the output is finished
+  run->interrupted = run->interrupted || !run->outputFinished;
+  double deadline = currentTime() + SHUTDOWN_TIMEOUT;
+  while (!run->outputFinished && currentTime() < deadline){
+    if (run->processCount > 0){
+      kill(run->processIDs[0], SIGUSR2);
+    } else {
+      pthread_kill(run->threadIDs[0], SIGUSR2);
+    }
+
+    struct timespec wakeTime;
+    clock_gettime(CLOCK_REALTIME, &wakeTime);
+    long nanoseconds = wakeTime.tv_nsec + (long)(SHUTDOWN_WAKE_INTERVAL * 1e9);
+    wakeTime.tv_sec += nanoseconds / 1000000000;
+    wakeTime.tv_nsec = nanoseconds % 1000000000;
+    pthread_cond_timedwait(&shutdownChanged, &shutdownLock, &wakeTime);
+  }
+  bool finished = run->outputFinished;
+  pthread_mutex_unlock(&shutdownLock);
+
+  // A thread blocked on something outside the program, like a full output pipe, is cancelled as a last resort
+  // The Writer still finishes the output file in its cleanup handler. A stage process cancels its own threads on SIGTERM
+  if (!finished){
+    fprintf(stderr, "The %s did not drain within %.1f s of the interrupt, cancelling them\n",
+      run->processCount > 0 ? "stage processes" : "threads", SHUTDOWN_TIMEOUT);
+    run->shutdownCancelled = true;
+    for (unsigned p = 0; p < run->processCount; p++){
+      kill(run->processIDs[p], SIGTERM);
+    }
+    for (unsigned t = 0; t < run->threadCount; t++){
+      pthread_cancel(run->threadIDs[t]);
+    }
+  }
+}
+
+void *StageProcessWatcher(void * params)
+{
+  // The write stage marked the output finished in its own process, which cannot wake this one
+  ProcessWatcherParams * parameters = params;
+  parameters->succeeded = waitStageProcesses(parameters->stages);
+  markOutputFinished(parameters->run);
+  return NULL;
+}
+
+void markOutputFinished(PipelineRun * run)
+{
+  pthread_mutex_lock(&shutdownLock);
+  run->outputFinished = true;
+  run->interrupted = safelyTerminate; //The rows in flight may have drained before the main thread woke up
+  pthread_cond_broadcast(&shutdownChanged);
+  pthread_mutex_unlock(&shutdownLock);
+}
+
+void handleMetricsRequest(int signalNumber)
+{
+  requestMetricsReport();
+}
+
+bool readRow(ReadParams * parameters, FILE * readFile, size_t * nextOffset, char * buffer, size_t space, PooledRow ** pooled, size_t * offset, size_t * length)
+{
+  MappedInput * mappedInput = parameters->mappedInput;
+
+  *pooled = NULL;
+  if (mappedInput != NULL){
+    if (*nextOffset >= mappedInput->size){
+      return false;
+    }
+    const char * rowStart = mappedInput->data + *nextOffset;
+    const char * rowEnd = memchr(rowStart, '\n', mappedInput->size - *nextOffset);
+    *offset = *nextOffset;
+    *length = rowEnd != NULL ? (size_t) (rowEnd - rowStart) + 1 : mappedInput->size - *nextOffset;
+    *nextOffset += *length;
+  } else if (buffer == NULL){
+    // Without a slot to read into, the whole row is read into a row from the pool
+    *pooled = acquireRow(parameters->rowPool);
+    if (!readPooledRow(*pooled, readFile)){
+      releaseRow(parameters->rowPool, *pooled);
+      *pooled = NULL;
+      return false;
+    }
+    *length = (*pooled)->length;
+  } else {
+    if (fgets(buffer, space, readFile) == NULL){
+      return false;
+    }
+    *length = strlen(buffer);
+
+    // A row that fills the free space of the slot without ending is moved into a pooled row and read to its end
+    if (*length == space - 1 && buffer[*length - 1] != '\n'){
+      *pooled = acquireRow(parameters->rowPool);
+      setPooledRow(*pooled, buffer, *length);
+      continuePooledRow(*pooled, readFile);
+      *length = (*pooled)->length;
+    }
+  }
+
+  parameters->run->dataInFile = true;
+  parameters->run->rowsRead++;
+  parameters->run->bytesRead += *length;
+  return true;
+}
+
+void resumeFromCheckpoint(PipelineRun * run, const char * checkpointName)
+{
+  Checkpoint checkpoint;
+  if (!loadCheckpoint(checkpointName, &checkpoint)){
+    if (errno != ENOENT){
+      exit(EXIT_FAILURE);
+    }
+    fprintf(stderr, "No checkpoint at %s, starting from the beginning of %s\n", checkpointName, run->inputFileName);
+    return;
+  }
+
+  // Offsets into another file, or into this one after it changed, would cut rows in half
+  Checkpoint current = {NULL};
+  struct stat outputStatus;
+  if (strcmp(checkpoint.inputFileName, run->inputFileName) != 0 || !identifyCheckpointInput(&current, run->inputFileName)
+      || current.inputSize != checkpoint.inputSize || current.inputModified != checkpoint.inputModified){
+    fprintf(stderr, "%s was saved for %s as it was then, %s is another file or has changed since\n",
+      checkpointName, checkpoint.inputFileName, run->inputFileName);
+    exit(EXIT_FAILURE);
+  }
+  if (stat(run->outputFileName, &outputStatus) != 0 || (size_t) outputStatus.st_size < checkpoint.outputLength){
+    fprintf(stderr, "%s is shorter than the %zu bytes recorded in %s\n", run->outputFileName, checkpoint.outputLength, checkpointName);
+    exit(EXIT_FAILURE);
+  }
+
+  run->resumed = true;
+  run->resumeInput = checkpoint.inputOffset;
+  run->resumeOutput = checkpoint.outputLength;
+  run->inputWritten = checkpoint.inputOffset;
+  run->substringFound = checkpoint.contentRegion;
+  run->dataInFile = checkpoint.inputOffset > 0;
+  fprintf(stderr, "Resuming %s at byte %zu of %zu in the %s region, keeping the first %zu bytes of %s\n", run->inputFileName,
+    checkpoint.inputOffset, checkpoint.inputSize, checkpoint.contentRegion ? "content" : "header", checkpoint.outputLength, run->outputFileName);
+  freeCheckpoint(&checkpoint);
+}
+
+bool canResume(const ProgramOptions * options)
+{
+  // A resumed run only has the rest of the file, so the binary header, the statistics and the coordinates of --where could not be found
+  return !options->bulkCopy && options->parallelThreads == 0 && options->outputDirectory == NULL && !options->useUring
+    && options->outputFormat == AsciiOutput && !options->vertexStats && options->where.stepCount == 0;
+}
+
+void finishCheckpoint(ProgramOptions * options, PipelineRun * run, const char * checkpointName)
+{
+  if (isStandardStream(run->outputFileName)){
+    return;
+  }
+
+  // A cancelled Writer dropped rows it had not written, and a stream cannot be read again from an offset
+  bool resumable = canResume(options);
+  if (run->interrupted && resumable && !run->shutdownCancelled && !run->outputFailed && !isStandardStream(run->inputFileName)){
+    Checkpoint checkpoint = {run->inputFileName, 0, 0, run->inputWritten, run->substringFound, run->resumeOutput + run->outputBytes};
+
+    // The output reaches the disk first, so the checkpoint never claims rows that could still be lost
+    int outputFile = open(run->outputFileName, O_WRONLY);
+    bool synced = outputFile >= 0 && fsync(outputFile) == 0;
+    if (outputFile >= 0){
+      close(outputFile);
+    }
+    if (synced && identifyCheckpointInput(&checkpoint, run->inputFileName) && saveCheckpoint(checkpointName, &checkpoint)){
+      fprintf(stderr, "Saved a checkpoint at byte %zu of %s to %s, run again with --resume to continue\n",
+        checkpoint.inputOffset, run->inputFileName, checkpointName);
+    } else {
+      fprintf(stderr, "Error saving the checkpoint %s: %s\n", checkpointName, strerror(errno));
+    }
+    return;
+  }
+  if (run->interrupted && isStandardStream(run->inputFileName)){
+    fprintf(stderr, "No checkpoint was saved, input read from stdin cannot be checkpointed or resumed\n");
+  } else if (run->interrupted && !resumable){
+    fprintf(stderr, "No checkpoint was saved, " RESUME_LIMITS "\n");
+  } else if (run->interrupted){
+    fprintf(stderr, "No checkpoint was saved, the output of %s is not complete up to a known row\n", run->inputFileName);
+  }
+
+  // The output was written over or completed, so an older checkpoint no longer describes it
+  if (unlink(checkpointName) != 0 && errno != ENOENT){
+    fprintf(stderr, "Error removing the old checkpoint %s: %s\n", checkpointName, strerror(errno));
+  }
+}
+
+void preparePatterns(ProgramOptions * options, const char * substring)
+{
+  if (options->patterns.count == 0){
+    return;
+  }
+  addPattern(&options->patterns, substring, strlen(substring), PatternTerminator);
+  buildPatternSet(&options->patterns);
+}
+
+void tagRow(ProcessorParams * parameters, enum fileRegion * region, enum fileRegion * rowRegion, const char * content, size_t length)
+{
+  const PatternSet * patterns = parameters->patterns;
+  *rowRegion = *region;
+
+  /* Check contains the substring. If it does, we update the region  */
+  if (*region == Header){
+    bool found = patterns != NULL
+      ? matchPatterns(patterns, content, length, PatternTerminator) != 0
+      : findSubstring(content, length, parameters->substring, strlen(parameters->substring)) != NULL;
+    if (found){
+      *region = Content;
+      parameters->run->substringFound = true;
+    }
+  }
+}
+
+enum fileRegion filterRow(const PatternSet * patterns, const char * content, size_t length)
+{
+  // A row is left out when it holds a drop pattern, or when there are select patterns and it holds none of them
+  unsigned filters = patterns == NULL ? 0 : patterns->kindsPresent & (PatternDrop | PatternSelect);
+  if (filters != 0){
+    unsigned found = matchPatterns(patterns, content, length, filters);
+    if ((found & PatternDrop) || ((filters & PatternSelect) && !(found & PatternSelect))){
+      return Dropped;
+    }
+  }
+  return Content;
+}
+
+void tagBatch(ProcessorParams * parameters, enum fileRegion * region, RowBatch * batch)
+{
+  BatchLimits * limits = parameters->batchLimits;
+  RowSpan * rows = batchRows(batch);
+  size_t substringLength = strlen(parameters->substring);
+  size_t i = 0;
+
+  // The automaton already runs in a single pass over each row
+  if (parameters->patterns != NULL){
+    for (; i < batch->rowCount; i++){
+      tagRow(parameters, region, &rows[i].region, spanText(batch, limits, parameters->mappedInput, &rows[i]), rows[i].length);
+    }
+    return;
+  }
+
+  // The rows of a batch are contiguous, both in the slot and in the mapped input, except for a row held in the row pool.
+  // The rows up to the next pooled row are searched together, and a pooled row on its own
+  while (*region == Header && i < batch->rowCount){
+    size_t last = i;
+    while (rows[last].pooled == NULL && last + 1 < batch->rowCount && rows[last + 1].pooled == NULL){
+      last++;
+    }
+    const char * start = spanText(batch, limits, parameters->mappedInput, &rows[i]);
+    const char * end = spanText(batch, limits, parameters->mappedInput, &rows[last]) + rows[last].length;
+    const char * match = findSubstring(start, end - start, parameters->substring, substringLength);
+
+    // Every row up to the one holding the match stays in the Header region
+    while (i <= last && (match == NULL || spanText(batch, limits, parameters->mappedInput, &rows[i]) + rows[i].length <= match)){
+      rows[i++].region = Header;
+    }
+    if (match == NULL){
+      continue;
+    }
+
+    // A match that runs past the end of its row does not count, just like when rows are searched one at a time
+    rows[i].region = Header;
+    if (match + substringLength <= spanText(batch, limits, parameters->mappedInput, &rows[i]) + rows[i].length){
+      *region = Content;
+      parameters->run->substringFound = true;
+    }
+    i++;
+  }
+
+  for (; i < batch->rowCount; i++){
+    rows[i].region = *region;
+  }
+}
+
+void parseTaggedRow(ProcessorParams * parameters, enum fileRegion rowRegion, const char * content, size_t length)
+{
+  PlySchema * schema = parameters->schema;
+  if (schema == NULL || rowRegion == Dropped){
+    return;
+  }
+
+  if (rowRegion == Header){
+    parsePlyHeaderRow(schema, content, length);
+    return;
+  }
+
+  // The coordinates are parsed from the text, so statistics do not need the typed columns
+  if (parameters->stats != NULL){
+    addVertexStatsRow(parameters->stats, schema, content, length);
+  }
+  if (!parameters->typedColumns){
+    return;
+  }
+
+  // The columns are sized from the declared counts once, when the first content row arrives
+  if (!schema->columnsAttempted && !allocatePlyColumns(schema)){
+    fprintf(stderr, "The header of %s is not an ascii PLY header that can be parsed, content rows are not typed\n", parameters->run->inputFileName);
+  }
+  if (schema->columnsReady){
+    parsePlyContentRow(schema, content, length);
+  }
+}
+
+void writeBinaryHeader(WriterState * state)
+{
+  PlySchema * schema = state->parameters->schema;
+
+  // The Processor completes the schema before it hands over the first content row
+  state->useSchema = schema != NULL && schema->columnsReady;
+  if (state->useSchema){
+    state->countPositions = malloc(schema->elementCount * sizeof(long));
+    writeBinaryPlySchemaHeader(state->writeFile, schema, state->countPositions);
+  } else {
+    writeBinaryPlyHeader(state->writeFile, 0);
+  }
+  state->headerWritten = true;
+}
+
+void writeContentRow(WriterState * state, const char * content, size_t length, bool stable)
+{
+  WriterParams * parameters = state->parameters;
+
+  if (parameters->outputFormat == AsciiOutput){
+    appendOutput(&state->output, content, length, stable);
+    return;
+  }
+
+  if (!state->headerWritten){
+    writeBinaryHeader(state);
+  }
+
+  // With a schema the row was already parsed by the Processor, so only its typed values are written
+  bool converted;
+  if (state->useSchema){
+    converted = writeBinaryPlyRow(state->writeFile, parameters->schema, &state->cursor);
+  } else {
+    float vertex[3];
+    if ((converted = parseVertex(content, length, vertex))){
+      writeBinaryVertex(state->writeFile, vertex);
+    }
+  }
+
+  if (converted){
+    parameters->run->convertedRows++;
+  } else {
+    parameters->run->skippedRows++;
+  }
+}
+
+bool waitForWriterRow(WriterState * state)
+{
+  if (handoffTryWait(state->parameters->write)){
+    return true;
+  }
+  flushBeforeWaiting(&state->output);
+  return handoffWait(state->parameters->write) == 0;
+}
+
+void finishOutputFile(void * state)
+{
+  WriterState * writer = state;
+  WriterParams * parameters = writer->parameters;
+
+  // After a cancellation the output may be a pipe that nobody reads, so what is still waiting is dropped instead of blocking again
+  bool abandoned = parameters->run->shutdownCancelled;
+  if (abandoned){
+    discardOutput(&writer->output);
+  }
+
+  if (parameters->outputFormat == BinaryOutput){
+    if (!writer->headerWritten){
+      writeBinaryHeader(writer);
+    }
+
+    bool updated = writer->useSchema
+      ? updatePlyCounts(writer->writeFile, parameters->schema, writer->countPositions)
+      : updateBinaryPlyVertexCount(writer->writeFile, parameters->run->convertedRows);
+    if (!updated){
+      fprintf(stderr, "Error updating the element counts of %s: %s\n", parameters->outputFileName, strerror(errno));
+      parameters->run->outputFailed = true;
+    }
+    free(writer->countPositions);
+  }
+
+  // Ascii rows bypass the buffer of the stream, so the output buffer knows how much was written
+  if (!freeOutputBuffer(&writer->output)){
+    fprintf(stderr, "Error writing to %s: %s\n", parameters->outputFileName, strerror(errno));
+    parameters->run->outputFailed = true;
+  }
+  parameters->run->outputFlushes = writer->output.flushes;
+  parameters->run->latencyFlushes = writer->output.latencyFlushes;
+  parameters->run->outputBytes = parameters->outputFormat == AsciiOutput ? writer->output.bytesWritten : (size_t) ftell(writer->writeFile);
+
+  if (writer->streamFile != NULL && !abandoned && !copyStream(writer->writeFile, fileno(writer->streamFile))){
+    fprintf(stderr, "Error writing to %s: %s\n", parameters->outputFileName, strerror(errno));
+    parameters->run->outputFailed = true;
+  }
+  if(fclose(writer->writeFile) == EOF || (writer->streamFile != NULL && fclose(writer->streamFile) == EOF)){
+    fprintf(stderr, "Error closing output file: %s\n", strerror(errno));
+    parameters->run->outputFailed = true;
+  }
+}
+
+bool copyStream(FILE * source, int destination)
+{
+  char buffer[1 << 16];
+  size_t length;
+
+  // Written without stdio, so nothing is left buffered for exit to flush if the Writer is cancelled during the copy
+  rewind(source);
+  while ((length = fread(buffer, 1, sizeof(buffer), source)) > 0){
+    for (size_t done = 0; done < length; ){
+      ssize_t written = write(destination, buffer + done, length - done);
+      if (written < 0){
+        if (errno == EINTR){ continue; }
+        return false;
+      }
+      done += written;
+    }
+  }
+  return !ferror(source);
+}
+
+FILE * openInputFile(ReadParams * parameters)
+{
+  if (parameters->mappedInput != NULL){
+    fprintf(stderr, "Reading from %s (memory mapped)\n", parameters->inputFileName);
+    return NULL;
+  }
+
+  //Open the input file for reading, through io_uring when it was asked for
+  FILE * readFile = openStream(parameters->inputFileName, "r", parameters->useUring, &parameters->run->uringReads);
+  if (readFile == NULL){
+    fprintf(stderr,
+      "Error: Could not find or open %s. Ensure that a file named %s exists within the same directory.\n",
+      parameters->inputFileName, parameters->inputFileName
+    );
+    fprintf(stderr, "Exiting program...\n");
+    exit(ENOENT); /* No such file or directory */
+  }
+  if (parameters->run->resumed && fseeko(readFile, parameters->run->resumeInput, SEEK_SET) != 0){
+    fprintf(stderr, "Error seeking to the checkpoint in %s: %s\n", parameters->inputFileName, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  fprintf(stderr, "Reading from %s%s\n", parameters->inputFileName, parameters->run->uringReads ? " (io_uring)" : "");
+  return readFile;
+}
+
+void unblockWakeSignal()
+{
+  // Only the Reader blocks on something outside the pipeline, its input, so only it is woken after an interrupt
+  sigset_t wakeSignal;
+  sigemptyset(&wakeSignal);
+  sigaddset(&wakeSignal, SIGUSR2);
+  pthread_sigmask(SIG_UNBLOCK, &wakeSignal, NULL);
+}
+
+void openOutputFile(WriterParams * parameters, WriterState * state)
+{
+  FILE *writeFile;
+
+  // Create or open the output file we want to output the content to
+  // A resumed run keeps the output up to the checkpoint and drops anything written after it
+  if (parameters->run->resumed){
+    writeFile = fopen(parameters->outputFileName, "r+");
+    if (writeFile != NULL && (ftruncate(fileno(writeFile), parameters->run->resumeOutput) != 0 || fseeko(writeFile, 0, SEEK_END) != 0)){
+      fprintf(stderr, "Error truncating %s to the checkpoint: %s\n", parameters->outputFileName, strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+  } else {
+    writeFile = openStream(parameters->outputFileName, "w", parameters->useUring, &parameters->run->uringWrites);
+  }
+  if (writeFile == NULL){
+    fprintf(stderr, "Error! opening creating or opening existing output file\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // The counts of the binary header are rewritten in place at the end, which a pipe cannot do
+  FILE * streamFile = NULL;
+  if (parameters->outputFormat == BinaryOutput && isStandardStream(parameters->outputFileName)
+      && lseek(STDOUT_FILENO, 0, SEEK_CUR) < 0){
+    streamFile = writeFile;
+    if ((writeFile = tmpfile()) == NULL){
+      perror("Error creating a temporary file for the binary output");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // The counts of the binary output header are not known until the last row, they are filled in when the output is finished
+  *state = (WriterState) {parameters, writeFile, false, false, {0, 0}, NULL};
+  state->streamFile = streamFile;
+  initOutputBuffer(&state->output, writeFile, parameters->flushBytes, parameters->flushLatency);
+}
+
+void *Reader(void * params)
+{
+  ReadParams * parameters = params;
+  size_t nextOffset = parameters->run->resumeInput; //Offset of the next row in mmap mode
+
+  unblockWakeSignal();
+  FILE * readFile = openInputFile(parameters);
+
+  StageMetrics * metrics = parameters->metrics;
+  PooledRow * pooled;
+  size_t offset, length;
+  bool holdingRow = false; //Whether the Writer has given the shared row back and the Reader has not passed it on
+  uint64_t waitStart = metricsNow();
+  while (!safelyTerminate){
+    // A failed wait was interrupted by the wake signal, so the loop condition is checked again
+    if (handoffWait(parameters->read) != 0){
+      continue;
+    }
+    holdingRow = true;
+    uint64_t workStart = recordBlocked(metrics, waitStart);
+    if (!readRow(parameters, readFile, &nextOffset, NULL, 0, &pooled, &offset, &length)){
+      break;
+    }
+
+    //Write the row to the pipe between the Reader and Processor thread
+    //In mmap mode only the offset and length of the row are sent, otherwise only the pointer to the pooled row
+    //The Processor and then the Writer take over the row, which the Writer gives back to the pool
+    ssize_t written;
+    if (parameters->mappedInput != NULL){
+      RowView view = {offset, length};
+      written = write(parameters->pipePrt[1], &view, sizeof(view));
+    } else {
+      written = write(parameters->pipePrt[1], &pooled, sizeof(pooled));
+    }
+    if (written < 1){
+      perror("Error writing to pipe");
+      exit(EPIPE); /* Broken pipe */
+    }
+    waitStart = recordWork(metrics, 1, length, workStart);
+    holdingRow = false;
+    handoffPost(parameters->process);
   }
 
-  if(fclose(writeFile) == EOF){
+  if(readFile != NULL && fclose(readFile) == EOF){
     fprintf(stderr, "Error closing input file: %s\n", strerror(errno));
   }
+
+  //Closing the pipe is the end of the stream, handed to the Processor like any other row
+  //It waits for the Writer to give the shared row back, so the rows in flight are written first
+  while (!holdingRow && handoffWait(parameters->read) != 0){ }
+  if(close(parameters->pipePrt[1]) != 0){
+    fprintf(stderr, "Error closing pipe: %s\n", strerror(errno));
+  }
+  handoffPost(parameters->process);
+  pthread_exit(0);
+}
+
+void *Processor(void *params)
+{
+  ProcessorParams * parameters = params;
+  enum fileRegion region = parameters->run->substringFound ? Content : Header; //Only found already when resuming in the Content region
+
+  StageMetrics * metrics = parameters->metrics;
+  uint64_t waitStart = metricsNow();
+  while (!handoffWait(parameters->process)){
+    uint64_t workStart = recordBlocked(metrics, waitStart);
+
+    // The Writer is waiting on sem_write, so the row in shared memory can be replaced in place
+    DataRow * row = parameters->sharedBuffer;
+    const char * content;
+    ssize_t received;
+
+    if (parameters->mappedInput != NULL){
+      // Only the view is stored in shared memory, the row itself is never copied
+      RowView view;
+      received = read(parameters->pipePrt[0], &view, sizeof(view));
+      row->pooled = NULL;
+      row->offset = view.offset;
+      row->length = view.length;
+      content = parameters->mappedInput->data + row->offset;
+    } else {
+      // Only the pointer is stored in shared memory, the row now belongs to the Writer
+      received = read(parameters->pipePrt[0], &row->pooled, sizeof(row->pooled));
+      row->offset = 0;
+      row->length = received > 0 ? row->pooled->length : 0;
+      content = received > 0 ? row->pooled->data : NULL;
+    }
+    if (received == 0){
+      // The Reader closed the pipe, so the Writer is told to finish
+      row->endOfStream = true;
+      handoffPost(parameters->write);
+      break;
+    }
+    if (received < 0){
+      perror("Error reading from the pipe");
+      exit(EPIPE); /* Broken pipe */
+    }
+
+    tagRow(parameters, &region, &row->region, content, row->length);
+    if (row->region == Content && (row->region = filterRow(parameters->patterns, content, row->length)) == Dropped){
+      parameters->run->droppedRows++;
+    }
+    parseTaggedRow(parameters, row->region, content, row->length);
+
+    waitStart = recordWork(metrics, 1, row->length, workStart);
+    handoffPost(parameters->write);
+  }
+
+  if(close(parameters->pipePrt[0]) != 0){
+    fprintf(stderr, "Error closing pipe: %s\n", strerror(errno));
+  }
+  pthread_exit(NULL);
+}
+
+void *Writer(void * params)
+{
+  WriterParams * parameters = params;
+
+  // The output file is finished by a cleanup handler, so that it is complete even if the thread is cancelled after an interrupt
+  WriterState state;
+  openOutputFile(parameters, &state);
+  pthread_cleanup_push(finishOutputFile, &state);
+
+  StageMetrics * metrics = parameters->metrics;
+  uint64_t waitStart = metricsNow();
+  while (waitForWriterRow(&state)){
+    uint64_t workStart = recordBlocked(metrics, waitStart);
+
+    /* Writes rows in the Content region to the output file */
+    DataRow * row = parameters->sharedBuffer;
+    if (row->endOfStream){
+      break;
+    }
+    size_t length = row->length;
+    parameters->run->inputWritten += length;
+    if (row->region == Content){
+      // Rows of the mapped input stay valid until the end of the run, so they are written without a copy
+      if (row->pooled != NULL){
+        writeContentRow(&state, row->pooled->data, row->length, false);
+      } else {
+        writeContentRow(&state, parameters->mappedInput->data + row->offset, row->length, true);
+      }
+    }
+    if (row->pooled != NULL){
+      releaseRow(parameters->rowPool, row->pooled);
+    }
+    waitStart = recordWork(metrics, 1, length, workStart);
+    handoffPost(parameters->read);
+  }
+
+  pthread_cleanup_pop(1);
+  markOutputFinished(parameters->run);
   pthread_exit(NULL);
 }
+
+void copyBatch(void * context, void * to, void * from)
+{
+  StageParams * stages = context;
+  RowBatch * input = from;
+  RowBatch * output = to;
+
+  // Only copy the part of the slot that is in use
+  *output = *input;
+  memcpy(batchRows(output), batchRows(input), input->rowCount * sizeof(RowSpan));
+  if (stages->read->mappedInput == NULL){
+    memcpy(batchData(output, stages->read->batchLimits), batchData(input, stages->read->batchLimits), input->dataLength);
+  }
+}
+
+void measureBatch(void * context, void * slot, size_t * rows, size_t * bytes)
+{
+  RowBatch * batch = slot;
+  *rows = batch->rowCount;
+  *bytes = batchBytes(batch);
+}
+
+void checkStagePlan(ProgramOptions * options)
+{
+  const StagePlan * plan = &options->stagePlan;
+  int scan = findPlanStage(plan, "scan");
+  int strip = findPlanStage(plan, "strip");
+  int filter = findPlanStage(plan, "filter");
+  int where = findPlanStage(plan, "where");
+  int parse = findPlanStage(plan, "parse");
+  bool selecting = options->where.stepCount > 0;
+  bool filtering = options->patterns.kindsPresent & (PatternDrop | PatternSelect);
+  bool parsing = options->outputFormat == BinaryOutput || options->vertexStats;
+
+  // Only the strip stage knows where the content starts, which the filter and parse stages only look at.
+  // The scan stage leaves every row in the Content region for the strip stage to settle, so a filter stage may come between them
+  if (strip < 0 || (scan >= 0 && scan > strip) || (filter >= 0 && filter < strip && (scan < 0 || filter < scan)) || (parse >= 0 && parse < strip)){
+    fprintf(stderr, "The stage plan needs the strip stage, before the parse stage and before the filter stage unless the scan stage comes ahead of both\n");
+    exit(EXIT_FAILURE);
+  }
+  if (filtering && filter < 0){
+    fprintf(stderr, "--drop and --select need the filter stage in the stage plan\n");
+    exit(EXIT_FAILURE);
+  }
+  if (parsing && parse < 0){
+    fprintf(stderr, "--output-format binary and --stats need the parse stage in the stage plan\n");
+    exit(EXIT_FAILURE);
+  }
+  // The typed columns are written row for row, so they cannot hold rows the filter leaves out later
+  if (filtering && parsing && filter > parse){
+    fprintf(stderr, "The filter stage must come before the parse stage when rows are both filtered and parsed\n");
+    exit(EXIT_FAILURE);
+  }
+  // The where stage finds the coordinates through the header rows, which only the strip stage tags
+  if (selecting && (where < 0 || where < strip)){
+    fprintf(stderr, "--where needs the where stage in the stage plan, after the strip stage\n");
+    exit(EXIT_FAILURE);
+  }
+  if (selecting && parsing && where > parse){
+    fprintf(stderr, "The where stage must come before the parse stage when rows are both selected and parsed\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void * initReadStage(void * context, unsigned worker)
+{
+  StageParams * stages = context;
+  ReadStage * stage = malloc(sizeof(ReadStage));
+  if (stage == NULL){
+    perror("Error allocating the read stage");
+    exit(EXIT_FAILURE);
+  }
+
+  // The read stage is always the first thread of the pipeline, the one woken after an interrupt
+  unblockWakeSignal();
+  stage->parameters = stages->read;
+  stage->nextOffset = stages->read->run->resumeInput;
+  stage->nextSequence = 0;
+  stage->endOfFile = false;
+  stage->readFile = openInputFile(stages->read);
+  return stage;
+}
+
+bool readBatch(void * state, void * slot)
+{
+  ReadStage * stage = state;
+  ReadParams * parameters = stage->parameters;
+  BatchLimits * limits = parameters->batchLimits;
+  RowBatch * batch = slot;
+  RowSpan * rows = batchRows(batch);
+
+  if (stage->endOfFile || safelyTerminate){
+    return false;
+  }
+
+  // Fill the slot in place so the read stage can run ahead of the next one by up to the queue depth
+  batch->rowCount = 0;
+  batch->dataLength = 0;
+  batch->sequence = stage->nextSequence++;
+  batch->scanned = false;
+  while (batch->rowCount < limits->maxRows && batch->dataLength < limits->maxBytes){
+    RowSpan * span = &rows[batch->rowCount];
+    span->offset = batch->dataLength;
+    if (!readRow(parameters, stage->readFile, &stage->nextOffset, batchData(batch, limits) + span->offset, limits->maxBytes + BUFFER_SIZE - batch->dataLength,
+        &span->pooled, &span->offset, &span->length)){
+      stage->endOfFile = true;
+      break;
+    }
+    batch->rowCount++;
+
+    // A pooled row takes no room in the slot, the write stage gives it back to the pool
+    if (span->pooled == NULL){
+      batch->dataLength += span->length;
+    }
+  }
+  return batch->rowCount > 0;
+}
+
+void finishReadStage(void * state)
+{
+  ReadStage * stage = state;
+  if(stage->readFile != NULL && fclose(stage->readFile) == EOF){
+    fprintf(stderr, "Error closing input file: %s\n", strerror(errno));
+  }
+  free(stage);
+}
+
+void * initScanStage(void * context, unsigned worker)
+{
+  StageParams * stages = context;
+  return stages->processor;
+}
+
+bool scanBatch(void * state, void * slot)
+{
+  ProcessorParams * parameters = state;
+  RowBatch * batch = slot;
+  RowSpan * rows = batchRows(batch);
+
+  // The batches before this one may still be on other workers, so it is searched as if the header went on into it,
+  // until the strip stage has seen the header end in an earlier batch. A terminator found this way is always a real one,
+  // either the batch does start in the header or the substring was found before it
+  enum fileRegion region = batch->sequence < atomic_load(&parameters->run->contentBatch) ? Header : Content;
+  batch->scanned = true;
+  batch->headerRows = 0;
+  batch->headerEnds = false;
+  if (region == Header){
+    tagBatch(parameters, &region, batch);
+    while (batch->headerRows < batch->rowCount && rows[batch->headerRows].region == Header){
+      batch->headerRows++;
+    }
+    batch->headerEnds = region == Content;
+  }
+
+  // The filter stage looks at every row, the few of the header it filters are put back by the strip stage
+  for (size_t i = 0; i < batch->rowCount; i++){
+    rows[i].region = Content;
+  }
+  return true;
+}
+
+void * initStripStage(void * context, unsigned worker)
+{
+  StageParams * stages = context;
+  StripStage * stage = malloc(sizeof(StripStage));
+  if (stage == NULL){
+    perror("Error allocating the strip stage");
+    exit(EXIT_FAILURE);
+  }
+  stage->parameters = stages->processor;
+  //Only known already when resuming in the Content region, the scan stage may have found the substring ahead of this stage
+  stage->region = atomic_load(&stages->processor->run->contentBatch) == 0 ? Content : Header;
+  stage->headerDrops = 0;
+  return stage;
+}
+
+bool stripBatch(void * state, void * slot)
+{
+  StripStage * stage = state;
+  RowBatch * batch = slot;
+  RowSpan * rows = batchRows(batch);
+
+  if (!batch->scanned){
+    tagBatch(stage->parameters, &stage->region, batch);
+    return true;
+  }
+
+  // The batches are back in stream order, so only now is it known whether the header went on into this one
+  if (stage->region == Header){
+    for (size_t i = 0; i < batch->headerRows; i++){
+      if (rows[i].region == Dropped){
+        stage->headerDrops++;
+      }
+      rows[i].region = Header;
+    }
+    if (batch->headerEnds){
+      stage->region = Content;
+      atomic_store(&stage->parameters->run->contentBatch, batch->sequence + 1);
+    }
+  }
+  return true;
+}
+
+void finishStripStage(void * state)
+{
+  StripStage * stage = state;
+  stage->parameters->run->droppedRows -= stage->headerDrops;
+  free(stage);
+}
+
+void * initFilterStage(void * context, unsigned worker)
+{
+  StageParams * stages = context;
+  FilterStage * stage = malloc(sizeof(FilterStage));
+  if (stage == NULL){
+    perror("Error allocating the filter stage");
+    exit(EXIT_FAILURE);
+  }
+  stage->parameters = stages->processor;
+  stage->droppedRows = 0;
+  return stage;
+}
+
+bool filterBatch(void * state, void * slot)
+{
+  FilterStage * stage = state;
+  ProcessorParams * parameters = stage->parameters;
+  RowBatch * batch = slot;
+  RowSpan * rows = batchRows(batch);
+
+  if (parameters->patterns == NULL || !(parameters->patterns->kindsPresent & (PatternDrop | PatternSelect))){
+    return true;
+  }
+  for (size_t i = 0; i < batch->rowCount; i++){
+    if (rows[i].region == Content
+        && (rows[i].region = filterRow(parameters->patterns, spanText(batch, parameters->batchLimits, parameters->mappedInput, &rows[i]), rows[i].length)) == Dropped){
+      stage->droppedRows++;
+    }
+  }
+  return true;
+}
+
+void finishFilterStage(void * state)
+{
+  FilterStage * stage = state;
+  stage->parameters->run->droppedRows += stage->droppedRows;
+  free(stage);
+}
+
+void * initWhereStage(void * context, unsigned worker)
+{
+  StageParams * stages = context;
+  ProcessorParams * parameters = stages->processor;
+  WhereStage * stage = malloc(sizeof(WhereStage));
+  if (stage == NULL){
+    perror("Error allocating the where stage");
+    exit(EXIT_FAILURE);
+  }
+  stage->parameters = parameters;
+  stage->candidates = NULL;
+  stage->selected = NULL;
+  if (parameters->where != NULL){
+    initWhereFilter(&stage->filter, parameters->where, parameters->batchLimits->maxRows);
+    stage->candidates = malloc(parameters->batchLimits->maxRows * sizeof(size_t));
+    stage->selected = malloc(parameters->batchLimits->maxRows * sizeof(size_t));
+    if (stage->candidates == NULL || stage->selected == NULL){
+      perror("Error allocating the where stage");
+      exit(EXIT_FAILURE);
+    }
+  }
+  return stage;
+}
+
+bool whereBatch(void * state, void * slot)
+{
+  WhereStage * stage = state;
+  ProcessorParams * parameters = stage->parameters;
+  RowBatch * batch = slot;
+  RowSpan * rows = batchRows(batch);
+  size_t candidateCount = 0;
+
+  if (parameters->where == NULL){
+    return true;
+  }
+
+  // Every content row is left out until the expression selects it, the rows stay in the batch so their offsets still add up
+  for (size_t i = 0; i < batch->rowCount; i++){
+    if (rows[i].region == Header){
+      addWhereHeaderRow(&stage->filter, spanText(batch, parameters->batchLimits, parameters->mappedInput, &rows[i]), rows[i].length);
+    } else if (rows[i].region == Dropped){
+      skipWhereRow(&stage->filter);
+    } else {
+      addWhereRow(&stage->filter, spanText(batch, parameters->batchLimits, parameters->mappedInput, &rows[i]), rows[i].length);
+      stage->candidates[candidateCount++] = i;
+      rows[i].region = Dropped;
+    }
+  }
+  if (candidateCount > 0){
+    size_t selectedCount = selectWhereRows(&stage->filter, stage->selected);
+    for (size_t i = 0; i < selectedCount; i++){
+      rows[stage->candidates[stage->selected[i]]].region = Content;
+    }
+  }
+  return true;
+}
+
+void finishWhereStage(void * state)
+{
+  WhereStage * stage = state;
+  if (stage->parameters->where != NULL){
+    stage->parameters->run->whereTested += stage->filter.rowsTested;
+    stage->parameters->run->whereKept += stage->filter.rowsKept;
+    freeWhereFilter(&stage->filter);
+  }
+  free(stage->candidates);
+  free(stage->selected);
+  free(stage);
+}
+
+void * initParseStage(void * context, unsigned worker)
+{
+  StageParams * stages = context;
+  return stages->processor;
+}
+
+bool parseBatch(void * state, void * slot)
+{
+  ProcessorParams * parameters = state;
+  RowBatch * batch = slot;
+  RowSpan * rows = batchRows(batch);
+
+  if (parameters->schema != NULL){
+    for (size_t i = 0; i < batch->rowCount; i++){
+      parseTaggedRow(parameters, rows[i].region, spanText(batch, parameters->batchLimits, parameters->mappedInput, &rows[i]), rows[i].length);
+    }
+  }
+  return true;
+}
+
+void * initWriteStage(void * context, unsigned worker)
+{
+  StageParams * stages = context;
+  WriterState * state = malloc(sizeof(WriterState));
+  if (state == NULL){
+    perror("Error allocating the write stage");
+    exit(EXIT_FAILURE);
+  }
+  openOutputFile(stages->writer, state);
+  return state;
+}
+
+bool writeBatch(void * state, void * slot)
+{
+  WriterState * writer = state;
+  WriterParams * parameters = writer->parameters;
+  RowBatch * batch = slot;
+  RowSpan * rows = batchRows(batch);
+
+  // Rows of the mapped input stay valid until the end of the run, so they are written without a copy
+  parameters->run->inputWritten += batchBytes(batch);
+  for (size_t i = 0; i < batch->rowCount; i++){
+    if (rows[i].region == Content){
+      writeContentRow(writer, spanText(batch, parameters->batchLimits, parameters->mappedInput, &rows[i]), rows[i].length,
+        parameters->mappedInput != NULL && rows[i].pooled == NULL);
+    }
+    if (rows[i].pooled != NULL){
+      releaseRow(parameters->rowPool, rows[i].pooled);
+    }
+  }
+  return true;
+}
+
+void idleWriteStage(void * state)
+{
+  // Under a latency limit the waiting rows are written before the write stage sleeps
+  WriterState * writer = state;
+  flushBeforeWaiting(&writer->output);
+}
+
+void finishWriteStage(void * state)
+{
+  // Also run when the worker is cancelled, so the output file is always complete
+  WriterState * writer = state;
+  PipelineRun * run = writer->parameters->run;
+  finishOutputFile(writer);
+  free(writer);
+  markOutputFinished(run);
+}
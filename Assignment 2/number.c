@@ -0,0 +1,160 @@
+#include <math.h>
+#include <stdint.h>
+#include "number.h"
+
+//Digits past this are dropped from the mantissa, they only move the exponent
+#define MAX_MANTISSA_DIGITS 19
+//A double holds every power of ten up to 1e22 exactly
+#define MAX_EXACT_POWER 22
+
+static const double powersOfTen[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static bool isSpace(char c){
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static bool isDigit(char c){
+	return c >= '0' && c <= '9';
+}
+
+//Moves position past any spaces, returning false if the text ends first
+static bool skipSpaces(const char ** position, const char * end){
+	while (*position < end && isSpace(**position)){
+		(*position)++;
+	}
+	return *position < end;
+}
+
+//Matches a word such as inf or nan without regard to case
+static bool matchWord(const char * position, const char * end, const char * word){
+	for (; *word != '\0'; word++, position++){
+		if (position == end || (*position | 0x20) != *word){
+			return false;
+		}
+	}
+	return position == end || isSpace(*position);
+}
+
+//Scales a mantissa by a power of ten, exactly when both fit a double without rounding
+static double scale(uint64_t mantissa, int exponent){
+	if (mantissa <= (1ull << 53) && exponent >= -MAX_EXACT_POWER && exponent <= MAX_EXACT_POWER){
+		return exponent < 0 ? mantissa / powersOfTen[-exponent] : mantissa * powersOfTen[exponent];
+	}
+
+	// Rare in vertex data, the extra precision of long double keeps the result within a unit of the last place
+	long double result = mantissa;
+	while (exponent > MAX_EXACT_POWER && result != 0 && result < HUGE_VALL){
+		result *= 1e22L;
+		exponent -= MAX_EXACT_POWER;
+	}
+	while (exponent < -MAX_EXACT_POWER && result != 0){
+		result /= 1e22L;
+		exponent += MAX_EXACT_POWER;
+	}
+	result = exponent < 0 ? result / powersOfTen[-exponent] : result * powersOfTen[exponent];
+	return (double) result;
+}
+
+bool parseDecimal(const char ** position, const char * end, double * value){
+	if (!skipSpaces(position, end)){
+		return false;
+	}
+
+	const char * p = *position;
+	bool negative = *p == '-';
+	if (*p == '-' || *p == '+'){
+		p++;
+	}
+
+	if (matchWord(p, end, "inf") || matchWord(p, end, "nan")){
+		*value = (*p | 0x20) == 'i' ? (negative ? -INFINITY : INFINITY) : NAN;
+		*position = p + 3;
+		return true;
+	}
+
+	uint64_t mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	bool anyDigits = false;
+
+	for (; p < end && isDigit(*p); p++){
+		anyDigits = true;
+		if (digits < MAX_MANTISSA_DIGITS){
+			mantissa = mantissa * 10 + (*p - '0');
+			digits += mantissa > 0;
+		} else {
+			exponent++;
+		}
+	}
+	if (p < end && *p == '.'){
+		for (p++; p < end && isDigit(*p); p++){
+			anyDigits = true;
+			if (digits < MAX_MANTISSA_DIGITS){
+				mantissa = mantissa * 10 + (*p - '0');
+				digits += mantissa > 0;
+				exponent--;
+			}
+		}
+	}
+	if (!anyDigits){
+		return false;
+	}
+
+	if (p < end && (*p == 'e' || *p == 'E')){
+		const char * e = p + 1;
+		bool negativeExponent = e < end && *e == '-';
+		if (e < end && (*e == '-' || *e == '+')){
+			e++;
+		}
+		if (e < end && isDigit(*e)){
+			int power = 0;
+			for (; e < end && isDigit(*e); e++){
+				if (power < 100000){
+					power = power * 10 + (*e - '0');
+				}
+			}
+			exponent += negativeExponent ? -power : power;
+			p = e;
+		}
+	}
+
+	if (p < end && !isSpace(*p)){
+		return false;
+	}
+
+	double result = scale(mantissa, exponent);
+	*value = negative ? -result : result;
+	*position = p;
+	return true;
+}
+
+bool parseInteger(const char ** position, const char * end, long long * value){
+	if (!skipSpaces(position, end)){
+		return false;
+	}
+
+	const char * p = *position;
+	bool negative = *p == '-';
+	if (*p == '-' || *p == '+'){
+		p++;
+	}
+
+	uint64_t result = 0;
+	const char * digitsStart = p;
+	for (; p < end && isDigit(*p); p++){
+		if (result > (UINT64_MAX - 9) / 10){
+			return false;
+		}
+		result = result * 10 + (*p - '0');
+	}
+	if (p == digitsStart || (p < end && !isSpace(*p)) || result > (uint64_t) INT64_MAX + negative){
+		return false;
+	}
+
+	*value = negative ? (long long) (0 - result) : (long long) result;
+	*position = p;
+	return true;
+}
@@ -0,0 +1,18 @@
+#ifndef NUMBER_H
+#define NUMBER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+	Parses the decimal number at position, such as 12, -0.5 or 1.25e-3, skipping any spaces before it.
+	The text does not need to be null terminated, nothing at or past end is read.
+	Unlike strtod the decimal point is always '.', whatever the locale.
+	On success position is moved past the number, which must be followed by whitespace or end.
+*/
+bool parseDecimal(const char ** position, const char * end, double * value);
+
+/* Parses a whole number at position in the same way as parseDecimal, rejecting fractions and exponents */
+bool parseInteger(const char ** position, const char * end, long long * value);
+
+#endif
@@ -0,0 +1,146 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "output_buffer.h"
+
+#define PAGE_SIZE 4096
+#define MAX_PIECES 1024 //The smallest IOV_MAX of the systems this runs on
+
+static double currentSeconds(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+void initOutputBuffer(OutputBuffer * buffer, FILE * file, size_t flushBytes, double flushLatency){
+	memset(buffer, 0, sizeof(OutputBuffer));
+	buffer->file = file;
+	buffer->fd = fileno(file);
+	buffer->flushBytes = flushBytes;
+	buffer->flushLatency = flushLatency;
+	buffer->capacity = (flushBytes + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+
+	if (posix_memalign((void **) &buffer->data, PAGE_SIZE, buffer->capacity) != 0
+			|| (buffer->pieces = malloc(MAX_PIECES * sizeof(struct iovec))) == NULL){
+		perror("Error allocating output buffer");
+		exit(EXIT_FAILURE);
+	}
+}
+
+//Writes every piece with as few writev calls as the kernel allows
+static bool writePieces(OutputBuffer * buffer){
+	struct iovec * pieces = buffer->pieces;
+	int count = buffer->pieceCount;
+
+	if (buffer->fd < 0){
+		for (int i = 0; i < count; i++){
+			if (fwrite(pieces[i].iov_base, 1, pieces[i].iov_len, buffer->file) != pieces[i].iov_len){
+				return false;
+			}
+		}
+		return fflush(buffer->file) == 0;
+	}
+
+	while (count > 0){
+		ssize_t written = writev(buffer->fd, pieces, count);
+		if (written < 0){
+			if (errno == EINTR){ continue; }
+			return false;
+		}
+
+		// Skip the pieces that were written in full, and the written part of the first one that was not
+		while (count > 0 && (size_t) written >= pieces->iov_len){
+			written -= pieces->iov_len;
+			pieces++;
+			count--;
+		}
+		if (count > 0){
+			pieces->iov_base = (char *) pieces->iov_base + written;
+			pieces->iov_len -= written;
+		}
+	}
+	return true;
+}
+
+bool flushOutput(OutputBuffer * buffer){
+	if (buffer->pieceCount > 0){
+		if (!writePieces(buffer)){
+			buffer->failed = true;
+		}
+		buffer->bytesWritten += buffer->pendingBytes;
+		buffer->flushes++;
+	}
+	buffer->pieceCount = 0;
+	buffer->pendingBytes = 0;
+	buffer->used = 0;
+	return !buffer->failed;
+}
+
+void appendOutput(OutputBuffer * buffer, const char * text, size_t length, bool stable){
+	if (length == 0){
+		return;
+	}
+	if (!stable && buffer->used + length > buffer->capacity){
+		flushOutput(buffer);
+	}
+	if (buffer->pieceCount == MAX_PIECES){
+		flushOutput(buffer);
+	}
+	if (buffer->pendingBytes == 0 && buffer->flushLatency > 0){
+		buffer->oldestRow = currentSeconds();
+	}
+
+	// A row too long for the copy buffer is written while it is still valid
+	if (!stable && length > buffer->capacity){
+		buffer->pieces[buffer->pieceCount++] = (struct iovec) {(void *) text, length};
+		buffer->pendingBytes += length;
+		flushOutput(buffer);
+		return;
+	}
+
+	const char * start = text;
+	if (!stable){
+		start = memcpy(buffer->data + buffer->used, text, length);
+		buffer->used += length;
+	}
+
+	// Rows that follow each other in memory share a piece, so a run of rows costs a single iovec
+	struct iovec * last = buffer->pieceCount > 0 ? &buffer->pieces[buffer->pieceCount - 1] : NULL;
+	if (last != NULL && (const char *) last->iov_base + last->iov_len == start){
+		last->iov_len += length;
+	} else {
+		buffer->pieces[buffer->pieceCount++] = (struct iovec) {(void *) start, length};
+	}
+	buffer->pendingBytes += length;
+
+	if (buffer->pendingBytes >= buffer->flushBytes){
+		flushOutput(buffer);
+	} else if (buffer->flushLatency > 0 && currentSeconds() - buffer->oldestRow >= buffer->flushLatency){
+		buffer->latencyFlushes++;
+		flushOutput(buffer);
+	}
+}
+
+void flushBeforeWaiting(OutputBuffer * buffer){
+	if (buffer->flushLatency > 0 && buffer->pendingBytes > 0){
+		buffer->latencyFlushes++;
+		flushOutput(buffer);
+	}
+}
+
+void discardOutput(OutputBuffer * buffer){
+	buffer->pieceCount = 0;
+	buffer->pendingBytes = 0;
+	buffer->used = 0;
+}
+
+bool freeOutputBuffer(OutputBuffer * buffer){
+	bool succeeded = flushOutput(buffer);
+	free(buffer->data);
+	free(buffer->pieces);
+	buffer->data = NULL;
+	buffer->pieces = NULL;
+	return succeeded;
+}
@@ -0,0 +1,53 @@
+#ifndef OUTPUT_BUFFER_H
+#define OUTPUT_BUFFER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/uio.h>
+
+/*
+	Gathers rows for the output file and writes them with a single writev once enough bytes are
+	waiting, or once the oldest waiting row has waited long enough.
+	Rows that stay valid until the flush, such as rows of a mapped input file, are only referenced.
+	Any other row is copied into a large page aligned buffer, next to the row before it.
+*/
+typedef struct OutputBuffer {
+	FILE * file;
+	int fd;               //-1 when the stream has no descriptor, then each piece is handed to fwrite instead
+
+	char * data;          //Copies of rows that would not outlive the flush
+	size_t used, capacity;
+
+	struct iovec * pieces;
+	int pieceCount;
+	size_t pendingBytes;
+
+	size_t flushBytes;    //Write once this many bytes are waiting
+	double flushLatency;  //Write once the oldest waiting row is this many seconds old, 0 for no limit
+	double oldestRow;     //When the oldest waiting row was added
+
+	size_t flushes, latencyFlushes;
+	size_t bytesWritten;
+	bool failed;
+} OutputBuffer;
+
+/* Sets up a buffer in front of an open file, with a copy buffer of flushBytes */
+void initOutputBuffer(OutputBuffer * buffer, FILE * file, size_t flushBytes, double flushLatency);
+
+/* Adds a row, which is copied unless it stays valid until the next flush, and writes the buffer when a threshold is reached */
+void appendOutput(OutputBuffer * buffer, const char * text, size_t length, bool stable);
+
+/* Writes every waiting row to the file, returning false if any write has failed */
+bool flushOutput(OutputBuffer * buffer);
+
+/* Writes the waiting rows if a latency limit is set, used before the caller goes to sleep waiting for more rows */
+void flushBeforeWaiting(OutputBuffer * buffer);
+
+/* Drops the waiting rows without writing them, for an output that can no longer be written */
+void discardOutput(OutputBuffer * buffer);
+
+/* Writes every waiting row and frees the buffer, the file stays open */
+bool freeOutputBuffer(OutputBuffer * buffer);
+
+#endif
@@ -0,0 +1,264 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "parallel.h"
+#include "search.h"
+
+//Bytes of content given to each thread per round, so the binary output of a round fits in memory
+#define ROUND_CHUNK_SIZE (16 << 20)
+
+/* A newline aligned part of the content region and what its thread made of it */
+typedef struct ChunkJob {
+	const char * start;
+	const char * end;
+	PlySchema * schema;   //NULL for ascii output, or when binary output falls back to x, y, z vertices
+	bool binaryOutput;
+	const PlySchema * header; //The parsed header, used to find the vertex rows for the statistics
+	VertexStats * stats;  //NULL unless the statistics were requested
+
+	size_t firstRow;      //Index of the first row of the chunk within the content region
+	size_t rowCount;
+	size_t convertedRows;
+	size_t skippedRows;
+	size_t malformedRows; //Rows that were converted with zeros in place of values that did not parse
+	PlyBuffer output;
+} ChunkJob;
+
+//Counts the rows of a chunk, the last row of the file may not end with a newline
+static void *countRows(void * params){
+	ChunkJob * job = params;
+	const char * position = job->start;
+
+	job->rowCount = 0;
+	while (position < job->end){
+		const char * rowEnd = memchr(position, '\n', job->end - position);
+		position = rowEnd != NULL ? rowEnd + 1 : job->end;
+		job->rowCount++;
+	}
+	return NULL;
+}
+
+//Converts a row of a chunk into binary values, using the element the row belongs to
+static void convertRow(ChunkJob * job, size_t rowIndex, const char * row, size_t length){
+	float vertex[3];
+
+	if (job->schema != NULL){
+		const PlyElement * element = plyElementForRow(job->schema, rowIndex);
+		if (element == NULL){
+			job->skippedRows++;
+			return;
+		}
+		if (!encodeBinaryPlyRow(element, row, length, &job->output)){
+			job->malformedRows++;
+		}
+		job->convertedRows++;
+	} else if (parseVertex(row, length, vertex)){
+		encodeBinaryVertex(vertex, &job->output);
+		job->convertedRows++;
+	} else {
+		job->skippedRows++;
+	}
+}
+
+//Converts every row of a chunk in binary output mode, and adds the coordinates of each row to the statistics of the chunk
+static void *parseRows(void * params){
+	ChunkJob * job = params;
+	const char * position = job->start;
+	size_t rowIndex = job->firstRow;
+
+	job->output.length = 0;
+	job->convertedRows = 0;
+	job->skippedRows = 0;
+	job->malformedRows = 0;
+	if (job->stats != NULL){
+		initVertexStats(job->stats, job->firstRow);
+	}
+
+	while (position < job->end){
+		const char * rowEnd = memchr(position, '\n', job->end - position);
+		size_t length = rowEnd != NULL ? (size_t) (rowEnd - position) + 1 : (size_t) (job->end - position);
+
+		if (job->stats != NULL){
+			addVertexStatsRow(job->stats, job->header, position, length);
+		}
+		if (job->binaryOutput){
+			convertRow(job, rowIndex, position, length);
+		}
+
+		position += length;
+		rowIndex++;
+	}
+	return NULL;
+}
+
+//Runs a function over every chunk of a round, each on its own thread
+static void runChunks(ChunkJob * jobs, unsigned jobCount, void *(*function)(void *)){
+	pthread_t threadIDs[jobCount];
+
+	for (unsigned i = 0; i < jobCount; i++){
+		if (pthread_create(&threadIDs[i], NULL, function, &jobs[i]) != 0){
+			perror("Error creating chunk thread");
+			exit(EXIT_FAILURE);
+		}
+	}
+	for (unsigned i = 0; i < jobCount; i++){
+		if (pthread_join(threadIDs[i], NULL) != 0){
+			perror("Error joining chunk thread");
+		}
+	}
+}
+
+//Returns the end of the chunk that starts at start, moved forward to just after the next newline
+static const char * alignedChunkEnd(const char * start, const char * end, size_t chunkSize){
+	if ((size_t) (end - start) <= chunkSize){
+		return end;
+	}
+	const char * newline = memchr(start + chunkSize, '\n', end - (start + chunkSize));
+	return newline != NULL ? newline + 1 : end;
+}
+
+ParallelResult runParallel(const char * inputFileName, const char * outputFileName, const char * substring,
+		unsigned threadCount, bool binaryOutput, PlySchema * schema, VertexStats * stats){
+	ParallelResult result = {0};
+	size_t substringLength = strlen(substring);
+	struct stat fileStatus;
+	const char * data = NULL;
+	int inputFile;
+	FILE * writeFile;
+
+	if ((inputFile = open(inputFileName, O_RDONLY)) < 0){
+		fprintf(stderr,
+			"Error: Could not find or open %s. Ensure that a file named %s exists within the same directory.\n",
+			inputFileName, inputFileName
+		);
+		fprintf(stderr, "Exiting program...\n");
+		exit(ENOENT); /* No such file or directory */
+	}
+	if (fstat(inputFile, &fileStatus) != 0){
+		perror("Error reading input file size");
+		exit(EXIT_FAILURE);
+	}
+	if (fileStatus.st_size > 0 && (data = mmap(NULL, fileStatus.st_size, PROT_READ, MAP_PRIVATE, inputFile, 0)) == MAP_FAILED){
+		perror("Error mapping input file");
+		exit(EXIT_FAILURE);
+	}
+	close(inputFile);
+	if ((writeFile = fopen(outputFileName, "w")) == NULL){
+		fprintf(stderr, "Error! opening creating or opening existing output file\n");
+		exit(EXIT_FAILURE);
+	}
+
+	fprintf(stderr, "Reading from %s with %u threads\n", inputFileName, threadCount);
+
+	// The header is scanned row by row on this thread, it is only a few rows long
+	const char * position = data;
+	const char * end = data + fileStatus.st_size;
+	while (!result.substringFound && position < end){
+		const char * rowEnd = memchr(position, '\n', end - position);
+		size_t length = rowEnd != NULL ? (size_t) (rowEnd - position) + 1 : (size_t) (end - position);
+
+		if (binaryOutput || stats != NULL){
+			parsePlyHeaderRow(schema, position, length);
+		}
+		result.substringFound = findSubstring(position, length, substring, substringLength) != NULL;
+		result.headerRows++;
+		position += length;
+	}
+	result.dataInFile = fileStatus.st_size > 0;
+
+	// An ascii PLY header drives the binary conversion, anything else is converted to x, y, z vertices
+	bool useSchema = binaryOutput && plySchemaIsConvertible(schema);
+	long * countPositions = NULL;
+	if (result.substringFound && binaryOutput){
+		if (useSchema){
+			countPositions = malloc(schema->elementCount * sizeof(long));
+			writeBinaryPlySchemaHeader(writeFile, schema, countPositions);
+		} else {
+			writeBinaryPlyHeader(writeFile, 0);
+		}
+	}
+
+	// Each round gives every thread a chunk of the content, then writes the chunks in their original order
+	ChunkJob jobs[threadCount];
+	VertexStats chunkStats[threadCount];
+	memset(jobs, 0, sizeof(jobs));
+	size_t nextRow = 0;
+	while (result.substringFound && position < end){
+		unsigned jobCount = 0;
+		for (; jobCount < threadCount && position < end; jobCount++){
+			jobs[jobCount].start = position;
+			jobs[jobCount].end = position = alignedChunkEnd(position, end, ROUND_CHUNK_SIZE);
+			jobs[jobCount].schema = useSchema ? schema : NULL;
+			jobs[jobCount].binaryOutput = binaryOutput;
+			jobs[jobCount].header = schema;
+			jobs[jobCount].stats = stats != NULL ? &chunkStats[jobCount] : NULL;
+		}
+
+		// Rows are counted first so that every chunk knows the index of its first row
+		runChunks(jobs, jobCount, countRows);
+		for (unsigned i = 0; i < jobCount; i++){
+			jobs[i].firstRow = nextRow;
+			nextRow += jobs[i].rowCount;
+		}
+		if (binaryOutput || stats != NULL){
+			runChunks(jobs, jobCount, parseRows);
+		}
+
+		for (unsigned i = 0; i < jobCount; i++){
+			if (stats != NULL){
+				mergeVertexStats(stats, &chunkStats[i]);
+			}
+			if (binaryOutput){
+				fwrite(jobs[i].output.data, 1, jobs[i].output.length, writeFile);
+				result.convertedRows += jobs[i].convertedRows;
+				result.skippedRows += jobs[i].skippedRows;
+				if (useSchema){
+					schema->malformedRows += jobs[i].malformedRows;
+					schema->extraRows += jobs[i].skippedRows;
+				}
+			} else {
+				fwrite(jobs[i].start, 1, jobs[i].end - jobs[i].start, writeFile);
+			}
+		}
+		result.rounds++;
+	}
+	result.contentRows = nextRow;
+
+	// Every element holds its declared number of rows, unless the file ran out of rows first
+	if (result.substringFound && binaryOutput){
+		bool updated;
+		if (useSchema){
+			for (size_t e = 0, remaining = nextRow; e < schema->elementCount; e++){
+				schema->elements[e].rowCount = remaining < schema->elements[e].declaredCount ? remaining : schema->elements[e].declaredCount;
+				remaining -= schema->elements[e].rowCount;
+			}
+			updated = updatePlyCounts(writeFile, schema, countPositions);
+		} else {
+			updated = updateBinaryPlyVertexCount(writeFile, result.convertedRows);
+		}
+		if (!updated){
+			fprintf(stderr, "Error updating the element counts of %s: %s\n", outputFileName, strerror(errno));
+		}
+	}
+
+	result.bytesRead = fileStatus.st_size;
+	result.outputBytes = ftell(writeFile);
+	for (unsigned i = 0; i < threadCount; i++){
+		free(jobs[i].output.data);
+	}
+	free(countPositions);
+	if (fclose(writeFile) == EOF){
+		fprintf(stderr, "Error closing output file: %s\n", strerror(errno));
+	}
+	if (data != NULL && munmap((void *) data, fileStatus.st_size) != 0){
+		fprintf(stderr, "Error unmapping input file: %s\n", strerror(errno));
+	}
+	return result;
+}
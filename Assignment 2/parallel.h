@@ -0,0 +1,33 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "ply.h"
+#include "vertex_stats.h"
+
+/* The outcome of processing the content region of a file in newline aligned chunks on many threads */
+typedef struct ParallelResult {
+	bool dataInFile;
+	bool substringFound;
+	size_t headerRows;
+	size_t contentRows;
+	size_t bytesRead;
+	size_t convertedRows;  //Rows written in binary output mode
+	size_t skippedRows;    //Rows that did not match their element, or came after the last declared row
+	size_t outputBytes;
+	unsigned rounds;
+} ParallelResult;
+
+/*
+	Maps the input file, scans its header for the substring and splits the rest of the file into
+	threadCount chunks that end on a newline. Each chunk is processed on its own thread and the
+	results are written to the output file in the original order.
+	In binary output mode the header rows are parsed into schema, which drives the conversion and
+	receives the row counts of every element. When stats is not NULL, every chunk gathers its own
+	vertex statistics, which are merged into stats in the original order.
+*/
+ParallelResult runParallel(const char * inputFileName, const char * outputFileName, const char * substring,
+	unsigned threadCount, bool binaryOutput, PlySchema * schema, VertexStats * stats);
+
+#endif
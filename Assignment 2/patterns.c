@@ -0,0 +1,172 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "patterns.h"
+
+static void * allocateOrExit(void * pointer){
+	if (pointer == NULL){
+		perror("Error allocating pattern set");
+		exit(EXIT_FAILURE);
+	}
+	return pointer;
+}
+
+bool addPattern(PatternSet * set, const char * text, size_t length, PatternKind kind){
+	if (length == 0){
+		return false;
+	}
+	if (set->count == set->capacity){
+		set->capacity = set->capacity == 0 ? 8 : set->capacity * 2;
+		set->texts = allocateOrExit(realloc(set->texts, set->capacity * sizeof(char *)));
+		set->lengths = allocateOrExit(realloc(set->lengths, set->capacity * sizeof(size_t)));
+		set->kinds = allocateOrExit(realloc(set->kinds, set->capacity));
+	}
+	char * copy = allocateOrExit(malloc(length));
+	memcpy(copy, text, length);
+	set->texts[set->count] = copy;
+	set->lengths[set->count] = length;
+	set->kinds[set->count] = kind;
+	set->count++;
+	set->kindsPresent |= kind;
+	return true;
+}
+
+bool loadPatternFile(PatternSet * set, const char * fileName){
+	FILE * file = fopen(fileName, "r");
+	if (file == NULL){
+		fprintf(stderr, "Error opening pattern file %s: %s\n", fileName, strerror(errno));
+		return false;
+	}
+
+	char * line = NULL;
+	size_t capacity = 0;
+	ssize_t length;
+	size_t lineNumber = 0;
+	bool loaded = true;
+	while (loaded && (length = getline(&line, &capacity, file)) > 0){
+		lineNumber++;
+		while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')){
+			line[--length] = '\0';
+		}
+		if (length == 0 || line[0] == '#'){
+			continue;
+		}
+
+		// The pattern is everything after the first space, so it may hold spaces of its own
+		char * pattern = strchr(line, ' ');
+		size_t kindLength = pattern == NULL ? (size_t) length : (size_t)(pattern - line);
+		PatternKind kind;
+		if (kindLength == strlen("terminator") && strncmp(line, "terminator", kindLength) == 0){
+			kind = PatternTerminator;
+		} else if (kindLength == strlen("drop") && strncmp(line, "drop", kindLength) == 0){
+			kind = PatternDrop;
+		} else if (kindLength == strlen("select") && strncmp(line, "select", kindLength) == 0){
+			kind = PatternSelect;
+		} else {
+			fprintf(stderr, "%s:%zu: expected terminator, drop or select before the pattern\n", fileName, lineNumber);
+			loaded = false;
+			break;
+		}
+		if (pattern == NULL || !addPattern(set, pattern + 1, line + length - (pattern + 1), kind)){
+			fprintf(stderr, "%s:%zu: the pattern is empty\n", fileName, lineNumber);
+			loaded = false;
+		}
+	}
+	free(line);
+	fclose(file);
+	return loaded;
+}
+
+void buildPatternSet(PatternSet * set){
+	// Only the bytes that appear in a pattern can change the state, so the table has one column per such byte
+	memset(set->byteClass, 0, sizeof(set->byteClass));
+	set->classCount = 1;
+	for (size_t p = 0; p < set->count; p++){
+		for (size_t i = 0; i < set->lengths[p]; i++){
+			unsigned char byte = set->texts[p][i];
+			if (set->byteClass[byte] == 0){
+				set->byteClass[byte] = set->classCount++;
+			}
+		}
+	}
+
+	size_t maxNodes = 1;
+	for (size_t p = 0; p < set->count; p++){
+		maxNodes += set->lengths[p];
+	}
+	unsigned classCount = set->classCount;
+	free(set->next);
+	free(set->output);
+	set->next = allocateOrExit(calloc(maxNodes * classCount, sizeof(uint32_t)));
+	set->output = allocateOrExit(calloc(maxNodes, 1));
+	uint32_t * fail = allocateOrExit(calloc(maxNodes, sizeof(uint32_t)));
+	uint32_t * queue = allocateOrExit(malloc(maxNodes * sizeof(uint32_t)));
+
+	// The trie of the patterns, where a zero entry means no child since the root is never a child
+	set->nodeCount = 1;
+	for (size_t p = 0; p < set->count; p++){
+		uint32_t node = 0;
+		for (size_t i = 0; i < set->lengths[p]; i++){
+			uint32_t * child = &set->next[node * classCount + set->byteClass[(unsigned char) set->texts[p][i]]];
+			if (*child == 0){
+				*child = set->nodeCount++;
+			}
+			node = *child;
+		}
+		set->output[node] |= set->kinds[p];
+	}
+
+	// Breadth first, so the suffix link of a node is complete before its children need it.
+	// Missing children become the transition of the suffix link, which makes every step of a match a single lookup
+	size_t head = 0, tail = 0;
+	queue[tail++] = 0;
+	while (head < tail){
+		uint32_t node = queue[head++];
+		uint32_t * transitions = &set->next[node * classCount];
+		uint32_t * failTransitions = &set->next[fail[node] * classCount];
+		for (unsigned c = 0; c < classCount; c++){
+			uint32_t child = transitions[c];
+			if (child == 0){
+				transitions[c] = node == 0 ? 0 : failTransitions[c];
+				continue;
+			}
+			fail[child] = node == 0 ? 0 : failTransitions[c];
+			set->output[child] |= set->output[fail[child]];
+			queue[tail++] = child;
+		}
+	}
+	free(fail);
+	free(queue);
+}
+
+unsigned matchPatterns(const PatternSet * set, const char * text, size_t length, unsigned kinds){
+	const uint32_t * next = set->next;
+	const unsigned char * byteClass = set->byteClass;
+	unsigned classCount = set->classCount;
+	unsigned found = 0;
+	uint32_t state = 0;
+
+	for (size_t i = 0; i < length; i++){
+		state = next[state * classCount + byteClass[(unsigned char) text[i]]];
+		if (set->output[state] != 0){
+			found |= set->output[state] & kinds;
+			if (found == kinds){
+				break;
+			}
+		}
+	}
+	return found;
+}
+
+void freePatternSet(PatternSet * set){
+	for (size_t p = 0; p < set->count; p++){
+		free(set->texts[p]);
+	}
+	free(set->texts);
+	free(set->lengths);
+	free(set->kinds);
+	free(set->next);
+	free(set->output);
+	memset(set, 0, sizeof(PatternSet));
+}
@@ -0,0 +1,51 @@
+#ifndef PATTERNS_H
+#define PATTERNS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* What a pattern does when a row contains it, as bits so that one scan can report every kind it found */
+typedef enum PatternKind {
+	PatternTerminator = 1, //Ends the header, like the substring
+	PatternDrop = 2,       //Removes a content row
+	PatternSelect = 4      //Keeps only the content rows that contain one of these
+} PatternKind;
+
+/* A list of patterns matched together by an Aho-Corasick automaton, in one pass over a row whatever their number.
+   A zeroed PatternSet is empty. Patterns are added first, then the set is built once and only read afterwards */
+typedef struct PatternSet {
+	char ** texts;
+	size_t * lengths;
+	unsigned char * kinds;
+	size_t count;
+	size_t capacity;
+	unsigned kindsPresent;
+
+	//Bytes that appear in no pattern share class 0, every other byte has its own class
+	unsigned char byteClass[256];
+	unsigned classCount;
+
+	//Dense transition table of nodeCount rows of classCount states, with the suffix links already followed
+	uint32_t * next;
+	unsigned char * output; //Kinds of every pattern that ends on reaching each state
+	size_t nodeCount;
+} PatternSet;
+
+/* Adds a pattern of a kind, returning false for an empty pattern */
+bool addPattern(PatternSet * set, const char * text, size_t length, PatternKind kind);
+
+/* Adds the patterns of a file with one "terminator", "drop" or "select" and its pattern per line.
+   Blank lines and lines starting with # are skipped. Returns false after printing the problem */
+bool loadPatternFile(PatternSet * set, const char * fileName);
+
+/* Builds the automaton of every pattern added so far */
+void buildPatternSet(PatternSet * set);
+
+/* Returns which of kinds have a pattern within text, stopping as soon as all of them were found */
+unsigned matchPatterns(const PatternSet * set, const char * text, size_t length, unsigned kinds);
+
+/* Frees the patterns and the automaton, leaving an empty set */
+void freePatternSet(PatternSet * set);
+
+#endif
@@ -0,0 +1,483 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "number.h"
+#include "ply.h"
+
+#define BINARY_PLY_FORMAT "format binary_little_endian 1.0\n"
+#define COUNT_WIDTH 20
+#define MAX_TOKEN_LENGTH 64
+#define INITIAL_LIST_ITEMS 4
+
+static const struct {
+	const char * name;
+	PlyType type;
+} plyTypeNames[] = {
+	{"char", PlyChar}, {"int8", PlyChar},
+	{"uchar", PlyUchar}, {"uint8", PlyUchar},
+	{"short", PlyShort}, {"int16", PlyShort},
+	{"ushort", PlyUshort}, {"uint16", PlyUshort},
+	{"int", PlyInt}, {"int32", PlyInt},
+	{"uint", PlyUint}, {"uint32", PlyUint},
+	{"float", PlyFloat}, {"float32", PlyFloat},
+	{"double", PlyDouble}, {"float64", PlyDouble}
+};
+
+static PlyType parsePlyType(const char * name){
+	for (size_t i = 0; i < sizeof(plyTypeNames) / sizeof(plyTypeNames[0]); i++){
+		if (strcmp(name, plyTypeNames[i].name) == 0){
+			return plyTypeNames[i].type;
+		}
+	}
+	return PlyInvalid;
+}
+
+static const char * plyTypeName(PlyType type){
+	for (size_t i = 0; i < sizeof(plyTypeNames) / sizeof(plyTypeNames[0]); i++){
+		if (plyTypeNames[i].type == type){
+			return plyTypeNames[i].name;
+		}
+	}
+	return "invalid";
+}
+
+size_t plyTypeSize(PlyType type){
+	switch (type){
+		case PlyChar: case PlyUchar: return 1;
+		case PlyShort: case PlyUshort: return 2;
+		case PlyInt: case PlyUint: case PlyFloat: return 4;
+		case PlyDouble: return 8;
+		default: return 0;
+	}
+}
+
+//Copies the next whitespace separated token of a row into token, returning false at the end of the row
+//Rows in mmap mode are not null terminated, so tokens are always bounded by the row length
+static bool nextToken(const char ** position, const char * end, char token[MAX_TOKEN_LENGTH]){
+	while (*position < end && (**position == ' ' || **position == '\t' || **position == '\r' || **position == '\n')){
+		(*position)++;
+	}
+	if (*position == end){
+		return false;
+	}
+
+	size_t length = 0;
+	while (*position < end && **position != ' ' && **position != '\t' && **position != '\r' && **position != '\n'){
+		if (length < MAX_TOKEN_LENGTH - 1){
+			token[length++] = **position;
+		}
+		(*position)++;
+	}
+	token[length] = '\0';
+	return true;
+}
+
+//Stores a number as a little endian value of the given type
+static void storeValue(unsigned char * destination, PlyType type, double value){
+	union {
+		int8_t i8; uint8_t u8; int16_t i16; uint16_t u16; int32_t i32; uint32_t u32; float f32; double f64;
+		unsigned char bytes[8];
+	} converted;
+
+	switch (type){
+		case PlyChar: converted.i8 = (int8_t) value; break;
+		case PlyUchar: converted.u8 = (uint8_t) value; break;
+		case PlyShort: converted.i16 = (int16_t) value; break;
+		case PlyUshort: converted.u16 = (uint16_t) value; break;
+		case PlyInt: converted.i32 = (int32_t) value; break;
+		case PlyUint: converted.u32 = (uint32_t) value; break;
+		case PlyFloat: converted.f32 = (float) value; break;
+		case PlyDouble: converted.f64 = value; break;
+		default: return;
+	}
+
+	size_t size = plyTypeSize(type);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	for (size_t i = 0; i < size; i++){
+		destination[i] = converted.bytes[size - 1 - i];
+	}
+#else
+	memcpy(destination, converted.bytes, size);
+#endif
+}
+
+void initPlySchema(PlySchema * schema){
+	memset(schema, 0, sizeof(PlySchema));
+}
+
+void freePlySchema(PlySchema * schema){
+	for (size_t e = 0; e < schema->elementCount; e++){
+		PlyElement * element = &schema->elements[e];
+		for (size_t p = 0; p < element->propertyCount; p++){
+			free(element->properties[p].name);
+			free(element->properties[p].values);
+			free(element->properties[p].listOffsets);
+		}
+		free(element->properties);
+		free(element->name);
+	}
+	for (size_t i = 0; i < schema->commentCount; i++){
+		free(schema->comments[i]);
+	}
+	free(schema->elements);
+	free(schema->comments);
+	initPlySchema(schema);
+}
+
+void parsePlyHeaderRow(PlySchema * schema, const char * row, size_t length){
+	const char * position = row;
+	const char * end = row + length;
+	char keyword[MAX_TOKEN_LENGTH], first[MAX_TOKEN_LENGTH], second[MAX_TOKEN_LENGTH], third[MAX_TOKEN_LENGTH];
+
+	if (schema->headerComplete || !nextToken(&position, end, keyword)){
+		return;
+	}
+	if (!schema->isPly){
+		schema->isPly = strcmp(keyword, "ply") == 0;
+		return;
+	}
+
+	if (strcmp(keyword, "format") == 0 && nextToken(&position, end, first)){
+		schema->isAscii = strcmp(first, "ascii") == 0;
+	} else if (strcmp(keyword, "comment") == 0 || strcmp(keyword, "obj_info") == 0){
+		while (length > 0 && (row[length - 1] == '\n' || row[length - 1] == '\r')){
+			length--;
+		}
+		schema->comments = realloc(schema->comments, (schema->commentCount + 1) * sizeof(char *));
+		schema->comments[schema->commentCount++] = strndup(row, length);
+	} else if (strcmp(keyword, "element") == 0 && nextToken(&position, end, first) && nextToken(&position, end, second)){
+		schema->elements = realloc(schema->elements, (schema->elementCount + 1) * sizeof(PlyElement));
+		PlyElement * element = &schema->elements[schema->elementCount++];
+		memset(element, 0, sizeof(PlyElement));
+		element->name = strdup(first);
+		element->declaredCount = strtoull(second, NULL, 10);
+	} else if (strcmp(keyword, "property") == 0 && schema->elementCount > 0 && nextToken(&position, end, first) && nextToken(&position, end, second)){
+		PlyElement * element = &schema->elements[schema->elementCount - 1];
+		element->properties = realloc(element->properties, (element->propertyCount + 1) * sizeof(PlyProperty));
+		PlyProperty * property = &element->properties[element->propertyCount++];
+		memset(property, 0, sizeof(PlyProperty));
+
+		if (strcmp(first, "list") == 0 && nextToken(&position, end, third)){
+			property->isList = true;
+			property->countType = parsePlyType(second);
+			property->type = parsePlyType(third);
+			property->name = nextToken(&position, end, first) ? strdup(first) : strdup("");
+		} else {
+			property->type = parsePlyType(first);
+			property->name = strdup(second);
+		}
+	} else if (strcmp(keyword, "end_header") == 0){
+		schema->headerComplete = true;
+	}
+}
+
+bool plySchemaIsConvertible(const PlySchema * schema){
+	if (!schema->isPly || !schema->isAscii || !schema->headerComplete || schema->elementCount == 0){
+		return false;
+	}
+	for (size_t e = 0; e < schema->elementCount; e++){
+		for (size_t p = 0; p < schema->elements[e].propertyCount; p++){
+			PlyProperty * property = &schema->elements[e].properties[p];
+			if (plyTypeSize(property->type) == 0 || (property->isList && plyTypeSize(property->countType) == 0)){
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool allocatePlyColumns(PlySchema * schema){
+	schema->columnsAttempted = true;
+	if (!plySchemaIsConvertible(schema)){
+		return false;
+	}
+
+	// Scalar columns hold exactly the declared number of rows, list items grow as they are parsed
+	for (size_t e = 0; e < schema->elementCount; e++){
+		PlyElement * element = &schema->elements[e];
+		if (element->declaredCount > SIZE_MAX / (INITIAL_LIST_ITEMS * sizeof(double))){
+			return false;
+		}
+		for (size_t p = 0; p < element->propertyCount; p++){
+			PlyProperty * property = &element->properties[p];
+			property->valueCapacity = element->declaredCount * (property->isList ? INITIAL_LIST_ITEMS : 1);
+			property->values = malloc(property->valueCapacity * plyTypeSize(property->type) + 1);
+			if (property->isList){
+				property->listOffsets = malloc((element->declaredCount + 1) * sizeof(size_t));
+			}
+			if (property->values == NULL || (property->isList && property->listOffsets == NULL)){
+				return false;
+			}
+			if (property->isList){
+				property->listOffsets[0] = 0;
+			}
+		}
+	}
+
+	schema->columnsReady = true;
+	return true;
+}
+
+//Parses the next number of a row as a value of the given type into destination
+//A token that is not a number of the type is skipped, so the values after it keep their place
+static bool parseValue(const char ** position, const char * end, PlyType type, unsigned char * destination, double * value){
+	bool parsed;
+
+	if (type == PlyFloat || type == PlyDouble){
+		parsed = parseDecimal(position, end, value);
+	} else {
+		long long integer;
+		if ((parsed = parseInteger(position, end, &integer))){
+			*value = (double) integer;
+		}
+	}
+
+	if (!parsed){
+		while (*position < end && **position != ' ' && **position != '\t' && **position != '\r' && **position != '\n'){
+			(*position)++;
+		}
+		return false;
+	}
+	storeValue(destination, type, *value);
+	return true;
+}
+
+void parsePlyContentRow(PlySchema * schema, const char * row, size_t length){
+	const char * position = row;
+	const char * end = row + length;
+
+	// Rows belong to the first element until its declared count is reached, then to the next one
+	while (schema->currentElement < schema->elementCount
+			&& schema->elements[schema->currentElement].rowCount >= schema->elements[schema->currentElement].declaredCount){
+		schema->currentElement++;
+	}
+	if (schema->currentElement >= schema->elementCount){
+		schema->extraRows++;
+		return;
+	}
+
+	PlyElement * element = &schema->elements[schema->currentElement];
+	size_t rowIndex = element->rowCount++;
+	bool malformed = false;
+
+	for (size_t p = 0; p < element->propertyCount; p++){
+		PlyProperty * property = &element->properties[p];
+		size_t size = plyTypeSize(property->type);
+		double value = 0;
+
+		if (!property->isList){
+			if (!parseValue(&position, end, property->type, property->values + rowIndex * size, &value)){
+				storeValue(property->values + rowIndex * size, property->type, 0);
+				malformed = true;
+			}
+			continue;
+		}
+
+		unsigned char countBytes[8];
+		size_t itemCount = 0;
+		if (parseValue(&position, end, property->countType, countBytes, &value) && value >= 0){
+			itemCount = (size_t) value;
+		} else {
+			malformed = true;
+		}
+
+		if (property->valueCount + itemCount > property->valueCapacity){
+			property->valueCapacity = (property->valueCount + itemCount) * 2;
+			property->values = realloc(property->values, property->valueCapacity * size + 1);
+		}
+		for (size_t i = 0; i < itemCount; i++){
+			if (!parseValue(&position, end, property->type, property->values + (property->valueCount + i) * size, &value)){
+				storeValue(property->values + (property->valueCount + i) * size, property->type, 0);
+				malformed = true;
+			}
+		}
+		property->valueCount += itemCount;
+		property->listOffsets[rowIndex + 1] = property->valueCount;
+	}
+
+	if (malformed){
+		schema->malformedRows++;
+	}
+}
+
+//Makes room for extra bytes at the end of a buffer
+static unsigned char * reserveBytes(PlyBuffer * buffer, size_t extra){
+	if (buffer->length + extra > buffer->capacity){
+		buffer->capacity = (buffer->length + extra) * 2;
+		if ((buffer->data = realloc(buffer->data, buffer->capacity)) == NULL){
+			perror("Error allocating output buffer");
+			exit(EXIT_FAILURE);
+		}
+	}
+	return buffer->data + buffer->length;
+}
+
+const PlyElement * plyElementForRow(const PlySchema * schema, size_t rowIndex){
+	for (size_t e = 0; e < schema->elementCount; e++){
+		if (rowIndex < schema->elements[e].declaredCount){
+			return &schema->elements[e];
+		}
+		rowIndex -= schema->elements[e].declaredCount;
+	}
+	return NULL;
+}
+
+bool encodeBinaryPlyRow(const PlyElement * element, const char * row, size_t length, PlyBuffer * buffer){
+	const char * position = row;
+	const char * end = row + length;
+	bool matched = true;
+	double value;
+
+	// Values that cannot be parsed are written as zero, so the row keeps its place within the element
+	for (size_t p = 0; p < element->propertyCount; p++){
+		PlyProperty * property = &element->properties[p];
+		size_t size = plyTypeSize(property->type);
+
+		if (!property->isList){
+			if (!parseValue(&position, end, property->type, reserveBytes(buffer, size), &value)){
+				storeValue(buffer->data + buffer->length, property->type, 0);
+				matched = false;
+			}
+			buffer->length += size;
+			continue;
+		}
+
+		size_t countSize = plyTypeSize(property->countType);
+		size_t countPosition = buffer->length;
+		size_t itemCount = 0;
+		if (parseValue(&position, end, property->countType, reserveBytes(buffer, countSize), &value) && value >= 0){
+			itemCount = (size_t) value;
+		} else {
+			storeValue(buffer->data + countPosition, property->countType, 0);
+			matched = false;
+		}
+		buffer->length += countSize;
+
+		for (size_t i = 0; i < itemCount; i++){
+			if (!parseValue(&position, end, property->type, reserveBytes(buffer, size), &value)){
+				storeValue(buffer->data + buffer->length, property->type, 0);
+				matched = false;
+			}
+			buffer->length += size;
+		}
+	}
+	return matched;
+}
+
+void encodeBinaryVertex(const float vertex[3], PlyBuffer * buffer){
+	for (int i = 0; i < 3; i++){
+		storeValue(reserveBytes(buffer, sizeof(float)), PlyFloat, vertex[i]);
+		buffer->length += sizeof(float);
+	}
+}
+
+void writeBinaryPlySchemaHeader(FILE * file, PlySchema * schema, long * countPositions){
+	fprintf(file, "ply\n" BINARY_PLY_FORMAT);
+	for (size_t i = 0; i < schema->commentCount; i++){
+		fprintf(file, "%s\n", schema->comments[i]);
+	}
+
+	// Counts are zero padded to a fixed width so that they can be rewritten in place at the end
+	for (size_t e = 0; e < schema->elementCount; e++){
+		PlyElement * element = &schema->elements[e];
+		fprintf(file, "element %s ", element->name);
+		countPositions[e] = ftell(file);
+		fprintf(file, "%0*zu\n", COUNT_WIDTH, (size_t) 0);
+
+		for (size_t p = 0; p < element->propertyCount; p++){
+			PlyProperty * property = &element->properties[p];
+			if (property->isList){
+				fprintf(file, "property list %s %s %s\n", plyTypeName(property->countType), plyTypeName(property->type), property->name);
+			} else {
+				fprintf(file, "property %s %s\n", plyTypeName(property->type), property->name);
+			}
+		}
+	}
+	fprintf(file, "end_header\n");
+}
+
+bool updatePlyCounts(FILE * file, PlySchema * schema, long * countPositions){
+	long end = ftell(file);
+	if (end < 0){
+		return false;
+	}
+	for (size_t e = 0; e < schema->elementCount; e++){
+		if (countPositions[e] < 0 || fseek(file, countPositions[e], SEEK_SET) != 0){
+			return false;
+		}
+		fprintf(file, "%0*zu", COUNT_WIDTH, schema->elements[e].rowCount);
+	}
+	return fseek(file, end, SEEK_SET) == 0;
+}
+
+bool writeBinaryPlyRow(FILE * file, PlySchema * schema, PlyCursor * cursor){
+	while (cursor->element < schema->elementCount && cursor->row >= schema->elements[cursor->element].declaredCount){
+		cursor->element++;
+		cursor->row = 0;
+	}
+	if (cursor->element >= schema->elementCount){
+		return false;
+	}
+
+	PlyElement * element = &schema->elements[cursor->element];
+	for (size_t p = 0; p < element->propertyCount; p++){
+		PlyProperty * property = &element->properties[p];
+		size_t size = plyTypeSize(property->type);
+
+		if (!property->isList){
+			fwrite(property->values + cursor->row * size, size, 1, file);
+			continue;
+		}
+
+		size_t first = property->listOffsets[cursor->row];
+		size_t itemCount = property->listOffsets[cursor->row + 1] - first;
+		unsigned char countBytes[8];
+		storeValue(countBytes, property->countType, (double) itemCount);
+		fwrite(countBytes, plyTypeSize(property->countType), 1, file);
+		fwrite(property->values + first * size, size, itemCount, file);
+	}
+	cursor->row++;
+	return true;
+}
+
+//The vertex count is zero padded to a fixed width so it can be rewritten in place once all rows are converted
+void writeBinaryPlyHeader(FILE * file, size_t vertexCount){
+	fprintf(file, "ply\n" BINARY_PLY_FORMAT "element vertex %0*zu\n", COUNT_WIDTH, vertexCount);
+	fprintf(file, "property float x\nproperty float y\nproperty float z\nend_header\n");
+}
+
+bool updateBinaryPlyVertexCount(FILE * file, size_t vertexCount){
+	long end = ftell(file);
+	if (end < 0 || fseek(file, strlen("ply\n" BINARY_PLY_FORMAT "element vertex "), SEEK_SET) != 0){
+		return false;
+	}
+	fprintf(file, "%0*zu", COUNT_WIDTH, vertexCount);
+	return fseek(file, end, SEEK_SET) == 0;
+}
+
+bool parseVertex(const char * row, size_t length, float vertex[3]){
+	const char * position = row;
+	const char * end = row + length;
+
+	for (int i = 0; i < 3; i++){
+		double value;
+		if (!parseDecimal(&position, end, &value)){
+			return false;
+		}
+		vertex[i] = (float) value;
+	}
+	return true;
+}
+
+void writeBinaryVertex(FILE * file, const float vertex[3]){
+	uint32_t words[3];
+	memcpy(words, vertex, sizeof(words));
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	for (int i = 0; i < 3; i++){
+		words[i] = __builtin_bswap32(words[i]);
+	}
+#endif
+	fwrite(words, sizeof(uint32_t), 3, file);
+}
@@ -0,0 +1,129 @@
+#ifndef PLY_H
+#define PLY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* The scalar types a PLY property can be declared with */
+typedef enum PlyType {
+	PlyInvalid,
+	PlyChar,
+	PlyUchar,
+	PlyShort,
+	PlyUshort,
+	PlyInt,
+	PlyUint,
+	PlyFloat,
+	PlyDouble
+} PlyType;
+
+/* A property of an element, along with the column that holds its value for every row of the element */
+typedef struct PlyProperty {
+	char * name;
+	PlyType type;
+
+	//List properties hold a count of countType, followed by that many values of type
+	bool isList;
+	PlyType countType;
+
+	//Little endian values of type, one per row, or every list item one after another for list properties
+	unsigned char * values;
+	size_t valueCount, valueCapacity;
+
+	//For list properties, the index of the first item of each row in values, with one extra entry at the end
+	size_t * listOffsets;
+} PlyProperty;
+
+/* An element declared by the header, such as vertex or face */
+typedef struct PlyElement {
+	char * name;
+	size_t declaredCount;
+	size_t rowCount;
+	PlyProperty * properties;
+	size_t propertyCount;
+} PlyElement;
+
+/* The structure of a PLY file described by its header, and the typed content parsed using it */
+typedef struct PlySchema {
+	bool isPly;           //The first header row was "ply"
+	bool isAscii;         //Only ascii content can be parsed row by row
+	bool headerComplete;  //end_header has been parsed
+	bool columnsAttempted; //allocatePlyColumns has been called
+	bool columnsReady;    //The columns have been allocated, so content rows can be parsed
+
+	char ** comments;     //comment and obj_info rows, kept for the regenerated header
+	size_t commentCount;
+
+	PlyElement * elements;
+	size_t elementCount;
+
+	size_t currentElement; //Element of the next content row
+	size_t malformedRows;  //Content rows that did not match the properties of their element
+	size_t extraRows;      //Content rows after the last declared row
+} PlySchema;
+
+/* The position of the next row when walking through the rows of a schema in file order */
+typedef struct PlyCursor {
+	size_t element;
+	size_t row;
+} PlyCursor;
+
+/* A growable block of bytes, used to build binary output in memory */
+typedef struct PlyBuffer {
+	unsigned char * data;
+	size_t length, capacity;
+} PlyBuffer;
+
+/* Sets up an empty schema */
+void initPlySchema(PlySchema * schema);
+
+/* Releases the header description and the columns of a schema */
+void freePlySchema(PlySchema * schema);
+
+/* Adds one header row to the schema, rows that are not PLY header rows are ignored */
+void parsePlyHeaderRow(PlySchema * schema, const char * row, size_t length);
+
+/* Returns whether the header was an ascii PLY header whose properties all have known types */
+bool plySchemaIsConvertible(const PlySchema * schema);
+
+/* Allocates the columns of every element from the declared counts, returning false if the schema cannot be used */
+bool allocatePlyColumns(PlySchema * schema);
+
+/* Parses a content row into the columns of the element it belongs to */
+void parsePlyContentRow(PlySchema * schema, const char * row, size_t length);
+
+/* Returns the size in bytes of a PLY type */
+size_t plyTypeSize(PlyType type);
+
+/* Writes the header of the schema in the binary little endian format, with counts that are completed by updatePlyCounts */
+void writeBinaryPlySchemaHeader(FILE * file, PlySchema * schema, long * countPositions);
+
+/* Rewrites the element counts written by writeBinaryPlySchemaHeader with the number of rows parsed for each element */
+bool updatePlyCounts(FILE * file, PlySchema * schema, long * countPositions);
+
+/* Writes the row at the cursor as binary little endian values and moves the cursor on, returning false past the last row */
+bool writeBinaryPlyRow(FILE * file, PlySchema * schema, PlyCursor * cursor);
+
+/* Returns the element that the content row with the given index belongs to, or NULL past the last declared row */
+const PlyElement * plyElementForRow(const PlySchema * schema, size_t rowIndex);
+
+/* Parses a content row of an element straight into binary little endian values at the end of buffer, returning false if the row did not match */
+bool encodeBinaryPlyRow(const PlyElement * element, const char * row, size_t length, PlyBuffer * buffer);
+
+/* Appends a vertex to buffer as three little endian float32 values */
+void encodeBinaryVertex(const float vertex[3], PlyBuffer * buffer);
+
+/* Writes the header of a binary little endian PLY file of x, y, z float vertices */
+void writeBinaryPlyHeader(FILE * file, size_t vertexCount);
+
+/* Rewrites the vertex count in the header written by writeBinaryPlyHeader, returning false if the file cannot seek */
+bool updateBinaryPlyVertexCount(FILE * file, size_t vertexCount);
+
+/* Parses the first three numbers of a row into x, y and z, returning false if the row has fewer than three */
+bool parseVertex(const char * row, size_t length, float vertex[3]);
+
+/* Appends a vertex to the file as three little endian float32 values */
+void writeBinaryVertex(FILE * file, const float vertex[3]);
+
+#endif
@@ -0,0 +1,100 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "ring.h"
+
+//The slots of a shared ring follow it, starting on a cache line of their own
+#define SHARED_RING_HEADER ((sizeof(RowRing) + 63) / 64 * 64)
+
+static void initRing(RowRing * ring, unsigned depth, size_t slotSize, HandoffMode mode){
+	ring->depth = depth;
+	ring->slotSize = slotSize;
+	atomic_init(&ring->head, 0);
+	atomic_init(&ring->tail, 0);
+	atomic_init(&ring->closed, false);
+	ring->fullStalls = 0;
+	ring->emptyStalls = 0;
+
+	if (initHandoff(&ring->slotsFree, mode, depth, ring->shared) || initHandoff(&ring->slotsFilled, mode, 0, ring->shared)){
+		perror("Error initializing ring handoffs");
+		exit(EXIT_FAILURE);
+	}
+}
+
+RowRing * createRing(unsigned depth, size_t slotSize, HandoffMode mode){
+	RowRing * ring = malloc(sizeof(RowRing));
+	if (ring == NULL || (ring->slots = malloc((size_t) depth * slotSize)) == NULL){
+		perror("Error allocating ring");
+		exit(EXIT_FAILURE);
+	}
+	ring->shared = false;
+	initRing(ring, depth, slotSize, mode);
+	return ring;
+}
+
+size_t sharedRingSize(unsigned depth, size_t slotSize){
+	return SHARED_RING_HEADER + (size_t) depth * slotSize;
+}
+
+RowRing * createSharedRing(void * memory, unsigned depth, size_t slotSize, HandoffMode mode){
+	RowRing * ring = memory;
+	ring->slots = (char *) memory + SHARED_RING_HEADER;
+	ring->shared = true;
+	initRing(ring, depth, slotSize, mode);
+	return ring;
+}
+
+void destroyRing(RowRing * ring){
+	destroyHandoff(&ring->slotsFree);
+	destroyHandoff(&ring->slotsFilled);
+	if (!ring->shared){
+		free(ring->slots);
+		free(ring);
+	}
+}
+
+//Takes a token from the handoff without waiting if one is available, counting every time it has to wait
+static void waitForToken(Handoff * handoff, size_t * stalls){
+	if (handoffTryWait(handoff)){ return; }
+
+	(*stalls)++;
+	while (handoffWait(handoff) != 0 && errno == EINTR){ }
+}
+
+void * ringReserve(RowRing * ring){
+	waitForToken(&ring->slotsFree, &ring->fullStalls);
+	size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	return ring->slots + (tail % ring->depth) * ring->slotSize;
+}
+
+void ringCommit(RowRing * ring){
+	atomic_fetch_add_explicit(&ring->tail, 1, memory_order_release);
+	handoffPost(&ring->slotsFilled);
+}
+
+void * ringPeek(RowRing * ring){
+	waitForToken(&ring->slotsFilled, &ring->emptyStalls);
+	size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+	//The token was posted by ringClose, put it back so that every later peek also sees the end
+	if (atomic_load_explicit(&ring->closed, memory_order_acquire) && head == atomic_load_explicit(&ring->tail, memory_order_acquire)){
+		handoffPost(&ring->slotsFilled);
+		return NULL;
+	}
+	return ring->slots + (head % ring->depth) * ring->slotSize;
+}
+
+bool ringReady(RowRing * ring){
+	return atomic_load_explicit(&ring->head, memory_order_relaxed) != atomic_load_explicit(&ring->tail, memory_order_acquire)
+		|| atomic_load_explicit(&ring->closed, memory_order_acquire);
+}
+
+void ringRelease(RowRing * ring){
+	atomic_fetch_add_explicit(&ring->head, 1, memory_order_release);
+	handoffPost(&ring->slotsFree);
+}
+
+void ringClose(RowRing * ring){
+	atomic_store_explicit(&ring->closed, true, memory_order_release);
+	handoffPost(&ring->slotsFilled);
+}
@@ -0,0 +1,58 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "handoff.h"
+
+/* A bounded single producer, single consumer ring of fixed size slots */
+typedef struct RowRing {
+	unsigned depth;
+	size_t slotSize;
+	char * slots;
+	bool shared; //Laid out in memory shared between processes by createSharedRing, rather than allocated
+
+	//Only the consumer advances head and only the producer advances tail
+	atomic_size_t head, tail;
+	atomic_bool closed;
+
+	//Count the free and filled slots so that a stage only sleeps when it cannot make progress
+	Handoff slotsFree, slotsFilled;
+
+	//Number of times the producer found the ring full and the consumer found it empty
+	size_t fullStalls, emptyStalls;
+} RowRing;
+
+/* Allocates a ring with depth slots of slotSize bytes each, whose stages wait on each other through handoffs of the given mode */
+RowRing * createRing(unsigned depth, size_t slotSize, HandoffMode mode);
+
+/* Returns the bytes of shared memory a ring of depth slots of slotSize bytes takes, with its slots behind it */
+size_t sharedRingSize(unsigned depth, size_t slotSize);
+
+/* Lays a ring out in sharedRingSize bytes of memory shared with other processes, whose stages wait on each other
+   through process shared handoffs. The slots are found by address, so every process must see memory at the same address */
+RowRing * createSharedRing(void * memory, unsigned depth, size_t slotSize, HandoffMode mode);
+
+/* Releases the slots and handoffs of a ring, leaving the memory of a shared ring to its owner */
+void destroyRing(RowRing * ring);
+
+/* Waits for a free slot and returns it to the producer without publishing it */
+void * ringReserve(RowRing * ring);
+
+/* Publishes the slot returned by the last ringReserve to the consumer */
+void ringCommit(RowRing * ring);
+
+/* Waits for a filled slot and returns it, or returns NULL once the ring is closed and drained */
+void * ringPeek(RowRing * ring);
+
+/* Returns whether ringPeek would return straight away, with a filled slot or the end of the ring */
+bool ringReady(RowRing * ring);
+
+/* Hands the slot returned by the last ringPeek back to the producer */
+void ringRelease(RowRing * ring);
+
+/* Marks the end of the stream, the consumer drains the remaining slots and then sees NULL */
+void ringClose(RowRing * ring);
+
+#endif
@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include <string.h>
+#include "row_pool.h"
+
+//Buffers start at the size of the fixed rows they replace, and double whenever a longer line arrives
+#define INITIAL_ROW_CAPACITY 1024
+
+RowPool * createRowPool(){
+	RowPool * pool = calloc(1, sizeof(RowPool));
+	if (pool == NULL || pthread_mutex_init(&pool->lock, NULL) != 0){
+		perror("Error allocating row pool");
+		exit(EXIT_FAILURE);
+	}
+	return pool;
+}
+
+void destroyRowPool(RowPool * pool){
+	PooledRow * row = pool->allRows;
+	while (row != NULL){
+		PooledRow * next = row->nextRow;
+		free(row->data);
+		free(row);
+		row = next;
+	}
+	pthread_mutex_destroy(&pool->lock);
+	free(pool);
+}
+
+PooledRow * acquireRow(RowPool * pool){
+	pthread_mutex_lock(&pool->lock);
+	PooledRow * row = pool->freeRows;
+	if (row != NULL){
+		pool->freeRows = row->nextFree;
+		pool->reused++;
+		pthread_mutex_unlock(&pool->lock);
+		row->length = 0;
+		return row;
+	}
+
+	// Only a handful of rows are ever in flight, so new rows are rare after the first few
+	if ((row = calloc(1, sizeof(PooledRow))) == NULL || (row->data = malloc(INITIAL_ROW_CAPACITY)) == NULL){
+		perror("Error allocating pooled row");
+		exit(EXIT_FAILURE);
+	}
+	row->capacity = INITIAL_ROW_CAPACITY;
+	row->nextRow = pool->allRows;
+	pool->allRows = row;
+	pool->created++;
+	pthread_mutex_unlock(&pool->lock);
+	return row;
+}
+
+void releaseRow(RowPool * pool, PooledRow * row){
+	pthread_mutex_lock(&pool->lock);
+	if (row->length > pool->largestRow){
+		pool->largestRow = row->length;
+	}
+	row->nextFree = pool->freeRows;
+	pool->freeRows = row;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+//Makes room for extra bytes and a null terminator at the end of a row
+static void growRow(PooledRow * row, size_t extra){
+	if (row->length + extra + 1 <= row->capacity){
+		return;
+	}
+	while (row->length + extra + 1 > row->capacity){
+		row->capacity *= 2;
+	}
+	if ((row->data = realloc(row->data, row->capacity)) == NULL){
+		perror("Error growing pooled row");
+		exit(EXIT_FAILURE);
+	}
+}
+
+void setPooledRow(PooledRow * row, const char * text, size_t length){
+	row->length = 0;
+	growRow(row, length);
+	memcpy(row->data, text, length);
+	row->length = length;
+	row->data[length] = '\0';
+}
+
+void continuePooledRow(PooledRow * row, FILE * file){
+	// Each fgets fills the free space of the buffer, which is doubled until the newline fits
+	while (row->length == 0 || row->data[row->length - 1] != '\n'){
+		growRow(row, INITIAL_ROW_CAPACITY / 2);
+		if (fgets(row->data + row->length, row->capacity - row->length, file) == NULL){
+			return;
+		}
+		row->length += strlen(row->data + row->length);
+	}
+}
+
+bool readPooledRow(PooledRow * row, FILE * file){
+	row->length = 0;
+	continuePooledRow(row, file);
+	return row->length > 0;
+}
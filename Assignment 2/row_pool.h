@@ -0,0 +1,51 @@
+#ifndef ROW_POOL_H
+#define ROW_POOL_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* A row of any length, held in a buffer that goes back to its pool to be reused instead of being freed */
+typedef struct PooledRow {
+	char * data;
+	size_t length;
+	size_t capacity;
+
+	struct PooledRow * nextFree; //Links the rows waiting in the pool
+	struct PooledRow * nextRow;  //Links every row the pool has created, so that none are lost
+} PooledRow;
+
+/* A set of row buffers shared by the stages, whose ownership is passed between them by pointer */
+typedef struct RowPool {
+	pthread_mutex_t lock;
+	PooledRow * freeRows;
+	PooledRow * allRows;
+
+	size_t created;   //Rows allocated over the life of the pool
+	size_t reused;    //Times a released row was handed out again
+	size_t largestRow;
+} RowPool;
+
+/* Allocates an empty pool */
+RowPool * createRowPool();
+
+/* Frees every row the pool has created, including any that were never released */
+void destroyRowPool(RowPool * pool);
+
+/* Takes a row from the pool, or creates one when every row is in use */
+PooledRow * acquireRow(RowPool * pool);
+
+/* Gives a row back to the pool once its last owner is done with it */
+void releaseRow(RowPool * pool, PooledRow * row);
+
+/* Reads the next line of file into row, however long it is, returning false at the end of the file */
+bool readPooledRow(PooledRow * row, FILE * file);
+
+/* Copies text into row, replacing what it held */
+void setPooledRow(PooledRow * row, const char * text, size_t length);
+
+/* Reads the rest of the current line of file onto the end of row */
+void continuePooledRow(PooledRow * row, FILE * file);
+
+#endif
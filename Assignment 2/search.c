@@ -0,0 +1,129 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <string.h>
+#include "search.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+typedef const char * (*SearchFunction)(const char *, size_t, const char *, size_t);
+
+static SearchFunction chosenSearch;
+static const char * chosenSearchName;
+static pthread_once_t chooseSearchOnce = PTHREAD_ONCE_INIT;
+
+const char * findSubstringScalar(const char * haystack, size_t haystackLength, const char * needle, size_t needleLength){
+	return memmem(haystack, haystackLength, needle, needleLength);
+}
+
+/*
+	Both vector versions compare a block of haystack positions at once against the first and the last
+	byte of the needle, each broadcast to a whole register. Only positions where both bytes match are
+	compared in full, which skips almost every position of the rows seen in practice.
+	Needles of one byte are left to memchr, and the tail that is shorter than a block goes to memmem.
+*/
+
+#ifdef HAVE_X86_SIMD
+__attribute__((target("sse2")))
+const char * findSubstringSse2(const char * haystack, size_t haystackLength, const char * needle, size_t needleLength){
+	if (needleLength < 2 || haystackLength < needleLength + 16){
+		return findSubstringScalar(haystack, haystackLength, needle, needleLength);
+	}
+
+	const __m128i first = _mm_set1_epi8(needle[0]);
+	const __m128i last = _mm_set1_epi8(needle[needleLength - 1]);
+	size_t i = 0;
+
+	for (; i + needleLength - 1 + 16 <= haystackLength; i += 16){
+		__m128i blockFirst = _mm_loadu_si128((const __m128i *) (haystack + i));
+		__m128i blockLast = _mm_loadu_si128((const __m128i *) (haystack + i + needleLength - 1));
+		unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, blockFirst), _mm_cmpeq_epi8(last, blockLast)));
+
+		while (mask != 0){
+			unsigned bit = __builtin_ctz(mask);
+			if (memcmp(haystack + i + bit + 1, needle + 1, needleLength - 2) == 0){
+				return haystack + i + bit;
+			}
+			mask &= mask - 1;
+		}
+	}
+	return findSubstringScalar(haystack + i, haystackLength - i, needle, needleLength);
+}
+
+__attribute__((target("avx2")))
+const char * findSubstringAvx2(const char * haystack, size_t haystackLength, const char * needle, size_t needleLength){
+	if (needleLength < 2 || haystackLength < needleLength + 32){
+		return findSubstringSse2(haystack, haystackLength, needle, needleLength);
+	}
+
+	const __m256i first = _mm256_set1_epi8(needle[0]);
+	const __m256i last = _mm256_set1_epi8(needle[needleLength - 1]);
+	size_t i = 0;
+
+	for (; i + needleLength - 1 + 32 <= haystackLength; i += 32){
+		__m256i blockFirst = _mm256_loadu_si256((const __m256i *) (haystack + i));
+		__m256i blockLast = _mm256_loadu_si256((const __m256i *) (haystack + i + needleLength - 1));
+		unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, blockFirst), _mm256_cmpeq_epi8(last, blockLast)));
+
+		while (mask != 0){
+			unsigned bit = __builtin_ctz(mask);
+			if (memcmp(haystack + i + bit + 1, needle + 1, needleLength - 2) == 0){
+				return haystack + i + bit;
+			}
+			mask &= mask - 1;
+		}
+	}
+	return findSubstringSse2(haystack + i, haystackLength - i, needle, needleLength);
+}
+
+bool cpuSupportsSse2(){
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+}
+
+bool cpuSupportsAvx2(){
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+}
+#else
+const char * findSubstringSse2(const char * haystack, size_t haystackLength, const char * needle, size_t needleLength){
+	return findSubstringScalar(haystack, haystackLength, needle, needleLength);
+}
+
+const char * findSubstringAvx2(const char * haystack, size_t haystackLength, const char * needle, size_t needleLength){
+	return findSubstringScalar(haystack, haystackLength, needle, needleLength);
+}
+
+bool cpuSupportsSse2(){
+	return false;
+}
+
+bool cpuSupportsAvx2(){
+	return false;
+}
+#endif
+
+static void chooseSearch(){
+	if (cpuSupportsAvx2()){
+		chosenSearch = findSubstringAvx2;
+		chosenSearchName = "avx2";
+	} else if (cpuSupportsSse2()){
+		chosenSearch = findSubstringSse2;
+		chosenSearchName = "sse2";
+	} else {
+		chosenSearch = findSubstringScalar;
+		chosenSearchName = "memmem";
+	}
+}
+
+const char * findSubstring(const char * haystack, size_t haystackLength, const char * needle, size_t needleLength){
+	pthread_once(&chooseSearchOnce, chooseSearch);
+	return chosenSearch(haystack, haystackLength, needle, needleLength);
+}
+
+const char * substringSearchName(){
+	pthread_once(&chooseSearchOnce, chooseSearch);
+	return chosenSearchName;
+}
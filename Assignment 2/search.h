@@ -0,0 +1,22 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Finds the first occurrence of needle in haystack, or returns NULL. Neither needs to be null terminated */
+const char * findSubstring(const char * haystack, size_t haystackLength, const char * needle, size_t needleLength);
+
+/* Returns the name of the implementation chosen for this CPU by findSubstring */
+const char * substringSearchName();
+
+/* The implementations behind findSubstring, exposed so that they can be benchmarked against each other */
+const char * findSubstringScalar(const char * haystack, size_t haystackLength, const char * needle, size_t needleLength);
+const char * findSubstringSse2(const char * haystack, size_t haystackLength, const char * needle, size_t needleLength);
+const char * findSubstringAvx2(const char * haystack, size_t haystackLength, const char * needle, size_t needleLength);
+
+/* Whether the running CPU can execute findSubstringSse2 and findSubstringAvx2 */
+bool cpuSupportsSse2();
+bool cpuSupportsAvx2();
+
+#endif
@@ -0,0 +1,41 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "shared_memory.h"
+
+void * mapSharedMemory(const char * purpose, size_t size){
+	static unsigned created = 0;
+	char name[64];
+	snprintf(name, sizeof(name), "/ply_strip.%d.%s.%u", (int) getpid(), purpose, created++);
+
+	int descriptor = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (descriptor < 0){
+		fprintf(stderr, "Error creating the shared memory object %s: %s\n", name, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	shm_unlink(name);
+
+	void * memory = MAP_FAILED;
+	if (ftruncate(descriptor, size) == 0){
+		memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+	}
+	if (memory == MAP_FAILED){
+		fprintf(stderr, "Error mapping %zu bytes of shared memory for the %s: %s\n", size, purpose, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+
+	// The mapping stays valid after the descriptor is closed
+	close(descriptor);
+	return memory;
+}
+
+void unmapSharedMemory(void * memory, size_t size){
+	if (munmap(memory, size) != 0){
+		perror("Error unmapping shared memory");
+	}
+}
@@ -0,0 +1,14 @@
+#ifndef SHARED_MEMORY_H
+#define SHARED_MEMORY_H
+
+#include <stddef.h>
+
+/* Maps size zeroed bytes of a POSIX shared memory object, named after purpose and the process. The name is removed
+   again straight away, so nothing is left behind in /dev/shm however the program ends. Processes forked after the
+   mapping share it at the same address, so it may hold pointers into itself. Exits after printing the problem */
+void * mapSharedMemory(const char * purpose, size_t size);
+
+/* Unmaps memory returned by mapSharedMemory, the object is freed once every process has unmapped it */
+void unmapSharedMemory(void * memory, size_t size);
+
+#endif
@@ -0,0 +1,210 @@
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "stage_metrics.h"
+
+static pthread_mutex_t registryLock = PTHREAD_MUTEX_INITIALIZER;
+static PipelineMetrics * registeredRuns = NULL;
+static sem_t reportRequested;
+static FILE * reportFile = NULL;
+
+static void initStage(StageMetrics * stage, const char * name){
+	stage->name = name;
+	atomic_init(&stage->rows, 0);
+	atomic_init(&stage->bytes, 0);
+	atomic_init(&stage->blockedNanos, 0);
+	atomic_init(&stage->workNanos, 0);
+	for (int i = 0; i < LATENCY_BUCKETS; i++){
+		atomic_init(&stage->latency[i], 0);
+	}
+}
+
+void initPipelineMetrics(PipelineMetrics * metrics, const char * label){
+	metrics->label = label;
+	metrics->stageCount = 0;
+	metrics->startNanos = metricsNow();
+	metrics->next = NULL;
+}
+
+StageMetrics * addStageMetrics(PipelineMetrics * metrics, const char * name){
+	if (metrics->stageCount == MAX_STAGE_METRICS){
+		fprintf(stderr, "Error: more than %d stages to gather metrics for\n", MAX_STAGE_METRICS);
+		exit(EXIT_FAILURE);
+	}
+	StageMetrics * stage = &metrics->stages[metrics->stageCount++];
+	initStage(stage, name);
+	return stage;
+}
+
+void registerPipelineMetrics(PipelineMetrics * metrics){
+	pthread_mutex_lock(&registryLock);
+	metrics->next = registeredRuns;
+	registeredRuns = metrics;
+	pthread_mutex_unlock(&registryLock);
+}
+
+void unregisterPipelineMetrics(PipelineMetrics * metrics){
+	pthread_mutex_lock(&registryLock);
+	for (PipelineMetrics ** link = &registeredRuns; *link != NULL; link = &(*link)->next){
+		if (*link == metrics){
+			*link = metrics->next;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&registryLock);
+}
+
+uint64_t metricsNow(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+uint64_t recordBlocked(StageMetrics * stage, uint64_t waitStart){
+	uint64_t now = metricsNow();
+	atomic_fetch_add_explicit(&stage->blockedNanos, now - waitStart, memory_order_relaxed);
+	return now;
+}
+
+//Returns the histogram bucket of a latency, the position of its highest set bit
+static int latencyBucket(uint64_t nanos){
+	int bucket = nanos > 0 ? 63 - __builtin_clzll(nanos) : 0;
+	return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+uint64_t recordWork(StageMetrics * stage, size_t rows, size_t bytes, uint64_t workStart){
+	uint64_t now = metricsNow();
+	uint64_t elapsed = now - workStart;
+
+	// A batch is timed as a whole, so each of its rows is counted with the average time of the batch
+	atomic_fetch_add_explicit(&stage->rows, rows, memory_order_relaxed);
+	atomic_fetch_add_explicit(&stage->bytes, bytes, memory_order_relaxed);
+	atomic_fetch_add_explicit(&stage->workNanos, elapsed, memory_order_relaxed);
+	if (rows > 0){
+		atomic_fetch_add_explicit(&stage->latency[latencyBucket(elapsed / rows)], rows, memory_order_relaxed);
+	}
+	return now;
+}
+
+//Prints a number of nanoseconds with a unit that keeps it short
+static void printDuration(FILE * file, uint64_t nanos){
+	if (nanos < 1000){
+		fprintf(file, "%lluns", (unsigned long long) nanos);
+	} else if (nanos < 1000000){
+		fprintf(file, "%.0fus", nanos / 1e3);
+	} else if (nanos < 1000000000){
+		fprintf(file, "%.0fms", nanos / 1e6);
+	} else {
+		fprintf(file, "%.0fs", nanos / 1e9);
+	}
+}
+
+//Returns the upper bound of the bucket that holds the given share of the rows
+static uint64_t latencyPercentile(size_t counts[LATENCY_BUCKETS], size_t rows, double share){
+	size_t seen = 0;
+	for (int i = 0; i < LATENCY_BUCKETS; i++){
+		seen += counts[i];
+		if (seen > 0 && seen >= share * rows){
+			return 2ull << i;
+		}
+	}
+	return 2ull << (LATENCY_BUCKETS - 1);
+}
+
+static void printStage(FILE * file, StageMetrics * stage, int nameWidth){
+	size_t rows = atomic_load_explicit(&stage->rows, memory_order_relaxed);
+	size_t bytes = atomic_load_explicit(&stage->bytes, memory_order_relaxed);
+	uint64_t blocked = atomic_load_explicit(&stage->blockedNanos, memory_order_relaxed);
+	uint64_t work = atomic_load_explicit(&stage->workNanos, memory_order_relaxed);
+	size_t counts[LATENCY_BUCKETS];
+	for (int i = 0; i < LATENCY_BUCKETS; i++){
+		counts[i] = atomic_load_explicit(&stage->latency[i], memory_order_relaxed);
+	}
+
+	fprintf(file, "  %-*s %zu rows, %.2f MB, working %.3f s, blocked %.3f s (%.0f%% of its time)", nameWidth, stage->name, rows, bytes / 1e6,
+		work / 1e9, blocked / 1e9, blocked + work > 0 ? 100.0 * blocked / (blocked + work) : 0);
+	if (rows == 0){
+		fprintf(file, "\n");
+		return;
+	}
+	fprintf(file, ", p50 < ");
+	printDuration(file, latencyPercentile(counts, rows, 0.5));
+	fprintf(file, ", p99 < ");
+	printDuration(file, latencyPercentile(counts, rows, 0.99));
+	fprintf(file, ", p99.9 < ");
+	printDuration(file, latencyPercentile(counts, rows, 0.999));
+	fprintf(file, ", max < ");
+	printDuration(file, latencyPercentile(counts, rows, 1.0));
+	fprintf(file, " per row\n  %-*s", nameWidth, "");
+	for (int i = 0; i < LATENCY_BUCKETS; i++){
+		if (counts[i] > 0){
+			fprintf(file, " <");
+			printDuration(file, 2ull << i);
+			fprintf(file, ": %zu", counts[i]);
+		}
+	}
+	fprintf(file, "\n");
+}
+
+void printPipelineMetrics(FILE * file, PipelineMetrics * metrics){
+	fprintf(file, "Stage metrics of %s after %.3f s:\n", metrics->label, (metricsNow() - metrics->startNanos) / 1e9);
+	int nameWidth = 9;
+	for (unsigned s = 0; s < metrics->stageCount; s++){
+		int length = strlen(metrics->stages[s].name);
+		nameWidth = length > nameWidth ? length : nameWidth;
+	}
+	for (unsigned s = 0; s < metrics->stageCount; s++){
+		printStage(file, &metrics->stages[s], nameWidth);
+	}
+}
+
+//Prints a report of every registered run each time one is requested
+static void *MetricsReporter(void * params){
+	(void) params;
+	while (true){
+		while (sem_wait(&reportRequested) != 0 && errno == EINTR){ }
+
+		pthread_mutex_lock(&registryLock);
+		if (registeredRuns == NULL){
+			fprintf(reportFile, "No pipeline is running\n");
+		}
+		for (PipelineMetrics * metrics = registeredRuns; metrics != NULL; metrics = metrics->next){
+			printPipelineMetrics(reportFile, metrics);
+		}
+		fflush(reportFile);
+		pthread_mutex_unlock(&registryLock);
+	}
+	return NULL;
+}
+
+void startMetricsReporter(FILE * file){
+	pthread_t reporterThreadID;
+	sigset_t signals, previous;
+
+	reportFile = file;
+	if (sem_init(&reportRequested, 0, 0) != 0){
+		perror("Error initializing metrics semaphore");
+		exit(EXIT_FAILURE);
+	}
+
+	// The reporter never takes the signals itself, so they reach a thread that is not in the middle of a report
+	sigfillset(&signals);
+	pthread_sigmask(SIG_BLOCK, &signals, &previous);
+	if (pthread_create(&reporterThreadID, NULL, MetricsReporter, NULL) != 0){
+		perror("Error creating metrics reporter thread");
+		exit(EXIT_FAILURE);
+	}
+	pthread_sigmask(SIG_SETMASK, &previous, NULL);
+	pthread_detach(reporterThreadID);
+}
+
+void requestMetricsReport(){
+	if (reportFile != NULL){
+		sem_post(&reportRequested);
+	}
+}
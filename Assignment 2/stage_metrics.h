@@ -0,0 +1,59 @@
+#ifndef STAGE_METRICS_H
+#define STAGE_METRICS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+//Latency bucket i holds the rows that took from 2^i up to 2^(i + 1) nanoseconds
+#define LATENCY_BUCKETS 40
+#define MAX_STAGE_METRICS 8
+
+/* What one stage of the pipeline has done so far, updated as it runs so that it can be read at any time */
+typedef struct StageMetrics {
+	const char * name;
+	atomic_size_t rows;
+	atomic_size_t bytes;
+	atomic_uint_fast64_t blockedNanos; //Time spent waiting on the neighbouring stages
+	atomic_uint_fast64_t workNanos;    //Time spent on the rows themselves
+	atomic_size_t latency[LATENCY_BUCKETS];
+} StageMetrics;
+
+/* The metrics of every stage of one run, linked into the list that a report covers */
+typedef struct PipelineMetrics {
+	const char * label;
+	StageMetrics stages[MAX_STAGE_METRICS]; //One for each thread, or each group of threads running the same stages
+	unsigned stageCount;
+	uint64_t startNanos;
+	struct PipelineMetrics * next;
+} PipelineMetrics;
+
+/* Sets up empty metrics for a run, labelled with its input file */
+void initPipelineMetrics(PipelineMetrics * metrics, const char * label);
+
+/* Adds a stage to the metrics of a run before the run is registered, returning the counters it updates */
+StageMetrics * addStageMetrics(PipelineMetrics * metrics, const char * name);
+
+/* Adds a run to the ones covered by reports, until it is removed */
+void registerPipelineMetrics(PipelineMetrics * metrics);
+void unregisterPipelineMetrics(PipelineMetrics * metrics);
+
+/* Returns a monotonic time in nanoseconds */
+uint64_t metricsNow();
+
+/* Adds the time since a stage started waiting to its blocked time, returning the current time */
+uint64_t recordBlocked(StageMetrics * stage, uint64_t waitStart);
+
+/* Adds rows a stage has finished since workStart to its counters, returning the current time */
+uint64_t recordWork(StageMetrics * stage, size_t rows, size_t bytes, uint64_t workStart);
+
+/* Prints the counters, the share of time spent blocked and the latency histogram of every stage of a run */
+void printPipelineMetrics(FILE * file, PipelineMetrics * metrics);
+
+/* Starts the thread that prints a report of every registered run to file whenever one is requested */
+void startMetricsReporter(FILE * file);
+
+/* Asks the reporter thread for a report, safe to call from a signal handler */
+void requestMetricsReport();
+
+#endif
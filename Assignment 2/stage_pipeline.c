@@ -0,0 +1,601 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "shared_memory.h"
+#include "stage_pipeline.h"
+
+#define PROCESS_STOP_POLL_NANOS 10000000 //How often a stage process waiting for its workers looks for SIGTERM
+#define NO_TAKER ((unsigned) -1)         //Taken by a worker that found the end of the stream instead of a slot
+
+static atomic_bool stopRequested; //Set by SIGTERM in a stage process
+
+/* One thread of a group, with the states of the stages it runs */
+typedef struct StageWorker {
+	StagePipeline * pipeline;
+	unsigned group;
+	unsigned index;
+	void * states[MAX_PIPELINE_STAGES];
+	unsigned initialised;
+	void * scratch; //The slot of a group with no ring on either side
+} StageWorker;
+
+/* The slots an unordered group has taken from its input ring, in stream order. This is the reorder buffer of the group after it:
+   slot i of the stream was taken by the worker at takers[i % capacity], and waits at the head of that worker's output ring */
+typedef struct StageDispatch {
+	pthread_mutex_t takeLock; //Held by the worker taking the next slot, so the slots are taken one at a time and in order
+	Handoff taken;            //One token for every entry of takers, waited on by the group after
+	size_t takenCount;        //Only changed under takeLock
+	unsigned capacity;        //A slot is only taken into a reserved output slot, so no more than the slots of the output rings are waiting
+	unsigned takers[];
+} StageDispatch;
+
+static const StageType * findStageType(const char * name, size_t length, const StageType * types, size_t typeCount){
+	for (size_t t = 0; t < typeCount; t++){
+		if (strlen(types[t].name) == length && strncmp(types[t].name, name, length) == 0){
+			return &types[t];
+		}
+	}
+	return NULL;
+}
+
+bool parseStagePlan(StagePlan * plan, const char * spec, const StageType * types, size_t typeCount){
+	memset(plan, 0, sizeof(StagePlan));
+	const char * position = spec;
+
+	while (true){
+		if (plan->groupCount == MAX_PIPELINE_STAGES){
+			fprintf(stderr, "The stage plan %s has more than %d groups\n", spec, MAX_PIPELINE_STAGES);
+			return false;
+		}
+		StageGroup * group = &plan->groups[plan->groupCount++];
+		group->workers = 1;
+
+		// The stages fused onto the group's threads, separated by +
+		while (true){
+			size_t length = strcspn(position, "+*%,");
+			const StageType * type = findStageType(position, length, types, typeCount);
+			if (type == NULL){
+				fprintf(stderr, "Unknown stage \"%.*s\" in the stage plan %s, the stages are", (int) length, position, spec);
+				for (size_t t = 0; t < typeCount; t++){
+					fprintf(stderr, " %s%s", types[t].name, t + 1 < typeCount ? "," : "\n");
+				}
+				return false;
+			}
+			if (findPlanStage(plan, type->name) >= 0){
+				fprintf(stderr, "The stage %s is given twice in the stage plan %s\n", type->name, spec);
+				return false;
+			}
+			group->stages[group->stageCount++] = type;
+			position += length;
+			if (*position != '+'){
+				break;
+			}
+			position++;
+		}
+
+		if (*position == '*' || *position == '%'){
+			char * end;
+			group->unordered = *position == '%';
+			long workers = strtol(position + 1, &end, 10);
+			if (end == position + 1 || workers < 1 || workers > MAX_STAGE_WORKERS){
+				fprintf(stderr, "The workers of a group in the stage plan %s must be between 1 and %d\n", spec, MAX_STAGE_WORKERS);
+				return false;
+			}
+			group->workers = workers;
+			position = end;
+		}
+		if (*position == ','){
+			position++;
+			continue;
+		}
+		if (*position != '\0'){
+			fprintf(stderr, "Unexpected \"%c\" in the stage plan %s, stages are joined by + and groups by , with *N or %%N at the end of a group\n", *position, spec);
+			return false;
+		}
+		break;
+	}
+
+	for (unsigned g = 0; g < plan->groupCount; g++){
+		StageGroup * group = &plan->groups[g];
+		size_t used = 0;
+		for (unsigned s = 0; s < group->stageCount; s++){
+			const StageType * type = group->stages[s];
+			bool first = g == 0 && s == 0;
+			bool last = g + 1 == plan->groupCount && s + 1 == group->stageCount;
+			if ((type->role == StageSource) != first || (type->role == StageSink) != last){
+				fprintf(stderr, "The stage %s cannot come %s in the stage plan %s, which starts with a source and ends with a sink\n",
+					type->name, first ? "first" : last ? "last" : "in the middle", spec);
+				return false;
+			}
+			// A stage that carries state from one slot to the next would see them out of order on several workers
+			if ((group->workers > 1 || group->unordered) && !type->parallel){
+				fprintf(stderr, "The stage %s in the stage plan %s keeps its state from one batch to the next, so it runs on a single worker\n",
+					type->name, spec);
+				return false;
+			}
+			used += snprintf(group->name + used, MAX_GROUP_NAME - used, "%s%s", s > 0 ? "+" : "", type->name);
+			used = used < MAX_GROUP_NAME ? used : MAX_GROUP_NAME - 1;
+		}
+		if (group->workers > 1 || group->unordered){
+			snprintf(group->name + used, MAX_GROUP_NAME - used, "%c%u", group->unordered ? '%' : '*', group->workers);
+		}
+	}
+
+	// The group before hands each slot to whichever unordered worker is free, and the group after takes them back in stream order
+	for (unsigned g = 0; g < plan->groupCount; g++){
+		const StageGroup * before = g > 0 ? &plan->groups[g - 1] : NULL;
+		const StageGroup * after = g + 1 < plan->groupCount ? &plan->groups[g + 1] : NULL;
+		if (plan->groups[g].unordered && (before == NULL || after == NULL || before->workers > 1 || after->workers > 1
+				|| before->unordered || after->unordered)){
+			fprintf(stderr, "The unordered group %s in the stage plan %s needs a group of a single ordered worker on either side\n",
+				plan->groups[g].name, spec);
+			return false;
+		}
+	}
+	return true;
+}
+
+int findPlanStage(const StagePlan * plan, const char * name){
+	int position = 0;
+	for (unsigned g = 0; g < plan->groupCount; g++){
+		for (unsigned s = 0; s < plan->groups[g].stageCount; s++, position++){
+			if (strcmp(plan->groups[g].stages[s]->name, name) == 0){
+				return position;
+			}
+		}
+	}
+	return -1;
+}
+
+//Returns the number of rings of the link after a group, one for every pair of workers, or one for the producer of an unordered group
+static size_t linkRings(const StagePlan * plan, unsigned link){
+	if (plan->groups[link + 1].unordered){
+		return plan->groups[link].workers;
+	}
+	return (size_t) plan->groups[link].workers * plan->groups[link + 1].workers;
+}
+
+//Returns the bytes of the dispatch of an unordered group, rounded up to a cache line so the rings after it stay aligned
+static size_t dispatchSize(const StagePipeline * pipeline, unsigned group){
+	size_t capacity = (size_t) pipeline->plan->groups[group].workers * pipeline->depth;
+	return (offsetof(StageDispatch, takers) + capacity * sizeof(unsigned) + 63) / 64 * 64;
+}
+
+//Runs the idle callbacks of a worker's stages before it sleeps waiting for its next slot
+static void idleWorker(StageWorker * worker){
+	const StageGroup * group = &worker->pipeline->plan->groups[worker->group];
+	for (unsigned s = 0; s < group->stageCount; s++){
+		if (group->stages[s]->idle != NULL){
+			group->stages[s]->idle(worker->states[s]);
+		}
+	}
+}
+
+static void unlockDispatch(void * params){
+	StageDispatch * dispatch = params;
+	pthread_mutex_unlock(&dispatch->takeLock);
+}
+
+//Takes the next slot of the input ring a worker of an unordered group shares, copying it into the output slot the worker
+//has reserved, and records the worker as its taker. Returns false at the end of the stream
+static bool takeSlot(StageWorker * worker, RowRing * input, void * slot){
+	StagePipeline * pipeline = worker->pipeline;
+	StageDispatch * dispatch = pipeline->dispatch[worker->group];
+	volatile bool taken = false; //Set between the setjmp of the cleanup handler and the return
+
+	pthread_mutex_lock(&dispatch->takeLock);
+	pthread_cleanup_push(unlockDispatch, dispatch);
+	void * inputSlot = ringPeek(input);
+	if (inputSlot != NULL){
+		pipeline->copySlot(pipeline->context, slot, inputSlot);
+		ringRelease(input);
+		taken = true;
+	}
+	dispatch->takers[dispatch->takenCount++ % dispatch->capacity] = taken ? worker->index : NO_TAKER;
+	handoffPost(&dispatch->taken);
+	pthread_cleanup_pop(1);
+	return taken;
+}
+
+//Waits until a worker of the unordered group before has taken slot sequence of the stream, and returns the ring the slot
+//comes through once that worker is done with it, or NULL at the end of the stream
+static RowRing * takenRing(StageWorker * worker, RowRing ** inputs, size_t sequence){
+	StageDispatch * dispatch = worker->pipeline->dispatch[worker->group - 1];
+	if (!handoffTryWait(&dispatch->taken)){
+		idleWorker(worker);
+		while (handoffWait(&dispatch->taken) != 0 && errno == EINTR){ }
+	}
+	unsigned taker = dispatch->takers[sequence % dispatch->capacity];
+	return taker == NO_TAKER ? NULL : inputs[taker];
+}
+
+//Runs the flush callbacks of the stages a worker has initialised, at its end or when it is cancelled
+static void flushWorker(void * params){
+	StageWorker * worker = params;
+	const StageGroup * group = &worker->pipeline->plan->groups[worker->group];
+	for (unsigned s = 0; s < worker->initialised; s++){
+		if (group->stages[s]->flush != NULL){
+			group->stages[s]->flush(worker->states[s]);
+		}
+	}
+	worker->initialised = 0;
+}
+
+//Hands the slots of the stream through the stages of a worker until the stream ends, then closes the rings it fills.
+//Kept apart from the cancellation cleanup of the thread, so its locals are never live across the setjmp behind it
+static void runWorker(StageWorker * worker){
+	StagePipeline * pipeline = worker->pipeline;
+	const StagePlan * plan = pipeline->plan;
+	const StageGroup * group = &plan->groups[worker->group];
+	unsigned g = worker->group;
+
+	// Slot i goes through ring i % (producers * consumers) of a link, whose only producer is worker i % producers
+	// and only consumer is worker i % consumers. An unordered group has a single input ring, and an output ring for each worker
+	RowRing ** inputs = g > 0 ? pipeline->links[g - 1] : NULL;
+	RowRing ** outputs = g + 1 < plan->groupCount ? pipeline->links[g] : NULL;
+	size_t inputRings = g > 0 ? linkRings(plan, g - 1) : 0;
+	size_t outputRings = outputs != NULL ? linkRings(plan, g) : 0;
+	bool reorder = g > 0 && plan->groups[g - 1].unordered;
+
+	StageMetrics * metrics = pipeline->metrics[g];
+	uint64_t waitStart = metricsNow();
+	for (size_t sequence = worker->index; ; sequence += group->workers){
+		RowRing * input = inputs != NULL ? inputs[sequence % inputRings] : NULL;
+		RowRing * output = outputs != NULL ? outputs[sequence % outputRings] : NULL;
+		if (reorder && (input = takenRing(worker, inputs, sequence)) == NULL){
+			break;
+		}
+
+		void * inputSlot = NULL;
+		void * slot;
+		uint64_t workStart;
+		if (group->unordered){
+			// The output slot is reserved first, so no worker holds the input ring while it waits on the group after
+			slot = ringReserve(output);
+			if (!takeSlot(worker, input, slot)){
+				break;
+			}
+			workStart = recordBlocked(metrics, waitStart);
+		} else {
+			if (input != NULL){
+				if (!ringReady(input)){
+					idleWorker(worker);
+				}
+				if ((inputSlot = ringPeek(input)) == NULL){
+					break;
+				}
+			}
+			slot = output != NULL ? ringReserve(output) : inputSlot != NULL ? inputSlot : worker->scratch;
+			workStart = recordBlocked(metrics, waitStart);
+			if (inputSlot != NULL && output != NULL){
+				pipeline->copySlot(pipeline->context, slot, inputSlot);
+			}
+		}
+
+		// Only a source ends the stream, every other stage handles each slot it is handed
+		bool more = true;
+		for (unsigned s = 0; s < group->stageCount && more; s++){
+			more = group->stages[s]->process(worker->states[s], slot);
+		}
+		if (!more){
+			break;
+		}
+
+		size_t rows, bytes;
+		pipeline->measureSlot(pipeline->context, slot, &rows, &bytes);
+		waitStart = recordWork(metrics, rows, bytes, workStart);
+		if (output != NULL){
+			ringCommit(output);
+		}
+		if (inputSlot != NULL){
+			ringRelease(input);
+		}
+	}
+
+	// Every ring this worker fills is closed, so each worker of the next group finds the end at its next slot
+	for (size_t r = worker->index; r < outputRings; r += group->workers){
+		ringClose(outputs[r]);
+	}
+}
+
+static void *StageWorkerThread(void * params){
+	StageWorker * worker = params;
+	const StageGroup * group = &worker->pipeline->plan->groups[worker->group];
+
+	pthread_cleanup_push(flushWorker, worker);
+	for (unsigned s = 0; s < group->stageCount; s++){
+		worker->states[s] = group->stages[s]->init(worker->pipeline->context, worker->index);
+		worker->initialised++;
+	}
+	runWorker(worker);
+	pthread_cleanup_pop(1);
+	return NULL;
+}
+
+//Returns the number of the first thread of a group, counting the workers of every group before it
+static unsigned firstWorker(const StagePlan * plan, unsigned group){
+	unsigned thread = 0;
+	for (unsigned g = 0; g < group; g++){
+		thread += plan->groups[g].workers;
+	}
+	return thread;
+}
+
+//Creates the rings between the groups, allocated or in one block of shared memory, and the workers of every group
+static void preparePipeline(StagePipeline * pipeline, bool shared){
+	const StagePlan * plan = pipeline->plan;
+	size_t ringSize = sharedRingSize(pipeline->depth, pipeline->slotSize);
+
+	pipeline->threadCount = firstWorker(plan, plan->groupCount);
+	pipeline->sharedSize = 0;
+	for (unsigned g = 0; g + 1 < plan->groupCount; g++){
+		pipeline->sharedSize += linkRings(plan, g) * ringSize + (plan->groups[g].unordered ? dispatchSize(pipeline, g) : 0);
+	}
+	pipeline->sharedRings = shared && pipeline->sharedSize > 0 ? mapSharedMemory("rings", pipeline->sharedSize) : NULL;
+
+	char * nextRing = pipeline->sharedRings;
+	for (unsigned g = 0; g < plan->groupCount; g++){
+		pipeline->dispatch[g] = NULL;
+		if (!plan->groups[g].unordered){
+			continue;
+		}
+		if (shared){
+			pipeline->dispatch[g] = (StageDispatch *) nextRing;
+			nextRing += dispatchSize(pipeline, g);
+		} else if ((pipeline->dispatch[g] = malloc(dispatchSize(pipeline, g))) == NULL){
+			perror("Error allocating a stage dispatch");
+			exit(EXIT_FAILURE);
+		}
+
+		// The workers of an unordered group run in the same process, but the group after may not
+		StageDispatch * dispatch = pipeline->dispatch[g];
+		pthread_mutexattr_t attributes;
+		pthread_mutexattr_init(&attributes);
+		pthread_mutexattr_setpshared(&attributes, shared ? PTHREAD_PROCESS_SHARED : PTHREAD_PROCESS_PRIVATE);
+		pthread_mutex_init(&dispatch->takeLock, &attributes);
+		pthread_mutexattr_destroy(&attributes);
+		dispatch->takenCount = 0;
+		dispatch->capacity = plan->groups[g].workers * pipeline->depth;
+		if (initHandoff(&dispatch->taken, pipeline->handoffMode, 0, shared)){
+			perror("Error initializing a stage dispatch handoff");
+			exit(EXIT_FAILURE);
+		}
+	}
+	for (unsigned g = 0; g + 1 < plan->groupCount; g++){
+		size_t rings = linkRings(plan, g);
+		if ((pipeline->links[g] = malloc(rings * sizeof(RowRing *))) == NULL){
+			perror("Error allocating stage rings");
+			exit(EXIT_FAILURE);
+		}
+		for (size_t r = 0; r < rings; r++){
+			if (shared){
+				pipeline->links[g][r] = createSharedRing(nextRing, pipeline->depth, pipeline->slotSize, pipeline->handoffMode);
+				nextRing += ringSize;
+			} else {
+				pipeline->links[g][r] = createRing(pipeline->depth, pipeline->slotSize, pipeline->handoffMode);
+			}
+		}
+	}
+
+	pipeline->workers = calloc(pipeline->threadCount, sizeof(StageWorker));
+	pipeline->threads = calloc(pipeline->threadCount, sizeof(pthread_t));
+	if (pipeline->workers == NULL || pipeline->threads == NULL){
+		perror("Error allocating stage workers");
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void startGroup(StagePipeline * pipeline, unsigned group){
+	const StagePlan * plan = pipeline->plan;
+	unsigned thread = firstWorker(plan, group);
+	for (unsigned w = 0; w < plan->groups[group].workers; w++, thread++){
+		StageWorker * worker = &pipeline->workers[thread];
+		worker->pipeline = pipeline;
+		worker->group = group;
+		worker->index = w;
+		if (plan->groupCount == 1 && (worker->scratch = malloc(pipeline->slotSize)) == NULL){
+			perror("Error allocating stage slot");
+			exit(EXIT_FAILURE);
+		}
+		int result = createPlacedThread(pipeline->placement, thread, &pipeline->threads[thread], StageWorkerThread, worker);
+		if (result != 0){
+			fprintf(stderr, "Error creating a worker of the %s stage: %s\n", plan->groups[group].name, strerror(result));
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+void startStagePipeline(StagePipeline * pipeline){
+	preparePipeline(pipeline, false);
+	for (unsigned g = 0; g < pipeline->plan->groupCount; g++){
+		startGroup(pipeline, g);
+	}
+}
+
+void joinStagePipeline(StagePipeline * pipeline){
+	for (unsigned t = 0; t < pipeline->threadCount; t++){
+		if (pthread_join(pipeline->threads[t], NULL) != 0){
+			fprintf(stderr, "Error joining a worker of the %s stage\n", pipeline->plan->groups[pipeline->workers[t].group].name);
+		}
+	}
+}
+
+static void handleStop(int signalNumber){
+	atomic_store(&stopRequested, true);
+}
+
+//The body of a stage process, which runs the workers of one group and exits once they are done
+static void runStageProcess(StagePipeline * pipeline, unsigned group){
+	const StageGroup * stageGroup = &pipeline->plan->groups[group];
+	if (pipeline->lockMemory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0){
+		fprintf(stderr, "Could not lock the memory of the %s stage process: %s\n", stageGroup->name, strerror(errno));
+	}
+
+	// The workers start with SIGTERM blocked, so only this thread takes it, and cancels the workers it has not joined yet
+	struct sigaction stop;
+	memset(&stop, 0, sizeof(stop));
+	stop.sa_handler = handleStop;
+	sigemptyset(&stop.sa_mask);
+	sigaction(SIGTERM, &stop, NULL);
+	sigset_t terminate;
+	sigemptyset(&terminate);
+	sigaddset(&terminate, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &terminate, NULL);
+	startGroup(pipeline, group);
+	pthread_sigmask(SIG_UNBLOCK, &terminate, NULL);
+
+	pthread_t * threads = &pipeline->threads[firstWorker(pipeline->plan, group)];
+	bool cancelled = false;
+	for (unsigned w = 0; w < stageGroup->workers; w++){
+		while (true){
+			struct timespec deadline;
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			long nanoseconds = deadline.tv_nsec + PROCESS_STOP_POLL_NANOS;
+			deadline.tv_sec += nanoseconds / 1000000000;
+			deadline.tv_nsec = nanoseconds % 1000000000;
+			if (pthread_timedjoin_np(threads[w], NULL, &deadline) != ETIMEDOUT){
+				break;
+			}
+			if (atomic_load(&stopRequested) && !cancelled){
+				for (unsigned c = w; c < stageGroup->workers; c++){
+					pthread_cancel(threads[c]);
+				}
+				cancelled = true;
+			}
+		}
+	}
+
+	// Only the files the stages opened are flushed, the exit handlers belong to the process that forked this one
+	fflush(NULL);
+	_exit(EXIT_SUCCESS);
+}
+
+void startStageProcesses(StagePipeline * pipeline){
+	const StagePlan * plan = pipeline->plan;
+	preparePipeline(pipeline, true);
+
+	// Output buffered before the fork would be written again by every process
+	fflush(NULL);
+	pipeline->processCount = 0;
+	for (unsigned g = 0; g < plan->groupCount; g++){
+		pid_t process = fork();
+		if (process < 0){
+			fprintf(stderr, "Error starting a process for the %s stage: %s\n", plan->groups[g].name, strerror(errno));
+			stopStageProcesses(pipeline);
+			exit(EXIT_FAILURE);
+		}
+		if (process == 0){
+			runStageProcess(pipeline, g);
+		}
+		pipeline->processes[pipeline->processCount++] = process;
+	}
+}
+
+bool waitStageProcesses(StagePipeline * pipeline){
+	const StagePlan * plan = pipeline->plan;
+	bool succeeded = true;
+	for (unsigned remaining = pipeline->processCount; remaining > 0; ){
+		int status;
+		pid_t process = waitpid(-1, &status, 0);
+		if (process < 0){
+			if (errno == EINTR){
+				continue;
+			}
+			perror("Error waiting for the stage processes");
+			return false;
+		}
+
+		for (unsigned g = 0; g < pipeline->processCount; g++){
+			if (pipeline->processes[g] != process){
+				continue;
+			}
+			remaining--;
+			if (WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS){
+				break;
+			}
+
+			// The stages on either side would wait on their rings for ever, so the rest of the pipeline is stopped
+			if (WIFSIGNALED(status)){
+				fprintf(stderr, "The %s stage process was killed by signal %d (%s)\n", plan->groups[g].name, WTERMSIG(status), strsignal(WTERMSIG(status)));
+			} else {
+				fprintf(stderr, "The %s stage process exited with status %d\n", plan->groups[g].name, WEXITSTATUS(status));
+			}
+			if (succeeded){
+				stopStageProcesses(pipeline);
+			}
+			succeeded = false;
+		}
+	}
+	return succeeded;
+}
+
+void stopStageProcesses(StagePipeline * pipeline){
+	for (unsigned g = 0; g < pipeline->processCount; g++){
+		kill(pipeline->processes[g], SIGTERM);
+	}
+}
+
+void stageLinkStalls(StagePipeline * pipeline, unsigned group, size_t * fullStalls, size_t * emptyStalls){
+	size_t rings = linkRings(pipeline->plan, group);
+	*fullStalls = 0;
+	*emptyStalls = 0;
+	for (size_t r = 0; r < rings; r++){
+		*fullStalls += pipeline->links[group][r]->fullStalls;
+		*emptyStalls += pipeline->links[group][r]->emptyStalls;
+	}
+}
+
+void stageHandoffStats(StagePipeline * pipeline, HandoffStats * total){
+	const StagePlan * plan = pipeline->plan;
+	for (unsigned g = 0; g + 1 < plan->groupCount; g++){
+		size_t rings = linkRings(plan, g);
+		for (size_t r = 0; r < rings; r++){
+			addHandoffStats(total, &pipeline->links[g][r]->slotsFree);
+			addHandoffStats(total, &pipeline->links[g][r]->slotsFilled);
+		}
+		if (pipeline->dispatch[g] != NULL){
+			addHandoffStats(total, &pipeline->dispatch[g]->taken);
+		}
+	}
+}
+
+void destroyStagePipeline(StagePipeline * pipeline){
+	const StagePlan * plan = pipeline->plan;
+	for (unsigned g = 0; g + 1 < plan->groupCount; g++){
+		size_t rings = linkRings(plan, g);
+		for (size_t r = 0; r < rings; r++){
+			destroyRing(pipeline->links[g][r]);
+		}
+		free(pipeline->links[g]);
+		pipeline->links[g] = NULL;
+		if (pipeline->dispatch[g] != NULL){
+			destroyHandoff(&pipeline->dispatch[g]->taken);
+			pthread_mutex_destroy(&pipeline->dispatch[g]->takeLock);
+			if (pipeline->sharedRings == NULL){
+				free(pipeline->dispatch[g]);
+			}
+			pipeline->dispatch[g] = NULL;
+		}
+	}
+	if (pipeline->sharedRings != NULL){
+		unmapSharedMemory(pipeline->sharedRings, pipeline->sharedSize);
+		pipeline->sharedRings = NULL;
+	}
+	for (unsigned t = 0; t < pipeline->threadCount; t++){
+		free(pipeline->workers[t].scratch);
+	}
+	free(pipeline->workers);
+	free(pipeline->threads);
+	pipeline->workers = NULL;
+	pipeline->threads = NULL;
+	pipeline->threadCount = 0;
+}
@@ -0,0 +1,114 @@
+#ifndef STAGE_PIPELINE_H
+#define STAGE_PIPELINE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "ring.h"
+#include "stage_metrics.h"
+#include "thread_placement.h"
+
+#define MAX_PIPELINE_STAGES 8 //Stages of a plan, and groups of fused stages
+#define MAX_STAGE_WORKERS 64
+#define MAX_GROUP_NAME 64
+
+/* Where a stage sits in the pipeline */
+typedef enum StageRole {
+	StageSource,    //Fills each slot, always the first stage
+	StageTransform, //Changes the slots it is handed in place
+	StageSink       //Consumes the slots, always the last stage
+} StageRole;
+
+/* The callbacks of one kind of stage. Every worker running a stage has a state of its own, made by init on the worker's thread */
+typedef struct StageType {
+	const char * name;
+	StageRole role;
+	bool parallel; //Each slot can be handled apart from the others, so the stage may run on several workers
+	void * (*init)(void * context, unsigned worker);
+	bool (*process)(void * state, void * slot); //A source returns false once it has nothing more, the others return true
+	void (*idle)(void * state);  //Optional, called before the worker sleeps waiting for its next slot
+	void (*flush)(void * state); //Optional, called at the end of the stream or when the worker is cancelled, and frees the state
+} StageType;
+
+/* Stages fused onto the same threads, which hand each slot from one stage to the next without a ring */
+typedef struct StageGroup {
+	const StageType * stages[MAX_PIPELINE_STAGES];
+	unsigned stageCount;
+	unsigned workers;
+	bool unordered; //The workers take the next slot whichever of them is free, and the group after them puts the slots back in order
+	char name[MAX_GROUP_NAME];
+} StageGroup;
+
+/* The groups of a pipeline in order, connected by rings. A zeroed plan has no groups */
+typedef struct StagePlan {
+	StageGroup groups[MAX_PIPELINE_STAGES];
+	unsigned groupCount;
+} StagePlan;
+
+/* A running plan. Slot i of the stream is handled by worker i % workers of every group, and the rings between two groups
+   hold one ring for each pair of their workers, so every ring has a single producer and consumer and the order is kept.
+   The workers of an unordered group share a single ring from the group before instead, taking its slots in turn whenever
+   they are free, and each fills a ring of its own to the group after, which takes the slots from them in stream order */
+typedef struct StagePipeline {
+	const StagePlan * plan;
+	void * context; //Handed to the init callbacks
+	unsigned depth;
+	size_t slotSize;
+	void (*copySlot)(void * context, void * to, void * from); //Copies the part of a slot in use into a slot of the next ring
+	void (*measureSlot)(void * context, void * slot, size_t * rows, size_t * bytes);
+	const ThreadPlacement * placement; //The CPUs and scheduling of the threads, numbered in the order of the groups
+	HandoffMode handoffMode; //How the stages wait on the rings between them
+	bool lockMemory; //Locks the memory of every stage process again, fork does not pass the locks on
+	StageMetrics * metrics[MAX_PIPELINE_STAGES]; //One for each group, shared by its workers, in shared memory for processes
+
+	//Set up by startStagePipeline
+	RowRing ** links[MAX_PIPELINE_STAGES]; //links[g] connects group g to group g + 1
+	struct StageDispatch * dispatch[MAX_PIPELINE_STAGES]; //How the workers of an unordered group g take their slots, NULL for the others
+	struct StageWorker * workers;
+	pthread_t * threads; //The threads of every group in order, so the source is first
+	unsigned threadCount;
+
+	//Set up by startStageProcesses, which lays the rings out in shared memory
+	pid_t processes[MAX_PIPELINE_STAGES]; //The process of each group, so the source is first
+	unsigned processCount;
+	void * sharedRings;
+	size_t sharedSize;
+} StagePipeline;
+
+/* Parses a plan such as "read,strip+parse,filter*4,write", where a comma starts a new group, + fuses a stage onto the
+   threads of the stage before it and *N runs a group on N workers. %N runs it on N unordered workers instead, which
+   need a single worker in the groups on either side. Returns false after printing the problem */
+bool parseStagePlan(StagePlan * plan, const char * spec, const StageType * types, size_t typeCount);
+
+/* Returns the position of a stage in the plan, counting the stages of every group in order, or -1 when it is not used */
+int findPlanStage(const StagePlan * plan, const char * name);
+
+/* Creates the rings and starts a thread for every worker of every group */
+void startStagePipeline(StagePipeline * pipeline);
+
+/* Waits for every worker to finish */
+void joinStagePipeline(StagePipeline * pipeline);
+
+/* Forks a process for every group, which runs the workers of the group and exits once they are done. The rings are
+   created in shared memory first, and everything else the stages use is inherited from this process at the same address,
+   so the context must not change afterwards unless it is in shared memory too. SIGTERM cancels the workers of a stage
+   process like cancelling the threads of a single process, so their flush callbacks still run */
+void startStageProcesses(StagePipeline * pipeline);
+
+/* Waits for every stage process to exit. When one fails, the others are stopped, and false is returned after printing how */
+bool waitStageProcesses(StagePipeline * pipeline);
+
+/* Sends SIGTERM to every stage process */
+void stopStageProcesses(StagePipeline * pipeline);
+
+/* Adds up how often the producers found the rings after a group full, and the consumers found them empty */
+void stageLinkStalls(StagePipeline * pipeline, unsigned group, size_t * fullStalls, size_t * emptyStalls);
+
+/* Adds up what the waits of the stages on every ring cost */
+void stageHandoffStats(StagePipeline * pipeline, HandoffStats * total);
+
+/* Releases the rings and the workers of a pipeline that was joined */
+void destroyStagePipeline(StagePipeline * pipeline);
+
+#endif
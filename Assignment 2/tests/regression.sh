@@ -0,0 +1,190 @@
+#!/bin/sh
+# Runs main over small generated inputs in the modes that once got them wrong, and compares each output with the expected one
+# Usage: tests/regression.sh
+# Prints a line per case and exits with the number of cases that failed
+
+cd "$(dirname "$0")/.." || exit 1
+make -s main || exit 1
+
+WORK=$(mktemp -d /tmp/regression.XXXXXX)
+trap 'rm -rf "$WORK"' EXIT
+FAILED=0
+
+# check <name> <input> <expected output> <main options>...
+check() {
+  NAME=$1
+  INPUT=$2
+  EXPECTED=$3
+  shift 3
+  ./main "$@" "$INPUT" "$WORK/out" 2>"$WORK/err"
+  STATUS=$?
+  if [ "$STATUS" -eq 0 ] && cmp -s "$WORK/out" "$EXPECTED"; then
+    echo "ok      $NAME"
+  else
+    echo "FAILED  $NAME (exit status $STATUS)"
+    FAILED=$((FAILED + 1))
+  fi
+}
+
+# A header with rows longer than the free space of a batch slot, which are held in pooled rows apart from the rest of the batch
+{
+  echo ply
+  echo format ascii 1.0
+  printf 'comment %3000s\n' "" | tr ' ' a
+  echo element vertex 300
+  printf 'comment %5000s\n' "" | tr ' ' b
+  echo property float x
+  echo property float y
+  echo property float z
+  echo end_header
+} > "$WORK/long_header.ply"
+awk 'BEGIN { for (i = 0; i < 300; i++) printf "%d.5 -%d.25 %d\n", i % 7, i % 5, i }' > "$WORK/long_header.txt"
+cat "$WORK/long_header.txt" >> "$WORK/long_header.ply"
+# The unordered workers of --processors search for the end of the header in each batch on their own
+for MODE in "--batch-rows 3 --batch-bytes 1500" "--batch-bytes 2000" "--batch-bytes 100" "--io-uring --batch-bytes 500" "--mmap --batch-bytes 100" \
+    "--processors 2 --batch-bytes 1000" "--processors 3 --batch-bytes 100" "--processors 2 --processes --batch-bytes 100"; do
+  # shellcheck disable=SC2086
+  check "long header rows, $MODE" "$WORK/long_header.ply" "$WORK/long_header.txt" $MODE
+done
+
+# --where reads the first numbers of each row when a PLY header declares no vertex element, and the vertex properties when it does
+awk 'BEGIN { for (i = 0; i < 2000; i++) printf "%d %d.5 -%d\n", i % 3 - 1, i, i }' > "$WORK/coordinates.txt"
+awk '$1 > -1' "$WORK/coordinates.txt" > "$WORK/where_x.txt"
+awk '$3 > -100' "$WORK/coordinates.txt" > "$WORK/where_vertex.txt"
+{ printf 'ply\nend_header\n'; cat "$WORK/coordinates.txt"; } > "$WORK/no_elements.ply"
+{ printf 'ply\nformat ascii 1.0\nelement face 2000\nproperty float a\nproperty float b\nproperty float c\nend_header\n'; cat "$WORK/coordinates.txt"; } > "$WORK/no_vertex.ply"
+{ printf 'ply\nformat ascii 1.0\nelement vertex 2000\nproperty float z\nproperty float y\nproperty float x\nend_header\n'; cat "$WORK/coordinates.txt"; } > "$WORK/vertex.ply"
+check "--where without element lines" "$WORK/no_elements.ply" "$WORK/where_x.txt" --where "x > -1"
+check "--where without a vertex element" "$WORK/no_vertex.ply" "$WORK/where_x.txt" --where "x > -1"
+check "--where with a vertex element" "$WORK/vertex.ply" "$WORK/where_vertex.txt" --where "x > -100"
+
+# io_uring names an offset for every read and write, so a FIFO on either side goes through stdio instead, and nothing is lost
+awk 'BEGIN { print "ply"; print "end_header"; for (i = 0; i < 200000; i++) printf "%d.125 %d -%d.5\n", i % 9, i, i }' > "$WORK/fifo.ply"
+tail -n +3 "$WORK/fifo.ply" > "$WORK/fifo.txt"
+mkfifo "$WORK/fifo_in" "$WORK/fifo_out"
+cat "$WORK/fifo.ply" > "$WORK/fifo_in" &
+check "--io-uring from a FIFO" "$WORK/fifo_in" "$WORK/fifo.txt" --io-uring
+cat "$WORK/fifo_out" > "$WORK/fifo_out.txt" &
+READER=$!
+./main --io-uring --batch-bytes 65536 "$WORK/fifo.ply" "$WORK/fifo_out" 2>"$WORK/err"
+STATUS=$?
+wait "$READER"
+if [ "$STATUS" -eq 0 ] && cmp -s "$WORK/fifo_out.txt" "$WORK/fifo.txt"; then
+  echo "ok      --io-uring to a FIFO"
+else
+  echo "FAILED  --io-uring to a FIFO (exit status $STATUS)"
+  FAILED=$((FAILED + 1))
+fi
+
+# check_stats <name> <input> <coordinates> <main options>...
+# Compares the vertex line of --stats with the one awk computes from the x, y and z columns of coordinates, in the same order and format
+check_stats() {
+  NAME=$1
+  INPUT=$2
+  COORDINATES=$3
+  shift 3
+  awk '{
+    for (i = 1; i <= 3; i++) {
+      v = $i + 0
+      if (NR == 1 || v < min[i]) min[i] = v
+      if (NR == 1 || v > max[i]) max[i] = v
+      sum[i] += v
+    }
+  } END {
+    printf "%d vertices, min (%g, %g, %g), max (%g, %g, %g), mean (%g, %g, %g)\n", NR,
+      min[1], min[2], min[3], max[1], max[2], max[3], sum[1] / NR, sum[2] / NR, sum[3] / NR
+  }' "$COORDINATES" > "$WORK/stats_expected"
+  ./main --stats "$@" "$INPUT" "$WORK/out" 2>"$WORK/err"
+  STATUS=$?
+  grep ' vertices, min ' "$WORK/err" > "$WORK/stats_out"
+  if [ "$STATUS" -eq 0 ] && cmp -s "$WORK/stats_out" "$WORK/stats_expected"; then
+    echo "ok      $NAME"
+  else
+    echo "FAILED  $NAME (exit status $STATUS)"
+    FAILED=$((FAILED + 1))
+  fi
+}
+
+# vertex_ply <rows> writes a PLY of the x y z rows to stdout
+vertex_ply() {
+  printf 'ply\nformat ascii 1.0\nelement vertex %d\nproperty double x\nproperty double y\nproperty double z\nend_header\n' "$(wc -l < "$1")"
+  cat "$1"
+}
+
+# --stats parses the coordinates itself, so each of these must come out as the strtod of awk has them
+cat > "$WORK/exponents.txt" <<'EOF'
+1.5e3 -2E-2 1e+22
+-7.25e-5 3e0 1e-320
+1e400 -1E400 6.02214076e23
+0.5e1 12.5e-1 -1e-22
+EOF
+vertex_ply "$WORK/exponents.txt" > "$WORK/exponents.ply"
+check_stats "--stats with exponents" "$WORK/exponents.ply" "$WORK/exponents.txt"
+
+cat > "$WORK/long_mantissas.txt" <<'EOF'
+3.14159265358979323846264338327950288 -2.71828182845904523536028747135266249 123456789012345678901234567890.5
+0.0000000000000000000001234567890123456789012 1.41421356237309504880168872420969807e10 -98765432109876543210.98765432109876543210e-15
+99999999999999999999999999999999999999 0.99999999999999999999999999999 -0.00000000000000000000000000000000000000000001
+EOF
+vertex_ply "$WORK/long_mantissas.txt" > "$WORK/long_mantissas.ply"
+check_stats "--stats with more than 19 mantissa digits" "$WORK/long_mantissas.ply" "$WORK/long_mantissas.txt"
+
+cat > "$WORK/inf_nan.txt" <<'EOF'
+1 2 3
+inf -4 5
+-6 -inf 7
+8 nan -INF
+-Inf 9 NaN
+EOF
+vertex_ply "$WORK/inf_nan.txt" > "$WORK/inf_nan.ply"
+check_stats "--stats with inf and nan" "$WORK/inf_nan.ply" "$WORK/inf_nan.txt"
+
+cat > "$WORK/int64.txt" <<'EOF'
+9223372036854775807 -9223372036854775808 18446744073709551615
+9223372036854775808 -9223372036854775809 18446744073709551616
+-99999999999999999999 123456789012345678901 1
+EOF
+vertex_ply "$WORK/int64.txt" > "$WORK/int64.ply"
+check_stats "--stats past the range of int64" "$WORK/int64.ply" "$WORK/int64.txt"
+
+# List properties in front of the coordinates are stepped over by their item count, and the rows of other elements are not vertices
+awk 'BEGIN { for (i = 0; i < 500; i++) printf "%d.5 -%d.25 %de-2\n", i % 11, i % 13, i }' > "$WORK/list_coordinates.txt"
+{
+  printf 'ply\nformat ascii 1.0\nelement vertex 500\nproperty list uchar int indices\nproperty float nx\nproperty list uchar float weights\n'
+  printf 'property float x\nproperty float y\nproperty float z\nelement face 20\nproperty list uchar int vertex_indices\nend_header\n'
+  awk '{ n = NR % 4; printf "%d", n; for (i = 0; i < n; i++) printf " %d", NR + i; printf " 0.5 %d", n + 1; for (i = 0; i <= n; i++) printf " %d.75", i; print " " $0 }' "$WORK/list_coordinates.txt"
+  awk 'BEGIN { for (i = 0; i < 20; i++) printf "3 %d 1e9 -1e9\n", i }'
+} > "$WORK/lists.ply"
+check_stats "--stats with list properties before x y z" "$WORK/lists.ply" "$WORK/list_coordinates.txt"
+check_stats "--stats with list properties before x y z, --processors 2" "$WORK/lists.ply" "$WORK/list_coordinates.txt" --processors 2 --batch-bytes 1000
+
+# The automaton of the patterns must report every pattern ending at a state, also those that overlap, or are a prefix or suffix of another one
+# Rows of a small alphabet hold many such matches, and grep -F finds the rows that contain them
+awk 'BEGIN { srand(17); for (i = 0; i < 3000; i++) { row = ""; for (j = 0; j < 14; j++) row = row substr("abc", int(rand() * 3) + 1, 1); print row } }' > "$WORK/letters.txt"
+{ printf 'ply\nend_header\n'; cat "$WORK/letters.txt"; } > "$WORK/letters.ply"
+# The patterns of grep -F are one per line, while main takes an option per pattern
+printf 'abcab\nbcabca\nbcab\n' > "$WORK/drop_patterns"
+grep -v -F -f "$WORK/drop_patterns" "$WORK/letters.txt" > "$WORK/dropped.txt"
+check "--drop of patterns that overlap and end in one another" "$WORK/letters.ply" "$WORK/dropped.txt" --drop abcab --drop bcabca --drop bcab
+printf 'caac\ncaacb\nacbba\naacbb\n' > "$WORK/select_patterns"
+grep -F -f "$WORK/select_patterns" "$WORK/letters.txt" > "$WORK/selected.txt"
+check "--select of patterns that are prefixes of one another" "$WORK/letters.ply" "$WORK/selected.txt" --select caac --select caacb --select acbba --select aacbb
+# A row can hold a --select pattern within a --drop one, or the other way around, and is kept only when no --drop pattern is in it
+printf 'ccab\nbcc\n' > "$WORK/select_patterns"
+printf 'bccab\nabcc\ncca\n' > "$WORK/drop_patterns"
+grep -F -f "$WORK/select_patterns" "$WORK/letters.txt" | grep -v -F -f "$WORK/drop_patterns" > "$WORK/filtered.txt"
+for MODE in "--batch-bytes 4096" "--processors 2 --batch-bytes 300"; do
+  # shellcheck disable=SC2086
+  check "--select and --drop patterns within one another, $MODE" "$WORK/letters.ply" "$WORK/filtered.txt" \
+    --select ccab --select bcc --drop bccab --drop abcc --drop cca $MODE
+done
+
+# The header ends at the first row that contains one of the terminators, the same row grep -F finds first
+awk 'BEGIN { srand(5); print "ply"; for (i = 0; i < 400; i++) { row = "comment "; for (j = 0; j < 6; j++) row = row substr("xyz", int(rand() * 3) + 1, 1); print row } }' > "$WORK/terminated.ply"
+cat "$WORK/letters.txt" >> "$WORK/terminated.ply"
+printf 'xyzzyx\nzzyxz\nyxzz\n' > "$WORK/terminator_patterns"
+HEADER_END=$(grep -n -m 1 -F -f "$WORK/terminator_patterns" "$WORK/terminated.ply" | cut -d : -f 1)
+tail -n +"$((HEADER_END + 1))" "$WORK/terminated.ply" > "$WORK/terminated.txt"
+check "--terminator patterns that overlap and end in one another" "$WORK/terminated.ply" "$WORK/terminated.txt" --terminator xyzzyx --terminator zzyxz --terminator yxzz
+
+exit "$FAILED"
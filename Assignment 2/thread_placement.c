@@ -0,0 +1,185 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "thread_placement.h"
+
+static atomic_bool refused = false;
+
+bool parseNumberList(const char * list, const char * name, bool ranges, int ** values, size_t * count){
+	const char * position = list;
+	*values = NULL;
+	*count = 0;
+
+	while (true){
+		char * end;
+		long first = strtol(position, &end, 10);
+		long last = first;
+		if (end == position || first < 0 || first > 1000000){
+			break;
+		}
+		position = end;
+		if (ranges && *position == '-'){
+			last = strtol(position + 1, &end, 10);
+			if (end == position + 1 || last < first || last > 1000000){
+				break;
+			}
+			position = end;
+		}
+
+		int * grown = realloc(*values, (*count + (last - first) + 1) * sizeof(int));
+		if (grown == NULL){
+			perror("Error allocating number list");
+			exit(EXIT_FAILURE);
+		}
+		*values = grown;
+		for (long value = first; value <= last; value++){
+			(*values)[(*count)++] = value;
+		}
+
+		if (*position == '\0'){
+			return true;
+		}
+		if (*position != ','){
+			break;
+		}
+		position++;
+	}
+
+	fprintf(stderr, "Invalid %s %s, expected numbers separated by commas%s\n", name, list, ranges ? " or ranges such as 4-7" : "");
+	free(*values);
+	*values = NULL;
+	*count = 0;
+	return false;
+}
+
+bool parseSchedulingPolicy(const char * name, int * policy){
+	if (strcmp(name, "fifo") == 0){
+		*policy = SCHED_FIFO;
+	} else if (strcmp(name, "rr") == 0){
+		*policy = SCHED_RR;
+	} else if (strcmp(name, "other") == 0){
+		*policy = SCHED_OTHER;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+bool checkThreadPlacement(ThreadPlacement * placement){
+	// A CPU outside the affinity of the process, or one that does not exist, would make every pthread_create fail
+	cpu_set_t allowed;
+	if (placement->cpuCount > 0 && sched_getaffinity(0, sizeof(allowed), &allowed) != 0){
+		perror("Error reading the CPUs the process may run on");
+		return false;
+	}
+	for (size_t i = 0; i < placement->cpuCount; i++){
+		if (placement->cpus[i] >= CPU_SETSIZE || !CPU_ISSET(placement->cpus[i], &allowed)){
+			fprintf(stderr, "CPU %d is not one this process may run on\n", placement->cpus[i]);
+			return false;
+		}
+	}
+
+	if (placement->policy == SCHED_OTHER){
+		if (placement->priorityCount > 0){
+			fprintf(stderr, "Priorities only apply to the fifo and rr scheduling policies\n");
+			return false;
+		}
+		return true;
+	}
+
+	int lowest = sched_get_priority_min(placement->policy);
+	int highest = sched_get_priority_max(placement->policy);
+	if (placement->priorityCount == 0){
+		placement->priorities = malloc(sizeof(int));
+		if (placement->priorities == NULL){
+			perror("Error allocating priorities");
+			exit(EXIT_FAILURE);
+		}
+		placement->priorities[0] = lowest;
+		placement->priorityCount = 1;
+	}
+	for (size_t i = 0; i < placement->priorityCount; i++){
+		if (placement->priorities[i] < lowest || placement->priorities[i] > highest){
+			fprintf(stderr, "Priority %d is outside the range %d to %d of the real-time policy\n", placement->priorities[i], lowest, highest);
+			return false;
+		}
+	}
+	return true;
+}
+
+int createPlacedThread(const ThreadPlacement * placement, unsigned index, pthread_t * thread, void *(*start)(void *), void * argument){
+	if (placement == NULL || (placement->cpuCount == 0 && placement->policy == SCHED_OTHER)){
+		return pthread_create(thread, NULL, start, argument);
+	}
+
+	pthread_attr_t attributes;
+	pthread_attr_init(&attributes);
+	if (placement->cpuCount > 0){
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(placement->cpus[index % placement->cpuCount], &cpus);
+		pthread_attr_setaffinity_np(&attributes, sizeof(cpus), &cpus);
+	}
+
+	bool realtime = placement->policy != SCHED_OTHER && !atomic_load(&refused);
+	if (realtime){
+		struct sched_param parameter = {0};
+		parameter.sched_priority = placement->priorities[index < placement->priorityCount ? index : placement->priorityCount - 1];
+		pthread_attr_setinheritsched(&attributes, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attributes, placement->policy);
+		pthread_attr_setschedparam(&attributes, &parameter);
+	}
+
+	int result = pthread_create(thread, &attributes, start, argument);
+
+	// Real-time scheduling needs CAP_SYS_NICE or an RLIMIT_RTPRIO, without them the run goes on with the default scheduler
+	if (result == EPERM && realtime){
+		if (!atomic_exchange(&refused, true)){
+			fprintf(stderr, "The real-time scheduling policy is not permitted (it needs CAP_SYS_NICE or ulimit -r), the threads keep the default scheduler\n");
+		}
+		pthread_attr_setinheritsched(&attributes, PTHREAD_INHERIT_SCHED);
+		result = pthread_create(thread, &attributes, start, argument);
+	}
+	pthread_attr_destroy(&attributes);
+	return result;
+}
+
+bool realtimeRefused(){
+	return atomic_load(&refused);
+}
+
+void printThreadPlacement(FILE * file, const ThreadPlacement * placement){
+	if (placement->cpuCount == 0 && placement->policy == SCHED_OTHER){
+		return;
+	}
+
+	fprintf(file, "Threads ");
+	if (placement->cpuCount > 0){
+		fprintf(file, "pinned in turn to CPU");
+		for (size_t i = 0; i < placement->cpuCount; i++){
+			fprintf(file, "%s %d", i > 0 ? "," : "", placement->cpus[i]);
+		}
+	} else {
+		fprintf(file, "left on any CPU");
+	}
+	if (placement->policy != SCHED_OTHER){
+		fprintf(file, ", under %s at priority", placement->policy == SCHED_FIFO ? "SCHED_FIFO" : "SCHED_RR");
+		for (size_t i = 0; i < placement->priorityCount; i++){
+			fprintf(file, "%s %d", i > 0 ? "," : "", placement->priorities[i]);
+		}
+		if (realtimeRefused()){
+			fprintf(file, ", which the kernel refused");
+		}
+	}
+	fprintf(file, "\n");
+}
+
+void freeThreadPlacement(ThreadPlacement * placement){
+	free(placement->cpus);
+	free(placement->priorities);
+	memset(placement, 0, sizeof(ThreadPlacement));
+}
@@ -0,0 +1,44 @@
+#ifndef THREAD_PLACEMENT_H
+#define THREAD_PLACEMENT_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* Which cores the threads of a pipeline run on and how they are scheduled. A zeroed ThreadPlacement leaves both to the kernel.
+   Threads are numbered in pipeline order, the Reader or read stage first */
+typedef struct ThreadPlacement {
+	int * cpus;           //Thread i is pinned to cpus[i % cpuCount], none are pinned without cpus
+	size_t cpuCount;
+	int policy;           //SCHED_OTHER, or SCHED_FIFO or SCHED_RR for real-time threads
+	int * priorities;     //Thread i runs at priorities[i], or at the last one given, under a real-time policy
+	size_t priorityCount;
+} ThreadPlacement;
+
+/* Parses a comma separated list of numbers, where a CPU list may also hold ranges such as 4-7.
+   Returns false after printing the problem */
+bool parseNumberList(const char * list, const char * name, bool ranges, int ** values, size_t * count);
+
+/* Parses fifo, rr or other into a scheduling policy, returning false for anything else */
+bool parseSchedulingPolicy(const char * name, int * policy);
+
+/* Checks that every CPU is one the process may run on and every priority suits the policy.
+   A real-time policy without priorities gets the lowest real-time priority. Returns false after printing the problem */
+bool checkThreadPlacement(ThreadPlacement * placement);
+
+/* Creates thread number index with its CPU and scheduling. When the kernel does not permit the real-time policy
+   the thread keeps the default scheduler, as does every later thread, and a warning is printed once.
+   Returns the result of pthread_create */
+int createPlacedThread(const ThreadPlacement * placement, unsigned index, pthread_t * thread, void *(*start)(void *), void * argument);
+
+/* Returns whether a real-time policy was asked for and then refused by the kernel */
+bool realtimeRefused();
+
+/* Prints the CPUs and the scheduling of the threads, or nothing when they are left to the kernel */
+void printThreadPlacement(FILE * file, const ThreadPlacement * placement);
+
+/* Frees the lists of a placement, leaving it zeroed */
+void freeThreadPlacement(ThreadPlacement * placement);
+
+#endif
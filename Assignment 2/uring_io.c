@@ -0,0 +1,420 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "uring_io.h"
+
+//Each stream keeps up to this many blocks of this size in flight
+#define URING_QUEUE_DEPTH 4
+#define URING_BLOCK_SIZE (1 << 20)
+
+/* The submission and completion rings shared with the kernel, set up without liburing */
+typedef struct Uring {
+	int fd;
+	void * sqRing;
+	void * cqRing;
+	size_t sqRingSize, cqRingSize;
+	struct io_uring_sqe * sqes;
+	size_t sqesSize;
+
+	unsigned * sqHead, * sqTail, * sqMask, * sqArray;
+	unsigned * cqHead, * cqTail, * cqMask;
+	struct io_uring_cqe * cqes;
+} Uring;
+
+/* A block of a stream and the read or write it is waiting on */
+typedef struct UringBlock {
+	char * data;
+	size_t length;   //Bytes read into the block, or waiting to be written from it
+	size_t consumed; //Bytes of a read block already handed to the caller, or of a write block already written
+	off_t offset;    //Where the block sits in the file
+	bool inFlight;
+	int result;      //Negative errno of a failed read or write, otherwise zero
+} UringBlock;
+
+/* The cookie behind a FILE opened by openUringFile */
+typedef struct UringStream {
+	Uring ring;
+	int fd;
+	bool writing;
+	UringBlock blocks[URING_QUEUE_DEPTH];
+	unsigned current;  //Block being read from, or written into
+	off_t nextOffset;  //Offset of the next block to read, or of the current block to write
+	off_t size;        //Largest offset written so far
+	bool endOfFile;
+	int writeError;    //The errno of the first write that failed, after which the stream stays failed
+} UringStream;
+
+static int uringSetup(unsigned entries, struct io_uring_params * params){
+	return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(int fd, unsigned submit, unsigned waitFor, unsigned flags){
+	return syscall(__NR_io_uring_enter, fd, submit, waitFor, flags, NULL, 0);
+}
+
+//Maps the rings of a new io_uring instance, returning false with errno set when the kernel refuses
+static bool initUring(Uring * ring, unsigned entries){
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+	memset(ring, 0, sizeof(Uring));
+
+	if ((ring->fd = uringSetup(entries, &params)) < 0){
+		return false;
+	}
+
+	ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+	ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqRing == MAP_FAILED || ring->cqRing == MAP_FAILED || ring->sqes == MAP_FAILED){
+		int error = errno;
+		close(ring->fd);
+		errno = error;
+		return false;
+	}
+
+	ring->sqHead = (unsigned *) ((char *) ring->sqRing + params.sq_off.head);
+	ring->sqTail = (unsigned *) ((char *) ring->sqRing + params.sq_off.tail);
+	ring->sqMask = (unsigned *) ((char *) ring->sqRing + params.sq_off.ring_mask);
+	ring->sqArray = (unsigned *) ((char *) ring->sqRing + params.sq_off.array);
+	ring->cqHead = (unsigned *) ((char *) ring->cqRing + params.cq_off.head);
+	ring->cqTail = (unsigned *) ((char *) ring->cqRing + params.cq_off.tail);
+	ring->cqMask = (unsigned *) ((char *) ring->cqRing + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *) ((char *) ring->cqRing + params.cq_off.cqes);
+	return true;
+}
+
+static void freeUring(Uring * ring){
+	munmap(ring->sqes, ring->sqesSize);
+	munmap(ring->cqRing, ring->cqRingSize);
+	munmap(ring->sqRing, ring->sqRingSize);
+	close(ring->fd);
+}
+
+//Queues a read or write of part of a block, from done bytes into it, and submits it straight away
+static void submitBlock(UringStream * stream, unsigned index, size_t done, size_t length){
+	Uring * ring = &stream->ring;
+	UringBlock * block = &stream->blocks[index];
+	unsigned tail = *ring->sqTail;
+	unsigned slot = tail & *ring->sqMask;
+	struct io_uring_sqe * sqe = &ring->sqes[slot];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = stream->writing ? IORING_OP_WRITE : IORING_OP_READ;
+	sqe->fd = stream->fd;
+	sqe->addr = (uintptr_t) (block->data + done);
+	sqe->len = length;
+	sqe->off = block->offset + done;
+	sqe->user_data = index;
+	ring->sqArray[slot] = slot;
+	atomic_store_explicit((_Atomic unsigned *) ring->sqTail, tail + 1, memory_order_release);
+
+	block->inFlight = true;
+	while (uringEnter(ring->fd, 1, 0, 0) < 0 && errno == EINTR){ }
+}
+
+//Records the result of a read or write of a block, and submits the rest of it again when the kernel only did part of it.
+//Every completion is handled here, whichever block the caller was waiting for
+static void finishBlock(UringStream * stream, unsigned index, int result){
+	UringBlock * block = &stream->blocks[index];
+	size_t done = stream->writing ? block->consumed : block->length;
+	size_t wanted = stream->writing ? block->length : URING_BLOCK_SIZE;
+	if (result == -EINTR || result == -EAGAIN){
+		submitBlock(stream, index, done, wanted - done);
+		return;
+	}
+	if (result < 0){
+		block->result = result;
+		if (stream->writing && stream->writeError == 0){
+			stream->writeError = -result;
+		}
+		return;
+	}
+
+	// A read that returns nothing has reached the end of the file, a write that writes nothing would never finish
+	if (!stream->writing){
+		block->length += result;
+		if (result > 0 && block->length < URING_BLOCK_SIZE){
+			submitBlock(stream, index, block->length, URING_BLOCK_SIZE - block->length);
+		}
+		return;
+	}
+	if (result == 0){
+		block->result = -EIO;
+		if (stream->writeError == 0){
+			stream->writeError = EIO;
+		}
+		return;
+	}
+	block->consumed += result;
+	if (block->consumed < block->length){
+		submitBlock(stream, index, block->consumed, block->length - block->consumed);
+		return;
+	}
+	block->length = 0;
+	block->consumed = 0;
+}
+
+//Waits until the kernel completes any request, and finishes its block
+static void completeOne(UringStream * stream){
+	Uring * ring = &stream->ring;
+	unsigned head = *ring->cqHead;
+
+	while (head == atomic_load_explicit((_Atomic unsigned *) ring->cqTail, memory_order_acquire)){
+		if (uringEnter(ring->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR){
+			perror("Error waiting for io_uring");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	struct io_uring_cqe * cqe = &ring->cqes[head & *ring->cqMask];
+	unsigned index = cqe->user_data;
+	int result = cqe->res;
+	stream->blocks[index].inFlight = false;
+	atomic_store_explicit((_Atomic unsigned *) ring->cqHead, head + 1, memory_order_release);
+	finishBlock(stream, index, result);
+}
+
+//Waits until a block is no longer in flight
+static void waitForBlock(UringStream * stream, UringBlock * block){
+	while (block->inFlight){
+		completeOne(stream);
+	}
+}
+
+//Returns false with errno set once any write of the stream has failed
+static bool checkWrites(UringStream * stream){
+	if (stream->writeError != 0){
+		errno = stream->writeError;
+		return false;
+	}
+	return true;
+}
+
+//Starts the read of the next block of the file into a free block
+static void startRead(UringStream * stream, unsigned index){
+	UringBlock * block = &stream->blocks[index];
+	block->offset = stream->nextOffset;
+	block->length = 0;
+	block->consumed = 0;
+	block->result = 0;
+	stream->nextOffset += URING_BLOCK_SIZE;
+	submitBlock(stream, index, 0, URING_BLOCK_SIZE);
+}
+
+static ssize_t uringRead(void * cookie, char * buffer, size_t size){
+	UringStream * stream = cookie;
+	size_t copied = 0;
+
+	while (copied < size && !stream->endOfFile){
+		UringBlock * block = &stream->blocks[stream->current];
+
+		// A short read has already been submitted again for the rest of the block, so only the end of the file leaves it short
+		waitForBlock(stream, block);
+		if (block->result < 0){
+			errno = -block->result;
+			return copied > 0 ? (ssize_t) copied : -1;
+		}
+
+		size_t available = block->length - block->consumed;
+		if (available == 0){
+			if (block->length < URING_BLOCK_SIZE){
+				stream->endOfFile = true;
+				break;
+			}
+			// The block has been used up, so it goes to the back of the queue for the block after the last one
+			startRead(stream, stream->current);
+			stream->current = (stream->current + 1) % URING_QUEUE_DEPTH;
+			continue;
+		}
+
+		size_t length = available < size - copied ? available : size - copied;
+		memcpy(buffer + copied, block->data + block->consumed, length);
+		block->consumed += length;
+		copied += length;
+	}
+	return copied;
+}
+
+//Submits the current block, and moves on to the next one once its previous write has completed
+static bool submitWrite(UringStream * stream){
+	UringBlock * block = &stream->blocks[stream->current];
+	if (block->length == 0){
+		return true;
+	}
+
+	if (!checkWrites(stream)){
+		return false;
+	}
+	block->offset = stream->nextOffset;
+	block->consumed = 0;
+	stream->nextOffset += block->length;
+	if (stream->nextOffset > stream->size){
+		stream->size = stream->nextOffset;
+	}
+	submitBlock(stream, stream->current, 0, block->length);
+
+	// The next block is written into once every part of its previous write has completed
+	stream->current = (stream->current + 1) % URING_QUEUE_DEPTH;
+	waitForBlock(stream, &stream->blocks[stream->current]);
+	return checkWrites(stream);
+}
+
+//Waits for every write in flight, returning false if any of them failed
+static bool drainWrites(UringStream * stream){
+	submitWrite(stream);
+	for (unsigned i = 0; i < URING_QUEUE_DEPTH; i++){
+		waitForBlock(stream, &stream->blocks[i]);
+	}
+	return checkWrites(stream);
+}
+
+static ssize_t uringWrite(void * cookie, const char * buffer, size_t size){
+	UringStream * stream = cookie;
+	size_t copied = 0;
+
+	while (copied < size){
+		UringBlock * block = &stream->blocks[stream->current];
+		size_t length = URING_BLOCK_SIZE - block->length < size - copied ? URING_BLOCK_SIZE - block->length : size - copied;
+		memcpy(block->data + block->length, buffer + copied, length);
+		block->length += length;
+		copied += length;
+
+		if (block->length == URING_BLOCK_SIZE && !submitWrite(stream)){
+			return -1;
+		}
+	}
+	return copied;
+}
+
+//Only output streams can seek, which the PLY writer uses to fill in the element counts
+static int uringSeek(void * cookie, off64_t * offset, int whence){
+	UringStream * stream = cookie;
+	if (!stream->writing){
+		errno = ESPIPE;
+		return -1;
+	}
+
+	// A position within the current block only needs its bytes counted
+	off_t position = stream->nextOffset + stream->blocks[stream->current].length;
+	if (whence == SEEK_CUR && *offset == 0){
+		*offset = position;
+		return 0;
+	}
+
+	if (!drainWrites(stream)){
+		return -1;
+	}
+	off_t size = position > stream->size ? position : stream->size;
+	off_t target = whence == SEEK_SET ? *offset : whence == SEEK_CUR ? position + *offset : size + *offset;
+	if (target < 0){
+		errno = EINVAL;
+		return -1;
+	}
+	stream->nextOffset = target;
+	*offset = target;
+	return 0;
+}
+
+static int uringClose(void * cookie){
+	UringStream * stream = cookie;
+	int result = 0;
+
+	// The kernel may still be reading into or writing from the blocks, so they are only freed once it is done
+	if (stream->writing){
+		result = drainWrites(stream) ? 0 : -1;
+	}
+	for (unsigned i = 0; i < URING_QUEUE_DEPTH; i++){
+		waitForBlock(stream, &stream->blocks[i]);
+		free(stream->blocks[i].data);
+	}
+	freeUring(&stream->ring);
+	if (close(stream->fd) != 0){
+		result = -1;
+	}
+	free(stream);
+	return result;
+}
+
+bool uringAvailable(const char ** reason){
+	Uring ring;
+	if (!initUring(&ring, 1)){
+		*reason = strerror(errno);
+		return false;
+	}
+	freeUring(&ring);
+	return true;
+}
+
+FILE * openUringFile(const char * fileName, const char * mode, bool * usedUring){
+	bool writing = mode[0] == 'w';
+	UringStream * stream = calloc(1, sizeof(UringStream));
+	if (stream == NULL){
+		perror("Error allocating io_uring stream");
+		exit(EXIT_FAILURE);
+	}
+
+	*usedUring = false;
+	if (!initUring(&stream->ring, URING_QUEUE_DEPTH)){
+		free(stream);
+		return fopen(fileName, mode);
+	}
+	if ((stream->fd = writing ? open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0666) : open(fileName, O_RDONLY)) < 0){
+		int error = errno;
+		freeUring(&stream->ring);
+		free(stream);
+		errno = error;
+		return NULL;
+	}
+
+	// Every read and write names its offset, which a pipe, FIFO or terminal does not have, so those use stdio
+	struct stat status;
+	if (fstat(stream->fd, &status) != 0 || !S_ISREG(status.st_mode)){
+		int fd = stream->fd;
+		freeUring(&stream->ring);
+		free(stream);
+		FILE * file = fdopen(fd, mode);
+		if (file == NULL){
+			int error = errno;
+			close(fd);
+			errno = error;
+		}
+		return file;
+	}
+
+	stream->writing = writing;
+	for (unsigned i = 0; i < URING_QUEUE_DEPTH; i++){
+		if ((stream->blocks[i].data = malloc(URING_BLOCK_SIZE)) == NULL){
+			perror("Error allocating io_uring blocks");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	// Reads of the first blocks start straight away, so they are in flight before the first row is asked for
+	if (!writing){
+		for (unsigned i = 0; i < URING_QUEUE_DEPTH; i++){
+			startRead(stream, i);
+		}
+	}
+
+	cookie_io_functions_t functions = {writing ? NULL : uringRead, writing ? uringWrite : NULL, uringSeek, uringClose};
+	FILE * file = fopencookie(stream, mode, functions);
+	if (file == NULL){
+		uringClose(stream);
+		return NULL;
+	}
+	*usedUring = true;
+	return file;
+}
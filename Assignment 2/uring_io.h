@@ -0,0 +1,19 @@
+#ifndef URING_IO_H
+#define URING_IO_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+	Opens a file for reading ("r") or writing ("w") through io_uring, as an ordinary FILE stream.
+	Reads keep several large blocks in flight ahead of the caller, and writes are gathered into
+	large blocks that are submitted without waiting for the previous ones to complete.
+	When io_uring is not available on this kernel, or the file is not a regular file that can be read
+	and written at any offset, the file is opened with stdio instead and usedUring is set to false. Returns NULL with errno set if the file cannot be opened.
+*/
+FILE * openUringFile(const char * fileName, const char * mode, bool * usedUring);
+
+/* Whether io_uring can be used by this process, with the reason when it cannot */
+bool uringAvailable(const char ** reason);
+
+#endif
@@ -0,0 +1,125 @@
+#include <string.h>
+#include "number.h"
+#include "vertex_stats.h"
+
+static const char * axisNames[3] = {"x", "y", "z"};
+
+void initVertexStats(VertexStats * stats, size_t firstRow){
+	memset(stats, 0, sizeof(VertexStats));
+	stats->nextRow = firstRow;
+	for (int i = 0; i < 3; i++){
+		stats->axes[i] = -1;
+	}
+}
+
+//Finds the x, y and z properties of an element, which only counts when it is the vertex element
+static void locateAxes(VertexStats * stats, const PlyElement * element){
+	stats->element = element;
+	for (int i = 0; i < 3; i++){
+		stats->axes[i] = -1;
+		if (element == NULL || strcmp(element->name, "vertex") != 0){
+			continue;
+		}
+		for (size_t p = 0; p < element->propertyCount; p++){
+			if (!element->properties[p].isList && strcmp(element->properties[p].name, axisNames[i]) == 0){
+				stats->axes[i] = p;
+			}
+		}
+	}
+}
+
+//Reads the coordinates of an element row, stepping over the properties in front of and between them
+static bool parseElementVertex(VertexStats * stats, const char * row, size_t length, double vertex[3]){
+	const PlyElement * element = stats->element;
+	const char * position = row;
+	const char * end = row + length;
+	int found = 0;
+
+	for (size_t p = 0; p < element->propertyCount && found < 3; p++){
+		double value;
+		if (!parseDecimal(&position, end, &value)){
+			return false;
+		}
+
+		if (element->properties[p].isList){
+			long long items = (long long) value;
+			for (long long i = 0; i < items; i++){
+				if (!parseDecimal(&position, end, &value)){
+					return false;
+				}
+			}
+			continue;
+		}
+		for (int i = 0; i < 3; i++){
+			if (stats->axes[i] == (int) p){
+				vertex[i] = value;
+				found++;
+			}
+		}
+	}
+	return found == 3;
+}
+
+void addVertexStatsRow(VertexStats * stats, const PlySchema * schema, const char * row, size_t length){
+	double vertex[3];
+	size_t rowIndex = stats->nextRow++;
+
+	if (schema != NULL && schema->isPly){
+		// A binary PLY file cannot be read as text, and only the vertex element holds coordinates
+		if (!stats->schemaChecked){
+			stats->schemaReadable = plySchemaIsConvertible(schema);
+			stats->schemaChecked = true;
+		}
+		if (!stats->schemaReadable){
+			return;
+		}
+		const PlyElement * element = plyElementForRow(schema, rowIndex);
+		if (element != stats->element){
+			locateAxes(stats, element);
+		}
+		if (stats->axes[0] < 0 || stats->axes[1] < 0 || stats->axes[2] < 0){
+			return;
+		}
+		stats->rowsParsed++;
+		if (!parseElementVertex(stats, row, length, vertex)){
+			return;
+		}
+	} else {
+		const char * position = row;
+		const char * end = row + length;
+		stats->rowsParsed++;
+		for (int i = 0; i < 3; i++){
+			if (!parseDecimal(&position, end, &vertex[i])){
+				return;
+			}
+		}
+	}
+
+	for (int i = 0; i < 3; i++){
+		if (stats->count == 0 || vertex[i] < stats->min[i]){
+			stats->min[i] = vertex[i];
+		}
+		if (stats->count == 0 || vertex[i] > stats->max[i]){
+			stats->max[i] = vertex[i];
+		}
+		stats->sum[i] += vertex[i];
+	}
+	stats->count++;
+}
+
+void mergeVertexStats(VertexStats * stats, const VertexStats * other){
+	if (other->count > 0){
+		for (int i = 0; i < 3; i++){
+			if (stats->count == 0 || other->min[i] < stats->min[i]){
+				stats->min[i] = other->min[i];
+			}
+			if (stats->count == 0 || other->max[i] > stats->max[i]){
+				stats->max[i] = other->max[i];
+			}
+			stats->sum[i] += other->sum[i];
+		}
+	}
+	stats->count += other->count;
+	stats->rowsParsed += other->rowsParsed;
+	stats->nextRow = other->nextRow;
+}
@@ -0,0 +1,37 @@
+#ifndef VERTEX_STATS_H
+#define VERTEX_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "ply.h"
+
+/* The bounding box, centroid and count of the vertices of a file, gathered one content row at a time */
+typedef struct VertexStats {
+	size_t count;
+	double min[3], max[3], sum[3];
+
+	size_t nextRow;       //Index of the next content row, used to find the element it belongs to
+	size_t rowsParsed;    //Content rows that were parsed, whether or not they held a vertex
+
+	//Whether the schema has been checked, and can be used to read the rows as text
+	bool schemaChecked, schemaReadable;
+
+	//Where the x, y and z properties sit within the element of the previous row, -1 when it has none
+	const PlyElement * element;
+	int axes[3];
+} VertexStats;
+
+/* Sets up empty statistics whose next content row has the given index */
+void initVertexStats(VertexStats * stats, size_t firstRow);
+
+/*
+	Parses the x, y and z coordinates of the next content row and adds them to the statistics.
+	With an ascii PLY schema only rows of the vertex element are counted, using its x, y and z
+	properties. Without a PLY header the first three numbers of every row are used.
+*/
+void addVertexStatsRow(VertexStats * stats, const PlySchema * schema, const char * row, size_t length);
+
+/* Adds the statistics of other, gathered over a later part of the same file, to stats */
+void mergeVertexStats(VertexStats * stats, const VertexStats * other);
+
+#endif
@@ -0,0 +1,498 @@
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "number.h"
+#include "search.h"
+#include "where.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+
+typedef void (*WhereCompare)(const double * column, size_t words, WhereOp op, double limit, uint64_t * mask);
+
+static WhereCompare chosenCompare;
+static const char * chosenCompareName;
+static pthread_once_t chooseCompareOnce = PTHREAD_ONCE_INIT;
+
+static const char * axisNames[3] = {"x", "y", "z"};
+
+/* --- Compiling --- */
+
+typedef struct WhereParser {
+	WhereProgram * program;
+	const char * position;
+	unsigned depth; //Masks on the stack after the steps emitted so far
+} WhereParser;
+
+static bool failParse(WhereParser * parser, const char * expected){
+	fprintf(stderr, "The --where expression \"%s\" needs %s at %s%s%s\n", parser->program->text, expected,
+		*parser->position != '\0' ? "\"" : "", *parser->position != '\0' ? parser->position : "its end", *parser->position != '\0' ? "\"" : "");
+	return false;
+}
+
+static void skipBlanks(WhereParser * parser){
+	while (isspace((unsigned char) *parser->position)){
+		parser->position++;
+	}
+}
+
+//Moves past a token if it comes next
+static bool takeToken(WhereParser * parser, const char * token){
+	skipBlanks(parser);
+	size_t length = strlen(token);
+	if (strncmp(parser->position, token, length) != 0){
+		return false;
+	}
+	parser->position += length;
+	return true;
+}
+
+static bool emitStep(WhereParser * parser, WhereOp op, unsigned axis, double limit){
+	WhereProgram * program = parser->program;
+	if (program->stepCount == MAX_WHERE_STEPS){
+		fprintf(stderr, "The --where expression \"%s\" has more than %d comparisons and operators\n", program->text, MAX_WHERE_STEPS);
+		return false;
+	}
+	program->steps[program->stepCount++] = (WhereStep) {op, axis, limit};
+
+	// A comparison pushes a mask, && and || replace two masks with one, and ! changes the mask on top in place
+	if (op <= WhereNotEqual){
+		parser->depth++;
+		program->axesUsed[axis] = true;
+		program->axisCount = axis + 1 > program->axisCount ? axis + 1 : program->axisCount;
+	} else if (op != WhereNot){
+		parser->depth--;
+	}
+	program->depth = parser->depth > program->depth ? parser->depth : program->depth;
+	return true;
+}
+
+//Reads x, y or z, returning -1 when the next token is not a coordinate
+static int takeAxis(WhereParser * parser){
+	skipBlanks(parser);
+	for (int i = 0; i < 3; i++){
+		if (parser->position[0] == axisNames[i][0] && !isalnum((unsigned char) parser->position[1]) && parser->position[1] != '_'){
+			parser->position++;
+			return i;
+		}
+	}
+	return -1;
+}
+
+static bool takeNumber(WhereParser * parser, double * value){
+	skipBlanks(parser);
+	char * end;
+	*value = strtod(parser->position, &end);
+	if (end == parser->position){
+		return false;
+	}
+	parser->position = end;
+	return true;
+}
+
+//Reads a comparison operator, the longer ones first so that <= is not taken for <
+static bool takeComparison(WhereParser * parser, WhereOp * op){
+	static const struct { const char * token; WhereOp op; } operators[] = {
+		{"<=", WhereLessEqual}, {">=", WhereGreaterEqual}, {"==", WhereEqual}, {"!=", WhereNotEqual},
+		{"<", WhereLess}, {">", WhereGreater}, {"=", WhereEqual}
+	};
+	for (size_t i = 0; i < sizeof(operators) / sizeof(operators[0]); i++){
+		if (takeToken(parser, operators[i].token)){
+			*op = operators[i].op;
+			return true;
+		}
+	}
+	return false;
+}
+
+//A coordinate compared with a number, either way round
+static bool parseComparison(WhereParser * parser){
+	WhereOp op;
+	double limit;
+	int axis = takeAxis(parser);
+	if (axis >= 0){
+		if (!takeComparison(parser, &op)){
+			return failParse(parser, "a comparison such as <, <=, >, >=, == or !=");
+		}
+		if (!takeNumber(parser, &limit)){
+			return failParse(parser, "a number");
+		}
+		return emitStep(parser, op, axis, limit);
+	}
+
+	if (!takeNumber(parser, &limit)){
+		return failParse(parser, "x, y, z, a number, ! or (");
+	}
+	if (!takeComparison(parser, &op)){
+		return failParse(parser, "a comparison such as <, <=, >, >=, == or !=");
+	}
+	if ((axis = takeAxis(parser)) < 0){
+		return failParse(parser, "x, y or z");
+	}
+	// 16 < z is z > 16
+	static const WhereOp mirrored[] = {WhereGreater, WhereGreaterEqual, WhereLess, WhereLessEqual, WhereEqual, WhereNotEqual};
+	return emitStep(parser, mirrored[op], axis, limit);
+}
+
+static bool parseOr(WhereParser * parser);
+
+static bool parseUnary(WhereParser * parser){
+	skipBlanks(parser);
+	if (parser->position[0] == '!' && parser->position[1] != '='){
+		parser->position++;
+		return parseUnary(parser) && emitStep(parser, WhereNot, 0, 0);
+	}
+	if (takeToken(parser, "(")){
+		if (!parseOr(parser)){
+			return false;
+		}
+		return takeToken(parser, ")") || failParse(parser, "a closing )");
+	}
+	return parseComparison(parser);
+}
+
+static bool parseAnd(WhereParser * parser){
+	if (!parseUnary(parser)){
+		return false;
+	}
+	while (takeToken(parser, "&&")){
+		if (!parseUnary(parser) || !emitStep(parser, WhereAnd, 0, 0)){
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool parseOr(WhereParser * parser){
+	if (!parseAnd(parser)){
+		return false;
+	}
+	while (takeToken(parser, "||")){
+		if (!parseAnd(parser) || !emitStep(parser, WhereOr, 0, 0)){
+			return false;
+		}
+	}
+	return true;
+}
+
+bool compileWhere(WhereProgram * program, const char * text){
+	memset(program, 0, sizeof(WhereProgram));
+	program->text = text;
+	WhereParser parser = {program, text, 0};
+	if (!parseOr(&parser)){
+		return false;
+	}
+	skipBlanks(&parser);
+	if (*parser.position != '\0'){
+		return failParse(&parser, "&&, || or the end of the expression");
+	}
+	return true;
+}
+
+/* --- Comparing --- */
+
+/*
+	Every version compares a column 64 rows at a time, a vector of rows per instruction, and gathers the result
+	into one bit per row. The operator is chosen outside the loops, so each loop is a single compare instruction.
+	A NaN coordinate only matches !=, the same as in C.
+*/
+#define COMPARE_WORDS(LANES, BITS) \
+	for (size_t w = 0; w < words; w++){ \
+		uint64_t bits = 0; \
+		for (unsigned k = 0; k < 64; k += LANES){ \
+			const double * values = column + w * 64 + k; \
+			bits |= (uint64_t) (BITS) << k; \
+		} \
+		mask[w] = bits; \
+	}
+
+static void compareScalar(const double * column, size_t words, WhereOp op, double limit, uint64_t * mask){
+	switch (op){
+	case WhereLess: COMPARE_WORDS(1, values[0] < limit); break;
+	case WhereLessEqual: COMPARE_WORDS(1, values[0] <= limit); break;
+	case WhereGreater: COMPARE_WORDS(1, values[0] > limit); break;
+	case WhereGreaterEqual: COMPARE_WORDS(1, values[0] >= limit); break;
+	case WhereEqual: COMPARE_WORDS(1, values[0] == limit); break;
+	default: COMPARE_WORDS(1, values[0] != limit); break;
+	}
+}
+
+#ifdef HAVE_X86_SIMD
+__attribute__((target("sse2")))
+static void compareSse2(const double * column, size_t words, WhereOp op, double limit, uint64_t * mask){
+	const __m128d bound = _mm_set1_pd(limit);
+	switch (op){
+	case WhereLess: COMPARE_WORDS(2, _mm_movemask_pd(_mm_cmplt_pd(_mm_loadu_pd(values), bound))); break;
+	case WhereLessEqual: COMPARE_WORDS(2, _mm_movemask_pd(_mm_cmple_pd(_mm_loadu_pd(values), bound))); break;
+	case WhereGreater: COMPARE_WORDS(2, _mm_movemask_pd(_mm_cmpgt_pd(_mm_loadu_pd(values), bound))); break;
+	case WhereGreaterEqual: COMPARE_WORDS(2, _mm_movemask_pd(_mm_cmpge_pd(_mm_loadu_pd(values), bound))); break;
+	case WhereEqual: COMPARE_WORDS(2, _mm_movemask_pd(_mm_cmpeq_pd(_mm_loadu_pd(values), bound))); break;
+	default: COMPARE_WORDS(2, _mm_movemask_pd(_mm_cmpneq_pd(_mm_loadu_pd(values), bound))); break;
+	}
+}
+
+__attribute__((target("avx2")))
+static void compareAvx2(const double * column, size_t words, WhereOp op, double limit, uint64_t * mask){
+	const __m256d bound = _mm256_set1_pd(limit);
+	switch (op){
+	case WhereLess: COMPARE_WORDS(4, _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(values), bound, _CMP_LT_OQ))); break;
+	case WhereLessEqual: COMPARE_WORDS(4, _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(values), bound, _CMP_LE_OQ))); break;
+	case WhereGreater: COMPARE_WORDS(4, _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(values), bound, _CMP_GT_OQ))); break;
+	case WhereGreaterEqual: COMPARE_WORDS(4, _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(values), bound, _CMP_GE_OQ))); break;
+	case WhereEqual: COMPARE_WORDS(4, _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(values), bound, _CMP_EQ_OQ))); break;
+	default: COMPARE_WORDS(4, _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(values), bound, _CMP_NEQ_UQ))); break;
+	}
+}
+#endif
+
+static void chooseCompare(){
+#ifdef HAVE_X86_SIMD
+	if (cpuSupportsAvx2()){
+		chosenCompare = compareAvx2;
+		chosenCompareName = "avx2";
+		return;
+	}
+	if (cpuSupportsSse2()){
+		chosenCompare = compareSse2;
+		chosenCompareName = "sse2";
+		return;
+	}
+#endif
+	chosenCompare = compareScalar;
+	chosenCompareName = "scalar";
+}
+
+const char * whereCompareName(){
+	pthread_once(&chooseCompareOnce, chooseCompare);
+	return chosenCompareName;
+}
+
+/* --- Filtering --- */
+
+static void * allocateOrExit(void * pointer){
+	if (pointer == NULL){
+		perror("Error allocating the --where columns");
+		exit(EXIT_FAILURE);
+	}
+	return pointer;
+}
+
+void initWhereFilter(WhereFilter * filter, const WhereProgram * program, size_t maxRows){
+	memset(filter, 0, sizeof(WhereFilter));
+	filter->program = program;
+	initPlySchema(&filter->header);
+	for (int i = 0; i < 3; i++){
+		filter->axes[i] = -1;
+	}
+
+	// The last mask is padded to 64 rows, which are compared like the others and then masked out
+	filter->capacity = (maxRows + 63) / 64 * 64;
+	for (int i = 0; i < 3; i++){
+		filter->columns[i] = allocateOrExit(calloc(filter->capacity, sizeof(double)));
+	}
+	filter->parsed = allocateOrExit(calloc(filter->capacity / 64, sizeof(uint64_t)));
+	filter->masks = allocateOrExit(calloc((size_t) (program->depth > 0 ? program->depth : 1) * (filter->capacity / 64), sizeof(uint64_t)));
+}
+
+void freeWhereFilter(WhereFilter * filter){
+	for (int i = 0; i < 3; i++){
+		free(filter->columns[i]);
+		filter->columns[i] = NULL;
+	}
+	free(filter->parsed);
+	free(filter->masks);
+	filter->parsed = NULL;
+	filter->masks = NULL;
+	freePlySchema(&filter->header);
+}
+
+void addWhereHeaderRow(WhereFilter * filter, const char * row, size_t length){
+	parsePlyHeaderRow(&filter->header, row, length);
+}
+
+//Finds the x, y and z properties of an element, which only counts when it is the vertex element
+static void locateAxes(WhereFilter * filter, const PlyElement * element){
+	filter->element = element;
+	for (int i = 0; i < 3; i++){
+		filter->axes[i] = -1;
+		if (element == NULL || strcmp(element->name, "vertex") != 0){
+			continue;
+		}
+		for (size_t p = 0; p < element->propertyCount; p++){
+			if (!element->properties[p].isList && strcmp(element->properties[p].name, axisNames[i]) == 0){
+				filter->axes[i] = p;
+			}
+		}
+	}
+}
+
+static bool isBlank(char c){
+	return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+//Moves position past the next field of a row without converting it, returning false if the row has no more fields
+static bool skipField(const char ** position, const char * end){
+	while (*position < end && isBlank(**position)){
+		(*position)++;
+	}
+	if (*position == end){
+		return false;
+	}
+	while (*position < end && !isBlank(**position)){
+		(*position)++;
+	}
+	return true;
+}
+
+//Reads the coordinates the program compares from a row of the vertex element, stepping over the other properties
+static bool parseElementAxes(WhereFilter * filter, const char * row, size_t length, double values[3]){
+	const PlyElement * element = filter->element;
+	const bool * used = filter->program->axesUsed;
+	const char * position = row;
+	const char * end = row + length;
+	unsigned needed = used[0] + used[1] + used[2];
+	unsigned found = 0;
+
+	for (size_t p = 0; p < element->propertyCount && found < needed; p++){
+		if (element->properties[p].isList){
+			double count;
+			if (!parseDecimal(&position, end, &count)){
+				return false;
+			}
+			for (long long i = 0; i < (long long) count; i++){
+				if (!skipField(&position, end)){
+					return false;
+				}
+			}
+			continue;
+		}
+
+		int axis = -1;
+		for (int i = 0; i < 3; i++){
+			if (used[i] && filter->axes[i] == (int) p){
+				axis = i;
+			}
+		}
+		if (axis < 0 ? !skipField(&position, end) : !parseDecimal(&position, end, &values[axis])){
+			return false;
+		}
+		found += axis >= 0;
+	}
+	return found == needed;
+}
+
+//Reads the coordinates the program compares from the first three numbers of a row, stopping after the last of them
+static bool parseLeadingAxes(WhereFilter * filter, const char * row, size_t length, double values[3]){
+	const char * position = row;
+	const char * end = row + length;
+	for (unsigned i = 0; i < filter->program->axisCount; i++){
+		if (filter->program->axesUsed[i] ? !parseDecimal(&position, end, &values[i]) : !skipField(&position, end)){
+			return false;
+		}
+	}
+	return true;
+}
+
+//Whether the header can be parsed and declares the vertex element, otherwise the rows are read as if there was no header
+static bool hasVertexElement(const PlySchema * header){
+	if (!plySchemaIsConvertible(header)){
+		return false;
+	}
+	for (size_t e = 0; e < header->elementCount; e++){
+		if (strcmp(header->elements[e].name, "vertex") == 0){
+			return true;
+		}
+	}
+	return false;
+}
+
+void addWhereRow(WhereFilter * filter, const char * row, size_t length){
+	size_t index = filter->rowCount++;
+	size_t rowIndex = filter->nextRow++;
+	double values[3] = {0, 0, 0};
+	bool parsed = false;
+
+	// The header is complete once the first content row arrives
+	if (!filter->schemaChecked){
+		filter->schemaUsed = filter->header.isPly && hasVertexElement(&filter->header);
+		filter->schemaChecked = true;
+	}
+
+	if (filter->schemaUsed){
+		const PlyElement * element = plyElementForRow(&filter->header, rowIndex);
+		if (element != filter->element){
+			locateAxes(filter, element);
+		}
+		bool present = element != NULL;
+		for (int i = 0; i < 3; i++){
+			present = present && (!filter->program->axesUsed[i] || filter->axes[i] >= 0);
+		}
+		parsed = present && parseElementAxes(filter, row, length, values);
+	} else {
+		parsed = parseLeadingAxes(filter, row, length, values);
+	}
+
+	for (int i = 0; i < 3; i++){
+		filter->columns[i][index] = values[i];
+	}
+	if (parsed){
+		filter->parsed[index / 64] |= 1ull << (index % 64);
+	}
+}
+
+void skipWhereRow(WhereFilter * filter){
+	filter->nextRow++;
+}
+
+size_t selectWhereRows(WhereFilter * filter, size_t * selected){
+	const WhereProgram * program = filter->program;
+	size_t words = (filter->rowCount + 63) / 64;
+	size_t stride = filter->capacity / 64;
+	uint64_t * masks = filter->masks;
+	unsigned top = 0;
+	pthread_once(&chooseCompareOnce, chooseCompare);
+
+	for (unsigned s = 0; s < program->stepCount; s++){
+		const WhereStep * step = &program->steps[s];
+		switch (step->op){
+		case WhereAnd:
+		case WhereOr:
+			top--;
+			uint64_t * below = masks + (size_t) (top - 1) * stride;
+			const uint64_t * above = masks + (size_t) top * stride;
+			for (size_t w = 0; w < words; w++){
+				below[w] = step->op == WhereAnd ? below[w] & above[w] : below[w] | above[w];
+			}
+			break;
+		case WhereNot:
+			for (size_t w = 0; w < words; w++){
+				masks[(size_t) (top - 1) * stride + w] = ~masks[(size_t) (top - 1) * stride + w];
+			}
+			break;
+		default:
+			chosenCompare(filter->columns[step->axis], words, step->op, step->limit, masks + (size_t) top * stride);
+			top++;
+			break;
+		}
+	}
+
+	// The mask is compacted into the positions of its set bits, the rows whose coordinates could not be parsed never match
+	size_t kept = 0;
+	for (size_t w = 0; w < words; w++){
+		uint64_t bits = masks[w] & filter->parsed[w];
+		while (bits != 0){
+			selected[kept++] = w * 64 + __builtin_ctzll(bits);
+			bits &= bits - 1;
+		}
+		filter->parsed[w] = 0;
+	}
+	filter->rowsTested += filter->rowCount;
+	filter->rowsKept += kept;
+	filter->rowCount = 0;
+	return kept;
+}
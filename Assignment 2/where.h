@@ -0,0 +1,88 @@
+#ifndef WHERE_H
+#define WHERE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "ply.h"
+
+#define MAX_WHERE_STEPS 64
+
+/* What a step of a compiled expression does, compare a coordinate with a number or combine the masks of earlier steps */
+typedef enum WhereOp {
+	WhereLess,
+	WhereLessEqual,
+	WhereGreater,
+	WhereGreaterEqual,
+	WhereEqual,
+	WhereNotEqual,
+	WhereAnd,
+	WhereOr,
+	WhereNot
+} WhereOp;
+
+typedef struct WhereStep {
+	WhereOp op;
+	unsigned axis; //0 for x, 1 for y and 2 for z, only for comparisons
+	double limit;
+} WhereStep;
+
+/* An expression such as "z > 16.0 && x < -0.9", compiled once into steps that each push or combine a mask of the rows
+   of a batch, in postfix order. A zeroed program is empty */
+typedef struct WhereProgram {
+	const char * text;
+	WhereStep steps[MAX_WHERE_STEPS];
+	unsigned stepCount;
+	unsigned depth;     //The most masks on the stack at once
+	bool axesUsed[3];
+	unsigned axisCount; //The coordinates up to the last one the expression compares, so the rest of a row is never parsed
+} WhereProgram;
+
+/* Evaluates a program over the content rows of one batch after another. The coordinates are parsed into columns, which are
+   compared a whole vector of rows at a time into bit masks of 64 rows, and the matching rows are then compacted out of the mask.
+   The coordinates are the x, y and z properties of the vertex element of a PLY header, or the first three numbers of each row
+   without a header that can be parsed and declares a vertex element. Rows without them never match */
+typedef struct WhereFilter {
+	const WhereProgram * program;
+	PlySchema header;      //The header rows of the input, which place the coordinates within the rows of each element
+	size_t nextRow;        //Index of the next content row, used to find the element it belongs to
+	const PlyElement * element;
+	int axes[3];           //Where the coordinates sit within the element of the previous row, -1 when it has none
+	bool schemaChecked, schemaUsed; //Whether the header has been looked at, and places the coordinates instead of the first numbers
+
+	size_t capacity;       //Rows of a batch, rounded up to a multiple of 64
+	size_t rowCount;       //Rows added since the last selectWhereRows
+	double * columns[3];
+	uint64_t * parsed;     //A bit for every row whose coordinates could all be parsed
+	uint64_t * masks;      //The stack of masks, depth masks of capacity bits
+
+	size_t rowsTested, rowsKept;
+} WhereFilter;
+
+/* Compiles an expression of comparisons of x, y or z with a number, by <, <=, >, >=, == or !=, joined by && and ||,
+   negated by ! and grouped by parentheses. Returns false after printing the problem */
+bool compileWhere(WhereProgram * program, const char * text);
+
+/* Sets up a filter of a program for batches of up to maxRows content rows */
+void initWhereFilter(WhereFilter * filter, const WhereProgram * program, size_t maxRows);
+
+/* Releases the columns and the header of a filter */
+void freeWhereFilter(WhereFilter * filter);
+
+/* Adds a header row of the input, which the coordinates of the content rows are found with */
+void addWhereHeaderRow(WhereFilter * filter, const char * row, size_t length);
+
+/* Parses the coordinates of the next content row of the batch into the columns */
+void addWhereRow(WhereFilter * filter, const char * row, size_t length);
+
+/* Counts a content row that an earlier filter left out, so that the rows after it are still placed in their element */
+void skipWhereRow(WhereFilter * filter);
+
+/* Evaluates the program over the rows added since the last call, writing the positions of the matching rows among them
+   to selected in order, and returns how many matched. The next row added starts a new batch */
+size_t selectWhereRows(WhereFilter * filter, size_t * selected);
+
+/* Returns the name of the vector compares chosen for this CPU */
+const char * whereCompareName();
+
+#endif